@@ -0,0 +1,483 @@
+/*  nbt_bench - Benchmarks of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+/* Usage: nbt-bench [--scale N] [--min-time MS] [--filter NAME] [--json FILE]
+ *
+ * Every benchmark runs on trees generated from a fixed seed, so two runs of
+ * the same version measure the same work. The human readable table goes to
+ * stderr, the JSON report to stdout or to the `--json` file. */
+
+#include "nbt.h"
+#include "nbt_pool.h"
+#include "nbt_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#define BENCH_SEED 0x6e6274
+
+typedef struct BenchResult
+{
+  const char *name;
+  int iterations;
+  /** Median time of one iteration, in nanoseconds */
+  double ns_per_iter;
+  /** Bytes handled by one iteration, 0 if it doesn't make sense */
+  guint64 bytes;
+  /** Nodes handled by one iteration */
+  guint64 nodes;
+  /** Peak RSS after the benchmark, in KiB */
+  glong peak_rss;
+} BenchResult;
+
+typedef void (*BenchFunc) (gpointer data);
+
+static gint64 min_time = 500 * 1000;
+
+static glong
+peak_rss (void)
+{
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static int
+compare_double (gconstpointer a, gconstpointer b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Run `func` until `min_time` passed (at least 3 samples), and take the
+ * median so a single slow run doesn't move the result. Fast functions are
+ * repeated in every sample to stay above the clock resolution. `setup` runs
+ * outside the timing, for the benchmarks consuming their input. */
+static void
+bench_run (BenchResult *result, BenchFunc setup, BenchFunc func, gpointer data)
+{
+  GArray *times = g_array_new (FALSE, FALSE, sizeof (double));
+  gint64 total = 0;
+  int repeat = 1;
+  while (total < min_time || times->len < 3)
+    {
+      if (setup)
+        setup (data);
+      gint64 start = g_get_monotonic_time ();
+      for (int i = 0; i < repeat; i++)
+        func (data);
+      gint64 passed = g_get_monotonic_time () - start;
+      total += passed;
+      if (!setup && passed < 1000 && repeat < (1 << 20))
+        {
+          /* Too short to be measured, drop it */
+          repeat *= 2;
+          continue;
+        }
+      double ns = passed * 1000.0 / repeat;
+      g_array_append_val (times, ns);
+    }
+  g_array_sort (times, compare_double);
+  result->iterations = times->len;
+  result->ns_per_iter = g_array_index (times, double, times->len / 2);
+  result->peak_rss = peak_rss ();
+  g_array_free (times, TRUE);
+}
+
+/* The tree looks like a chunk: sections with palettes and packed block
+ * states, entities with Pos/Motion lists, and some strings. */
+static NbtNode *
+bench_tree_new (GRand *rand, int scale)
+{
+  NbtNode *root = nbt_node_new_compound ("");
+  nbt_node_prepend (root, nbt_node_new_int ("DataVersion", 3465));
+  NbtNode *sections = nbt_node_new_list ("sections");
+  for (int i = 0; i < 24 * scale; i++)
+    {
+      NbtNode *section = nbt_node_new_compound (NULL);
+      nbt_node_prepend (section, nbt_node_new_byte ("Y", i % 24 - 4));
+      NbtNode *states = nbt_node_new_compound ("block_states");
+      NbtNode *palette = nbt_node_new_list ("palette");
+      for (int j = 0; j < 16; j++)
+        {
+          NbtNode *block = nbt_node_new_compound (NULL);
+          char *name = g_strdup_printf ("minecraft:block_%u",
+                                        g_rand_int_range (rand, 0, 1000));
+          nbt_node_prepend (block, nbt_node_new_string ("Name", name));
+          g_free (name);
+          nbt_node_prepend (palette, block);
+        }
+      nbt_node_prepend (states, palette);
+      gint64 data[256];
+      for (int j = 0; j < 256; j++)
+        data[j] = ((gint64)g_rand_int (rand) << 32) | g_rand_int (rand);
+      nbt_node_prepend (states, nbt_node_new_long_array ("data", data, 256));
+      nbt_node_prepend (section, states);
+      nbt_node_prepend (sections, section);
+    }
+  nbt_node_prepend (root, sections);
+
+  NbtNode *entities = nbt_node_new_list ("entities");
+  for (int i = 0; i < 64 * scale; i++)
+    {
+      NbtNode *entity = nbt_node_new_compound (NULL);
+      nbt_node_prepend (entity,
+                        nbt_node_new_string ("id", "minecraft:zombie"));
+      nbt_node_prepend (entity,
+                        nbt_node_new_string ("CustomName",
+                                             "Zombie \xc3\xa9\xe2\x9c\x93"));
+      NbtNode *pos = nbt_node_new_list ("Pos");
+      NbtNode *motion = nbt_node_new_list ("Motion");
+      for (int j = 0; j < 3; j++)
+        {
+          double x = g_rand_double_range (rand, -1e4, 1e4);
+          nbt_node_prepend (pos, nbt_node_new_double (NULL, x));
+          double v = g_rand_double (rand);
+          nbt_node_prepend (motion, nbt_node_new_double (NULL, v));
+        }
+      nbt_node_prepend (entity, pos);
+      nbt_node_prepend (entity, motion);
+      nbt_node_prepend (entity, nbt_node_new_float ("Health", 20.0f));
+      nbt_node_prepend (entity, nbt_node_new_short ("Fire", -1));
+      nbt_node_prepend (entity, nbt_node_new_long ("UUIDMost",
+                                                   g_rand_int (rand)));
+      nbt_node_prepend (entities, entity);
+    }
+  nbt_node_prepend (root, entities);
+  return root;
+}
+
+/* Strings only, with 2 and 3 bytes characters to make the MUTF-8 conversion
+ * the main cost. */
+static NbtNode *
+bench_string_tree_new (GRand *rand, int scale)
+{
+  static const char *const words[]
+      = { "stone", "\xc3\xa9t\xc3\xa9", "\xe7\x9f\xb3\xe5\xa4\xb4",
+          "\xd0\xba\xd0\xb0\xd0\xbc\xd0\xb5\xd0\xbd\xd1\x8c",
+          "\xf0\x9f\xaa\xa8 rock" };
+  NbtNode *root = nbt_node_new_compound ("");
+  NbtNode *list = nbt_node_new_list ("strings");
+  for (int i = 0; i < 4096 * scale; i++)
+    {
+      GString *string = g_string_new (NULL);
+      for (int j = 0; j < 8; j++)
+        g_string_append (string,
+                         words[g_rand_int_range (rand, 0,
+                                                 G_N_ELEMENTS (words))]);
+      nbt_node_prepend (list, nbt_node_new_string (NULL, string->str));
+      g_string_free (string, TRUE);
+    }
+  nbt_node_prepend (root, list);
+  return root;
+}
+
+typedef struct BenchData
+{
+  NbtNode *tree;
+  guint8 *packed;
+  size_t packed_len;
+  NBT_Compression compression;
+  NbtPackFlags pack_flags;
+  NbtNode *scratch;
+  const char **keys;
+  int n_keys;
+} BenchData;
+
+static void
+bench_parse (gpointer user_data)
+{
+  BenchData *data = user_data;
+  GError *err = NULL;
+  NbtNode *node = nbt_node_new_opt (data->packed, data->packed_len, &err, NULL,
+                                    NULL, NULL, 0, 0);
+  if (!node)
+    g_error ("Parsing failed: %s", err ? err->message : "unknown");
+  nbt_node_free (node);
+}
+
+static void
+bench_pack (gpointer user_data)
+{
+  BenchData *data = user_data;
+  size_t len = 0;
+  g_free (nbt_node_pack_with_flags (data->tree, &len, data->compression,
+                                    data->pack_flags, NULL, NULL, NULL, NULL,
+                                    NULL, NULL));
+}
+
+static void
+bench_lookup (gpointer user_data)
+{
+  BenchData *data = user_data;
+  for (int i = 0; i < data->n_keys; i++)
+    if (!nbt_node_child_to_key (data->scratch, data->keys[i]))
+      g_error ("Key %s not found", data->keys[i]);
+}
+
+static void
+bench_dup (gpointer user_data)
+{
+  BenchData *data = user_data;
+  nbt_node_free (nbt_node_dup (data->tree));
+}
+
+static void
+bench_free_setup (gpointer user_data)
+{
+  BenchData *data = user_data;
+  data->scratch = nbt_node_dup (data->tree);
+}
+
+static void
+bench_free (gpointer user_data)
+{
+  BenchData *data = user_data;
+  nbt_node_free (data->scratch);
+  data->scratch = NULL;
+}
+
+static guint8 *
+pack (NbtNode *tree, NBT_Compression compression, size_t *len)
+{
+  GError *err = NULL;
+  guint8 *ret = nbt_node_pack_full (tree, len, compression, &err, NULL, NULL,
+                                    NULL, NULL);
+  if (!ret)
+    g_error ("Packing failed: %s", err ? err->message : "unknown");
+  return ret;
+}
+
+/* Packing and parsing again must give the same bytes, or the numbers below
+ * measure something broken. */
+static void
+check_round_trip (NbtNode *tree)
+{
+  size_t len = 0;
+  guint8 *packed = pack (tree, NBT_Compression_NONE, &len);
+  NbtNode *node = nbt_node_new (packed, len);
+  size_t len2 = 0;
+  guint8 *packed2 = pack (node, NBT_Compression_NONE, &len2);
+  if (len != len2 || memcmp (packed, packed2, len) != 0)
+    g_error ("Round trip of the benchmark tree failed");
+  nbt_node_free (node);
+  g_free (packed);
+  g_free (packed2);
+}
+
+static gboolean
+bench_enabled (const char *filter, const char *name)
+{
+  return !filter || strstr (name, filter);
+}
+
+static const char *const compression_names[]
+    = { NULL, "gzip", "zlib", "none" };
+
+int
+main (int argc, char **argv)
+{
+  int scale = 16;
+  int min_time_ms = 500;
+  char *filter = NULL;
+  char *json = NULL;
+  gboolean pool = FALSE;
+  gboolean parallel = FALSE;
+  GOptionEntry entries[]
+      = { { "scale", 's', 0, G_OPTION_ARG_INT, &scale,
+            "Size of the generated trees", "N" },
+          { "min-time", 't', 0, G_OPTION_ARG_INT, &min_time_ms,
+            "Minimum time of every benchmark", "MS" },
+          { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+            "Only run the benchmarks containing NAME", "NAME" },
+          { "json", 'j', 0, G_OPTION_ARG_FILENAME, &json,
+            "Write the JSON report to FILE instead of stdout", "FILE" },
+          { "pool", 'p', 0, G_OPTION_ARG_NONE, &pool,
+            "Recycle the freed nodes through the pool", NULL },
+          { "parallel", 'P', 0, G_OPTION_ARG_NONE, &parallel,
+            "Pack and compress the large trees on several threads", NULL },
+          G_OPTION_ENTRY_NULL };
+  GOptionContext *context = g_option_context_new ("- benchmark nbt-glib");
+  g_option_context_add_main_entries (context, entries, NULL);
+  GError *err = NULL;
+  if (!g_option_context_parse (context, &argc, &argv, &err))
+    {
+      fprintf (stderr, "%s\n", err->message);
+      return 1;
+    }
+  g_option_context_free (context);
+  min_time = (gint64)min_time_ms * 1000;
+  scale = MAX (scale, 1);
+  nbt_pool_set_enabled (pool);
+
+  GRand *rand = g_rand_new_with_seed (BENCH_SEED);
+  NbtNode *tree = bench_tree_new (rand, scale);
+  NbtNode *strings = bench_string_tree_new (rand, scale);
+  g_rand_free (rand);
+  check_round_trip (tree);
+  check_round_trip (strings);
+  guint64 tree_nodes = g_node_n_nodes (tree, G_TRAVERSE_ALL);
+  guint64 string_nodes = g_node_n_nodes (strings, G_TRAVERSE_ALL);
+  size_t raw_len = 0;
+  g_free (pack (tree, NBT_Compression_NONE, &raw_len));
+  size_t string_len = 0;
+  g_free (pack (strings, NBT_Compression_NONE, &string_len));
+
+  GArray *results = g_array_new (FALSE, TRUE, sizeof (BenchResult));
+  BenchData data = { 0 };
+  if (parallel)
+    data.pack_flags = NBT_PACK_PARALLEL | NBT_PACK_PARALLEL_COMPRESS;
+  BenchResult result;
+
+  for (NBT_Compression c = NBT_Compression_GZIP; c <= NBT_Compression_NONE;
+       c++)
+    {
+      char *name = g_strdup_printf ("parse_%s", compression_names[c]);
+      if (bench_enabled (filter, name))
+        {
+          data.tree = tree;
+          data.packed = pack (tree, c, &data.packed_len);
+          result = (BenchResult){ g_intern_string (name), 0, 0, raw_len,
+                                  tree_nodes, 0 };
+          bench_run (&result, NULL, bench_parse, &data);
+          g_array_append_val (results, result);
+          g_free (data.packed);
+        }
+      g_free (name);
+
+      name = g_strdup_printf ("pack_%s", compression_names[c]);
+      if (bench_enabled (filter, name))
+        {
+          data.tree = tree;
+          data.compression = c;
+          result = (BenchResult){ g_intern_string (name), 0, 0, raw_len,
+                                  tree_nodes, 0 };
+          bench_run (&result, NULL, bench_pack, &data);
+          g_array_append_val (results, result);
+        }
+      g_free (name);
+    }
+
+  /* The MUTF-8 conversion isn't public, measure it through parsing and
+   * packing the string tree uncompressed */
+  if (bench_enabled (filter, "mutf8_decode"))
+    {
+      data.packed = pack (strings, NBT_Compression_NONE, &data.packed_len);
+      result = (BenchResult){ "mutf8_decode", 0, 0, string_len, string_nodes,
+                              0 };
+      bench_run (&result, NULL, bench_parse, &data);
+      g_array_append_val (results, result);
+      g_free (data.packed);
+    }
+  if (bench_enabled (filter, "mutf8_encode"))
+    {
+      data.tree = strings;
+      data.compression = NBT_Compression_NONE;
+      result = (BenchResult){ "mutf8_encode", 0, 0, string_len, string_nodes,
+                              0 };
+      bench_run (&result, NULL, bench_pack, &data);
+      g_array_append_val (results, result);
+    }
+
+  if (bench_enabled (filter, "key_lookup"))
+    {
+      /* Look up every key of a wide compound, like a block entity */
+      int n_keys = 64;
+      data.scratch = nbt_node_new_compound ("");
+      data.keys = g_new0 (const char *, n_keys);
+      data.n_keys = n_keys;
+      for (int i = 0; i < n_keys; i++)
+        {
+          char *key = g_strdup_printf ("key_%d", i);
+          data.keys[i] = g_intern_string (key);
+          nbt_node_prepend (data.scratch, nbt_node_new_int (key, i));
+          g_free (key);
+        }
+      result = (BenchResult){ "key_lookup", 0, 0, 0, n_keys, 0 };
+      bench_run (&result, NULL, bench_lookup, &data);
+      g_array_append_val (results, result);
+      nbt_node_free (data.scratch);
+      data.scratch = NULL;
+      g_free (data.keys);
+    }
+
+  if (bench_enabled (filter, "dup"))
+    {
+      data.tree = tree;
+      result = (BenchResult){ "dup", 0, 0, 0, tree_nodes, 0 };
+      bench_run (&result, NULL, bench_dup, &data);
+      g_array_append_val (results, result);
+    }
+
+  if (bench_enabled (filter, "free"))
+    {
+      data.tree = tree;
+      result = (BenchResult){ "free", 0, 0, 0, tree_nodes, 0 };
+      bench_run (&result, bench_free_setup, bench_free, &data);
+      g_array_append_val (results, result);
+    }
+
+  GString *report = g_string_new ("{\n");
+  g_string_append_printf (report, "  \"scale\": %d,\n", scale);
+  g_string_append_printf (report, "  \"seed\": %d,\n", BENCH_SEED);
+  g_string_append (report, "  \"results\": [");
+  fprintf (stderr, "%-16s %8s %14s %10s %10s %10s\n", "benchmark", "iters",
+           "ns/iter", "MB/s", "ns/node", "rss KiB");
+  for (guint i = 0; i < results->len; i++)
+    {
+      BenchResult *r = &g_array_index (results, BenchResult, i);
+      double mb_per_s
+          = r->bytes ? r->bytes / (r->ns_per_iter / 1e9) / 1e6 : 0;
+      double ns_per_node = r->nodes ? r->ns_per_iter / r->nodes : 0;
+      fprintf (stderr, "%-16s %8d %14.0f %10.2f %10.2f %10ld\n", r->name,
+               r->iterations, r->ns_per_iter, mb_per_s, ns_per_node,
+               r->peak_rss);
+      g_string_append_printf (
+          report,
+          "%s\n    { \"name\": \"%s\", \"iterations\": %d, "
+          "\"ns_per_iter\": %.0f, \"bytes\": %" G_GUINT64_FORMAT ", "
+          "\"nodes\": %" G_GUINT64_FORMAT ", \"mb_per_s\": %.3f, "
+          "\"ns_per_node\": %.3f, \"peak_rss_kib\": %ld }",
+          i ? "," : "", r->name, r->iterations, r->ns_per_iter, r->bytes,
+          r->nodes, mb_per_s, ns_per_node, r->peak_rss);
+    }
+  g_string_append (report, "\n  ]\n}\n");
+
+  int ret = 0;
+  if (json)
+    {
+      if (!g_file_set_contents (json, report->str, report->len, &err))
+        {
+          fprintf (stderr, "%s\n", err->message);
+          g_error_free (err);
+          ret = 1;
+        }
+    }
+  else
+    fputs (report->str, stdout);
+
+  g_string_free (report, TRUE);
+  g_array_free (results, TRUE);
+  nbt_node_free (tree);
+  nbt_node_free (strings);
+  g_free (filter);
+  g_free (json);
+  return ret;
+}
@@ -0,0 +1,649 @@
+/*  nbt_corpus - Synthetic NBT workloads of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_corpus.h"
+
+#include <string.h>
+
+/* Everything is built with the nbt_util constructors, in the order of a
+ * real save. Children are linked with `append`, which keeps the last child
+ * so building a list of N elements stays O(N). */
+
+typedef struct Corpus
+{
+  GRand *rand;
+} Corpus;
+
+static const char *const workload_names[]
+    = { "chunk", "entities", "items", "list", "bytes", "strings", "mixed" };
+
+static const char *const block_names[]
+    = { "minecraft:air",           "minecraft:stone",
+        "minecraft:deepslate",     "minecraft:dirt",
+        "minecraft:grass_block",   "minecraft:water",
+        "minecraft:gravel",        "minecraft:andesite",
+        "minecraft:granite",       "minecraft:diorite",
+        "minecraft:tuff",          "minecraft:coal_ore",
+        "minecraft:iron_ore",      "minecraft:copper_ore",
+        "minecraft:deepslate_iron_ore",
+        "minecraft:deepslate_diamond_ore",
+        "minecraft:bedrock",       "minecraft:lava",
+        "minecraft:sand",          "minecraft:oak_log",
+        "minecraft:oak_leaves",    "minecraft:oak_stairs",
+        "minecraft:short_grass",   "minecraft:cave_air",
+        "minecraft:glow_lichen",   "minecraft:chest",
+        "minecraft:torch",         "minecraft:cobblestone" };
+
+static const char *const biome_names[]
+    = { "minecraft:plains", "minecraft:forest", "minecraft:river",
+        "minecraft:dripstone_caves", "minecraft:lush_caves",
+        "minecraft:deep_dark" };
+
+static const char *const entity_names[]
+    = { "minecraft:zombie", "minecraft:skeleton", "minecraft:cow",
+        "minecraft:sheep", "minecraft:item", "minecraft:bat",
+        "minecraft:villager", "minecraft:creeper" };
+
+static const char *const item_names[]
+    = { "minecraft:diamond_sword", "minecraft:cobblestone",
+        "minecraft:oak_planks", "minecraft:torch", "minecraft:iron_ingot",
+        "minecraft:written_book", "minecraft:enchanted_book",
+        "minecraft:bread" };
+
+/* Pieces of text in several scripts, the last ones are outside the BMP so
+ * they become surrogate pairs in MUTF-8 */
+static const char *const text_pieces[]
+    = { "Stone ",
+        "\xc3\xa9t\xc3\xa9 \xc3\xa0 la plage ",
+        "\xd0\x9a\xd0\xb0\xd0\xbc\xd0\xb5\xd0\xbd\xd1\x8c ",
+        "\xce\xbb\xce\xaf\xce\xb8\xce\xbf\xcf\x82 ",
+        "\xe7\x9f\xb3\xe5\xa4\xb4\xe4\xb8\x96\xe7\x95\x8c ",
+        "\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4 ",
+        "\xd8\xad\xd8\xac\xd8\xb1 ",
+        "\xe3\x81\x84\xe3\x81\x97 ",
+        "\xf0\x9f\xaa\xa8\xf0\x9f\x92\x8e ",
+        "\xf0\x9d\x95\xb8\xf0\x9d\x96\x8e\xf0\x9d\x96\x8a " };
+
+#define pick(c, array)                                                        \
+  ((array)[g_rand_int_range ((c)->rand, 0, G_N_ELEMENTS (array))])
+
+static void
+append (NbtNode *parent, NbtNode **last, NbtNode *child)
+{
+  nbt_node_insert_after (parent, *last, child);
+  *last = child;
+}
+
+/* The size of the node when packed, the strings are counted as UTF-8 */
+static guint64
+node_size (NbtNode *node, gboolean named)
+{
+  NbtData *data = node->data;
+  guint64 size = 0;
+  if (named)
+    size += 3 + (data->key ? strlen (data->key) : 0);
+  switch (data->type)
+    {
+    case TAG_Byte:
+      return size + 1;
+    case TAG_Short:
+      return size + 2;
+    case TAG_Int:
+    case TAG_Float:
+      return size + 4;
+    case TAG_Long:
+    case TAG_Double:
+      return size + 8;
+    case TAG_Byte_Array:
+      return size + 4 + data->value_a.len;
+    case TAG_Int_Array:
+      return size + 4 + 4 * (guint64)data->value_a.len;
+    case TAG_Long_Array:
+      return size + 4 + 8 * (guint64)data->value_a.len;
+    case TAG_String:
+      return size + 2 + strlen (data->value_a.value);
+    case TAG_List:
+      size += 5;
+      for (NbtNode *child = node->children; child; child = child->next)
+        size += node_size (child, FALSE);
+      return size;
+    case TAG_Compound:
+      size += 1;
+      for (NbtNode *child = node->children; child; child = child->next)
+        size += node_size (child, TRUE);
+      return size;
+    default:
+      return size;
+    }
+}
+
+static int
+bits_for (int n)
+{
+  int bits = 0;
+  while ((1 << bits) < n)
+    bits++;
+  return bits;
+}
+
+/* Pack the indices the way 1.16+ does, no entry spans two longs */
+static NbtNode *
+packed_long_array (const char *key, const guint16 *indices, int n, int bits)
+{
+  int per_long = 64 / bits;
+  int n_longs = (n + per_long - 1) / per_long;
+  gint64 *longs = g_new0 (gint64, n_longs);
+  for (int i = 0; i < n; i++)
+    longs[i / per_long]
+        |= (guint64)indices[i] << (bits * (i % per_long));
+  NbtNode *node = nbt_node_new_long_array (key, longs, n_longs);
+  g_free (longs);
+  return node;
+}
+
+static NbtNode *
+block_state_new (Corpus *c, const char *name)
+{
+  NbtNode *block = nbt_node_new_compound (NULL);
+  NbtNode *last = NULL;
+  append (block, &last, nbt_node_new_string ("Name", name));
+  if (g_str_has_prefix (name, "minecraft:oak_stairs"))
+    {
+      static const char *const facing[] = { "north", "south", "east", "west" };
+      NbtNode *properties = nbt_node_new_compound ("Properties");
+      NbtNode *plast = NULL;
+      append (properties, &plast,
+              nbt_node_new_string ("facing", pick (c, facing)));
+      append (properties, &plast, nbt_node_new_string ("half", "bottom"));
+      append (properties, &plast, nbt_node_new_string ("shape", "straight"));
+      append (properties, &plast,
+              nbt_node_new_string ("waterlogged", "false"));
+      append (block, &last, properties);
+    }
+  else if (g_str_has_suffix (name, "_log"))
+    {
+      NbtNode *properties = nbt_node_new_compound ("Properties");
+      nbt_node_prepend (properties, nbt_node_new_string ("axis", "y"));
+      append (block, &last, properties);
+    }
+  return block;
+}
+
+static NbtNode *
+section_new (Corpus *c, int y)
+{
+  NbtNode *section = nbt_node_new_compound (NULL);
+  NbtNode *last = NULL;
+  append (section, &last, nbt_node_new_byte ("Y", y));
+
+  /* The sky is air only, the ground has a bigger palette */
+  int palette_len = y > 6 ? 1 : g_rand_int_range (c->rand, 2, 24);
+  NbtNode *states = nbt_node_new_compound ("block_states");
+  NbtNode *slast = NULL;
+  NbtNode *palette = nbt_node_new_list ("palette");
+  NbtNode *plast = NULL;
+  if (palette_len == 1)
+    append (palette, &plast, block_state_new (c, "minecraft:air"));
+  else
+    for (int i = 0; i < palette_len; i++)
+      append (palette, &plast,
+              block_state_new (c, block_names[(i * 5 + y + 8)
+                                              % G_N_ELEMENTS (block_names)]));
+  append (states, &slast, palette);
+  if (palette_len > 1)
+    {
+      guint16 indices[4096];
+      int bits = MAX (4, bits_for (palette_len));
+      /* Mostly the first entries, with some veins */
+      for (int i = 0; i < 4096; i++)
+        {
+          guint32 r = g_rand_int (c->rand);
+          indices[i] = (r & 0xff) < 200 ? (i >> 8) % 2
+                                         : (r >> 8) % palette_len;
+        }
+      append (states, &slast, packed_long_array ("data", indices, 4096, bits));
+    }
+  append (section, &last, states);
+
+  int n_biomes = g_rand_int_range (c->rand, 1, 4);
+  NbtNode *biomes = nbt_node_new_compound ("biomes");
+  NbtNode *blast = NULL;
+  NbtNode *biome_palette = nbt_node_new_list ("palette");
+  NbtNode *bplast = NULL;
+  for (int i = 0; i < n_biomes; i++)
+    append (biome_palette, &bplast,
+            nbt_node_new_string (NULL, pick (c, biome_names)));
+  append (biomes, &blast, biome_palette);
+  if (n_biomes > 1)
+    {
+      guint16 indices[64];
+      for (int i = 0; i < 64; i++)
+        indices[i] = g_rand_int_range (c->rand, 0, n_biomes);
+      append (biomes, &blast,
+              packed_long_array ("data", indices, 64, bits_for (n_biomes)));
+    }
+  append (section, &last, biomes);
+  append (section, &last, nbt_node_new_byte_array ("SkyLight", NULL, 0));
+  return section;
+}
+
+static NbtNode *
+item_new (Corpus *c, int slot, int depth)
+{
+  NbtNode *item = nbt_node_new_compound (NULL);
+  NbtNode *last = NULL;
+  if (slot >= 0)
+    append (item, &last, nbt_node_new_byte ("Slot", slot));
+  append (item, &last,
+          nbt_node_new_string ("id", depth > 0 ? "minecraft:shulker_box"
+                                               : pick (c, item_names)));
+  append (item, &last,
+          nbt_node_new_byte ("Count", g_rand_int_range (c->rand, 1, 65)));
+  if (depth <= 0 && g_rand_int_range (c->rand, 0, 4))
+    return item;
+
+  NbtNode *tag = nbt_node_new_compound ("tag");
+  NbtNode *tlast = NULL;
+  NbtNode *display = nbt_node_new_compound ("display");
+  NbtNode *dlast = NULL;
+  append (display, &dlast,
+          nbt_node_new_string ("Name", "{\"text\":\"Box\",\"italic\":false}"));
+  NbtNode *lore = nbt_node_new_list ("Lore");
+  NbtNode *llast = NULL;
+  for (int i = g_rand_int_range (c->rand, 0, 3); i > 0; i--)
+    append (lore, &llast, nbt_node_new_string (NULL, "{\"text\":\"Lore\"}"));
+  append (display, &dlast, lore);
+  append (tag, &tlast, display);
+
+  NbtNode *enchantments = nbt_node_new_list ("Enchantments");
+  NbtNode *elast = NULL;
+  for (int i = g_rand_int_range (c->rand, 0, 4); i > 0; i--)
+    {
+      NbtNode *enchantment = nbt_node_new_compound (NULL);
+      NbtNode *nlast = NULL;
+      append (enchantment, &nlast,
+              nbt_node_new_string ("id", "minecraft:sharpness"));
+      append (enchantment, &nlast,
+              nbt_node_new_short ("lvl", g_rand_int_range (c->rand, 1, 6)));
+      append (enchantments, &elast, enchantment);
+    }
+  append (tag, &tlast, enchantments);
+
+  if (depth > 0)
+    {
+      /* One item goes deeper, the others are leaves */
+      NbtNode *block_entity = nbt_node_new_compound ("BlockEntityTag");
+      NbtNode *items = nbt_node_new_list ("Items");
+      NbtNode *ilast = NULL;
+      int n = g_rand_int_range (c->rand, 1, 4);
+      for (int i = 0; i < n; i++)
+        append (items, &ilast, item_new (c, i, i == 0 ? depth - 1 : 0));
+      nbt_node_prepend (block_entity, items);
+      append (tag, &tlast, block_entity);
+    }
+  append (item, &last, tag);
+  return item;
+}
+
+static NbtNode *
+double_list_new (const char *key, const double *values, int n)
+{
+  NbtNode *list = nbt_node_new_list (key);
+  NbtNode *last = NULL;
+  for (int i = 0; i < n; i++)
+    append (list, &last, nbt_node_new_double (NULL, values[i]));
+  return list;
+}
+
+static NbtNode *
+entity_new (Corpus *c, int x, int z)
+{
+  NbtNode *entity = nbt_node_new_compound (NULL);
+  NbtNode *last = NULL;
+  append (entity, &last, nbt_node_new_string ("id", pick (c, entity_names)));
+  double pos[3] = { x * 16 + g_rand_double_range (c->rand, 0, 16),
+                    g_rand_double_range (c->rand, -64, 320),
+                    z * 16 + g_rand_double_range (c->rand, 0, 16) };
+  append (entity, &last, double_list_new ("Pos", pos, 3));
+  double motion[3] = { g_rand_double_range (c->rand, -0.1, 0.1), -0.0784,
+                       g_rand_double_range (c->rand, -0.1, 0.1) };
+  append (entity, &last, double_list_new ("Motion", motion, 3));
+  NbtNode *rotation = nbt_node_new_list ("Rotation");
+  NbtNode *rlast = NULL;
+  append (rotation, &rlast,
+          nbt_node_new_float (NULL, g_rand_double_range (c->rand, 0, 360)));
+  append (rotation, &rlast,
+          nbt_node_new_float (NULL, g_rand_double_range (c->rand, -90, 90)));
+  append (entity, &last, rotation);
+  gint32 uuid[4];
+  for (int i = 0; i < 4; i++)
+    uuid[i] = g_rand_int (c->rand);
+  append (entity, &last, nbt_node_new_int_array ("UUID", uuid, 4));
+  append (entity, &last, nbt_node_new_float ("Health", 20.0f));
+  append (entity, &last, nbt_node_new_short ("Air", 300));
+  append (entity, &last, nbt_node_new_float ("FallDistance", 0.0f));
+  append (entity, &last, nbt_node_new_short ("Fire", -1));
+  append (entity, &last, nbt_node_new_byte ("OnGround", 1));
+  append (entity, &last, nbt_node_new_byte ("Invulnerable", 0));
+  append (entity, &last, nbt_node_new_int ("PortalCooldown", 0));
+
+  NbtNode *attributes = nbt_node_new_list ("Attributes");
+  NbtNode *alast = NULL;
+  static const char *const attribute_names[]
+      = { "minecraft:generic.max_health", "minecraft:generic.movement_speed",
+          "minecraft:generic.follow_range" };
+  for (int i = 0; i < G_N_ELEMENTS (attribute_names); i++)
+    {
+      NbtNode *attribute = nbt_node_new_compound (NULL);
+      NbtNode *nlast = NULL;
+      append (attribute, &nlast,
+              nbt_node_new_string ("Name", attribute_names[i]));
+      append (attribute, &nlast,
+              nbt_node_new_double ("Base", g_rand_double (c->rand) * 20));
+      append (attributes, &alast, attribute);
+    }
+  append (entity, &last, attributes);
+
+  NbtNode *armor = nbt_node_new_list ("ArmorItems");
+  NbtNode *hand = nbt_node_new_list ("HandItems");
+  NbtNode *arlast = NULL;
+  NbtNode *hlast = NULL;
+  for (int i = 0; i < 4; i++)
+    append (armor, &arlast,
+            g_rand_int_range (c->rand, 0, 8) ? nbt_node_new_compound (NULL)
+                                             : item_new (c, -1, 0));
+  for (int i = 0; i < 2; i++)
+    append (hand, &hlast,
+            g_rand_int_range (c->rand, 0, 4) ? nbt_node_new_compound (NULL)
+                                             : item_new (c, -1, 0));
+  append (entity, &last, armor);
+  append (entity, &last, hand);
+  return entity;
+}
+
+static NbtNode *
+heightmap_new (Corpus *c, const char *key)
+{
+  guint16 heights[256];
+  for (int i = 0; i < 256; i++)
+    heights[i] = 128 + g_rand_int_range (c->rand, -8, 8);
+  return packed_long_array (key, heights, 256, 9);
+}
+
+static NbtNode *
+chunk_new (Corpus *c, int x, int z)
+{
+  NbtNode *chunk = nbt_node_new_compound (NULL);
+  NbtNode *last = NULL;
+  append (chunk, &last, nbt_node_new_int ("DataVersion", 3465));
+  append (chunk, &last, nbt_node_new_int ("xPos", x));
+  append (chunk, &last, nbt_node_new_int ("zPos", z));
+  append (chunk, &last, nbt_node_new_int ("yPos", -4));
+  append (chunk, &last, nbt_node_new_string ("Status", "minecraft:full"));
+  append (chunk, &last,
+          nbt_node_new_long ("LastUpdate", g_rand_int (c->rand)));
+  append (chunk, &last,
+          nbt_node_new_long ("InhabitedTime", g_rand_int (c->rand) >> 12));
+
+  NbtNode *sections = nbt_node_new_list ("sections");
+  NbtNode *slast = NULL;
+  for (int y = -4; y < 20; y++)
+    append (sections, &slast, section_new (c, y));
+  append (chunk, &last, sections);
+
+  NbtNode *heightmaps = nbt_node_new_compound ("Heightmaps");
+  NbtNode *hlast = NULL;
+  append (heightmaps, &hlast, heightmap_new (c, "MOTION_BLOCKING"));
+  append (heightmaps, &hlast,
+          heightmap_new (c, "MOTION_BLOCKING_NO_LEAVES"));
+  append (heightmaps, &hlast, heightmap_new (c, "OCEAN_FLOOR"));
+  append (heightmaps, &hlast, heightmap_new (c, "WORLD_SURFACE"));
+  append (chunk, &last, heightmaps);
+
+  NbtNode *block_entities = nbt_node_new_list ("block_entities");
+  NbtNode *blast = NULL;
+  for (int i = g_rand_int_range (c->rand, 0, 4); i > 0; i--)
+    {
+      NbtNode *chest = nbt_node_new_compound (NULL);
+      NbtNode *clast = NULL;
+      append (chest, &clast, nbt_node_new_string ("id", "minecraft:chest"));
+      append (chest, &clast,
+              nbt_node_new_int ("x", x * 16 + g_rand_int_range (c->rand, 0, 16)));
+      append (chest, &clast,
+              nbt_node_new_int ("y", g_rand_int_range (c->rand, -64, 320)));
+      append (chest, &clast,
+              nbt_node_new_int ("z", z * 16 + g_rand_int_range (c->rand, 0, 16)));
+      append (chest, &clast, nbt_node_new_byte ("keepPacked", 0));
+      NbtNode *items = nbt_node_new_list ("Items");
+      NbtNode *ilast = NULL;
+      for (int j = g_rand_int_range (c->rand, 0, 27); j >= 0; j--)
+        append (items, &ilast, item_new (c, j, 0));
+      append (chest, &clast, items);
+      append (block_entities, &blast, chest);
+    }
+  append (chunk, &last, block_entities);
+
+  NbtNode *post_processing = nbt_node_new_list ("PostProcessing");
+  NbtNode *plast = NULL;
+  for (int i = 0; i < 24; i++)
+    append (post_processing, &plast, nbt_node_new_list (NULL));
+  append (chunk, &last, post_processing);
+  return chunk;
+}
+
+static NbtNode *
+entity_chunk_new (Corpus *c, int x, int z)
+{
+  NbtNode *chunk = nbt_node_new_compound (NULL);
+  NbtNode *last = NULL;
+  append (chunk, &last, nbt_node_new_int ("DataVersion", 3465));
+  gint32 position[2] = { x, z };
+  append (chunk, &last, nbt_node_new_int_array ("Position", position, 2));
+  NbtNode *entities = nbt_node_new_list ("Entities");
+  NbtNode *elast = NULL;
+  for (int i = g_rand_int_range (c->rand, 50, 200); i > 0; i--)
+    append (entities, &elast, entity_new (c, x, z));
+  append (chunk, &last, entities);
+  return chunk;
+}
+
+static char *
+text_new (Corpus *c, int pieces)
+{
+  GString *string = g_string_new (NULL);
+  for (int i = 0; i < pieces; i++)
+    g_string_append (string, pick (c, text_pieces));
+  return g_string_free (string, FALSE);
+}
+
+/* Fill a list with units until `size`, the units are made by `func` */
+static void
+generate_list (Corpus *c, NbtNode *root, const char *key, guint64 size,
+               NbtNode *(*func) (Corpus *c, int x, int z))
+{
+  NbtNode *list = nbt_node_new_list (key);
+  NbtNode *last = NULL;
+  guint64 done = 0;
+  for (int i = 0; done < size; i++)
+    {
+      NbtNode *unit = func (c, i % 32, i / 32);
+      done += node_size (unit, FALSE);
+      append (list, &last, unit);
+    }
+  nbt_node_prepend (root, list);
+}
+
+static NbtNode *
+item_unit_new (Corpus *c, int x, int z)
+{
+  return item_new (c, x % 27, g_rand_int_range (c->rand, 8, 33));
+}
+
+static void
+generate_flat_lists (Corpus *c, NbtNode *root, guint64 size)
+{
+  NbtNode *ints = nbt_node_new_list ("ints");
+  NbtNode *doubles = nbt_node_new_list ("doubles");
+  NbtNode *points = nbt_node_new_list ("points");
+  NbtNode *ilast = NULL;
+  NbtNode *dlast = NULL;
+  NbtNode *plast = NULL;
+  /* An int, a double and a point of 3 ints are 4 + 8 + 25 bytes */
+  for (guint64 done = 0; done < size; done += 37)
+    {
+      append (ints, &ilast, nbt_node_new_int (NULL, g_rand_int (c->rand)));
+      append (doubles, &dlast,
+              nbt_node_new_double (NULL, g_rand_double (c->rand)));
+      NbtNode *point = nbt_node_new_compound (NULL);
+      NbtNode *last = NULL;
+      append (point, &last,
+              nbt_node_new_int ("x", g_rand_int_range (c->rand, -1000, 1000)));
+      append (point, &last,
+              nbt_node_new_int ("y", g_rand_int_range (c->rand, -64, 320)));
+      append (point, &last,
+              nbt_node_new_int ("z", g_rand_int_range (c->rand, -1000, 1000)));
+      append (points, &plast, point);
+    }
+  nbt_node_prepend (root, points);
+  nbt_node_prepend (root, doubles);
+  nbt_node_prepend (root, ints);
+}
+
+static void
+generate_bytes (Corpus *c, NbtNode *root, guint64 size)
+{
+  NbtNode *last = NULL;
+  int block = 4 << 20;
+  gint8 *bytes = g_malloc (block);
+  for (guint64 done = 0, i = 0; done < size; i++)
+    {
+      /* Half random, half runs, so it's neither incompressible nor
+       * trivially compressible */
+      int len = MIN (block, size - done);
+      for (int j = 0; j < len; j += 4)
+        {
+          guint32 r = g_rand_int (c->rand);
+          if (j & 0x1000)
+            r &= 0x01010101;
+          memcpy (bytes + j, &r, MIN (4, len - j));
+        }
+      char *key = g_strdup_printf ("blob_%" G_GUINT64_FORMAT, i);
+      append (root, &last, nbt_node_new_byte_array (key, bytes, len));
+      done += len + 3 + strlen (key);
+      g_free (key);
+    }
+  g_free (bytes);
+}
+
+static void
+generate_strings (Corpus *c, NbtNode *root, guint64 size)
+{
+  NbtNode *list = nbt_node_new_list ("strings");
+  NbtNode *names = nbt_node_new_compound ("names");
+  NbtNode *last = NULL;
+  NbtNode *nlast = NULL;
+  guint64 done = 0;
+  for (int i = 0; done < size; i++)
+    {
+      char *text = text_new (c, g_rand_int_range (c->rand, 1, 24));
+      done += 2 + strlen (text);
+      append (list, &last, nbt_node_new_string (NULL, text));
+      g_free (text);
+      if (i % 8 == 0)
+        {
+          /* The keys need to be unique in a compound */
+          char *piece = text_new (c, 2);
+          char *key = g_strdup_printf ("%s%d", piece, i);
+          char *value = text_new (c, 4);
+          done += 5 + strlen (key) + strlen (value);
+          append (names, &nlast, nbt_node_new_string (key, value));
+          g_free (piece);
+          g_free (key);
+          g_free (value);
+        }
+    }
+  nbt_node_prepend (root, names);
+  nbt_node_prepend (root, list);
+}
+
+static void
+generate (Corpus *c, NbtNode *root, NbtCorpusWorkload workload,
+          guint64 size)
+{
+  switch (workload)
+    {
+    case NBT_CORPUS_CHUNK:
+      generate_list (c, root, "chunks", size, chunk_new);
+      break;
+    case NBT_CORPUS_ENTITIES:
+      generate_list (c, root, "chunks", size, entity_chunk_new);
+      break;
+    case NBT_CORPUS_ITEMS:
+      generate_list (c, root, "Items", size, item_unit_new);
+      break;
+    case NBT_CORPUS_LIST:
+      generate_flat_lists (c, root, size);
+      break;
+    case NBT_CORPUS_BYTES:
+      generate_bytes (c, root, size);
+      break;
+    case NBT_CORPUS_STRINGS:
+      generate_strings (c, root, size);
+      break;
+    case NBT_CORPUS_MIXED:
+      {
+        NbtNode *last = NULL;
+        for (int i = 0; i < NBT_CORPUS_MIXED; i++)
+          {
+            NbtNode *child = nbt_node_new_compound (workload_names[i]);
+            generate (c, child, i, size / NBT_CORPUS_MIXED);
+            append (root, &last, child);
+          }
+        break;
+      }
+    default:
+      g_return_if_reached ();
+    }
+}
+
+const char *
+nbt_corpus_workload_name (NbtCorpusWorkload workload)
+{
+  g_return_val_if_fail (workload < NBT_CORPUS_N_WORKLOADS, NULL);
+  return workload_names[workload];
+}
+
+int
+nbt_corpus_workload_from_name (const char *name)
+{
+  for (int i = 0; i < NBT_CORPUS_N_WORKLOADS; i++)
+    if (g_str_equal (name, workload_names[i]))
+      return i;
+  return -1;
+}
+
+NbtNode *
+nbt_corpus_generate (NbtCorpusWorkload workload, guint32 seed, guint64 size)
+{
+  g_return_val_if_fail (workload < NBT_CORPUS_N_WORKLOADS, NULL);
+  Corpus c = { g_rand_new_with_seed (seed) };
+  NbtNode *root = nbt_node_new_compound ("");
+  generate (&c, root, workload, size);
+  g_rand_free (c.rand);
+  return root;
+}
@@ -0,0 +1,71 @@
+/*  nbt_corpus - Synthetic NBT workloads of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_CORPUS_H
+#define DHLRC_NBT_CORPUS_H
+
+#include "nbt_util.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The kinds of the generated workloads
+ */
+typedef enum NbtCorpusWorkload
+{
+  /** Chunks with sections, palettes and packed block states */
+  NBT_CORPUS_CHUNK,
+  /** Chunks full of entities */
+  NBT_CORPUS_ENTITIES,
+  /** Items nested in containers, deep trees */
+  NBT_CORPUS_ITEMS,
+  /** Huge flat lists of scalars and small compounds */
+  NBT_CORPUS_LIST,
+  /** Large byte arrays */
+  NBT_CORPUS_BYTES,
+  /** Strings in many scripts, with supplementary characters */
+  NBT_CORPUS_STRINGS,
+  /** All the workloads above, in turn */
+  NBT_CORPUS_MIXED,
+  NBT_CORPUS_N_WORKLOADS
+} NbtCorpusWorkload;
+
+/**
+ * @brief Get the name of the workload, used by the command line.
+ */
+const char *nbt_corpus_workload_name (NbtCorpusWorkload workload);
+/**
+ * @brief Find the workload by its name.
+ * @return The workload, or -1 if not found
+ */
+int nbt_corpus_workload_from_name (const char *name);
+/**
+ * @brief Generate a tree of the workload.
+ *
+ * The same seed and size always give the same tree.
+ * @param workload The workload to generate
+ * @param seed The seed of the random generator
+ * @param size The approximate size of the uncompressed NBT, in bytes
+ * @return The root node of the tree
+ */
+NbtNode *nbt_corpus_generate (NbtCorpusWorkload workload, guint32 seed,
+                              guint64 size);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_CORPUS_H
@@ -0,0 +1,163 @@
+/*  nbt_gen - Synthetic NBT file generator of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+/* Usage: nbt-gen [--workload NAME] [--size SIZE] [--seed N]
+ *                [--compression gzip|zlib|none] [--output FILE]
+ *
+ * The same options always give the same file, so a corpus can be described
+ * by its command line instead of being shipped. SIZE is the approximate
+ * uncompressed size and takes the K, M and G suffixes. The file goes to
+ * stdout if there's no `--output`. */
+
+#include "nbt.h"
+#include "nbt_corpus.h"
+
+#include <stdio.h>
+
+static gboolean
+parse_size (const char *str, guint64 *size)
+{
+  char *end = NULL;
+  guint64 value = g_ascii_strtoull (str, &end, 10);
+  if (end == str)
+    return FALSE;
+  switch (g_ascii_toupper (*end))
+    {
+    case 'G':
+      value <<= 10;
+      /* fall through */
+    case 'M':
+      value <<= 10;
+      /* fall through */
+    case 'K':
+      value <<= 10;
+      end++;
+      break;
+    default:
+      break;
+    }
+  *size = value;
+  return *end == '\0';
+}
+
+static int
+parse_compression (const char *str)
+{
+  if (g_ascii_strcasecmp (str, "gzip") == 0)
+    return NBT_Compression_GZIP;
+  if (g_ascii_strcasecmp (str, "zlib") == 0)
+    return NBT_Compression_ZLIB;
+  if (g_ascii_strcasecmp (str, "none") == 0)
+    return NBT_Compression_NONE;
+  return -1;
+}
+
+int
+main (int argc, char **argv)
+{
+  char *workload_name = NULL;
+  char *size_str = NULL;
+  gint64 seed = 0x6e6274;
+  char *compression_name = NULL;
+  char *output = NULL;
+  GOptionEntry entries[]
+      = { { "workload", 'w', 0, G_OPTION_ARG_STRING, &workload_name,
+            "The workload: chunk, entities, items, list, bytes, strings or "
+            "mixed",
+            "NAME" },
+          { "size", 's', 0, G_OPTION_ARG_STRING, &size_str,
+            "Approximate uncompressed size, with K, M or G", "SIZE" },
+          { "seed", 'r', 0, G_OPTION_ARG_INT64, &seed,
+            "Seed of the random generator, from 0 to 4294967295", "N" },
+          { "compression", 'c', 0, G_OPTION_ARG_STRING, &compression_name,
+            "gzip, zlib or none", "TYPE" },
+          { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+            "Write to FILE instead of stdout", "FILE" },
+          G_OPTION_ENTRY_NULL };
+  GOptionContext *context
+      = g_option_context_new ("- generate synthetic NBT files");
+  g_option_context_add_main_entries (context, entries, NULL);
+  GError *err = NULL;
+  if (!g_option_context_parse (context, &argc, &argv, &err))
+    {
+      fprintf (stderr, "%s\n", err->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  int workload = nbt_corpus_workload_from_name (
+      workload_name ? workload_name : "chunk");
+  if (workload < 0)
+    {
+      fprintf (stderr, "Unknown workload: %s\n", workload_name);
+      return 1;
+    }
+  guint64 size = 1 << 20;
+  if (size_str && !parse_size (size_str, &size))
+    {
+      fprintf (stderr, "Invalid size: %s\n", size_str);
+      return 1;
+    }
+  /* The generator takes a 32-bit seed, a wider one would be cut */
+  if (seed < 0 || seed > G_MAXUINT32)
+    {
+      fprintf (stderr, "Invalid seed: %" G_GINT64_FORMAT "\n", seed);
+      return 1;
+    }
+  int compression = parse_compression (
+      compression_name ? compression_name : "gzip");
+  if (compression < 0)
+    {
+      fprintf (stderr, "Unknown compression: %s\n", compression_name);
+      return 1;
+    }
+
+  gint64 start = g_get_monotonic_time ();
+  NbtNode *root = nbt_corpus_generate (workload, seed, size);
+  gint64 generated = g_get_monotonic_time ();
+
+  GFile *file = output ? g_file_new_for_commandline_arg (output) : NULL;
+  size_t len = 0;
+  guint8 *data = nbt_node_pack_full (root, &len, compression, &err, NULL,
+                                     NULL, NULL, file);
+  if (err)
+    {
+      fprintf (stderr, "Pack failed: %s\n", err->message);
+      return 1;
+    }
+  if (!file && fwrite (data, 1, len, stdout) != len)
+    {
+      fprintf (stderr, "Write failed\n");
+      return 1;
+    }
+  gint64 packed = g_get_monotonic_time ();
+  fprintf (stderr, "%s: %u nodes, generated in %.2fs, packed in %.2fs\n",
+           nbt_corpus_workload_name (workload),
+           g_node_n_nodes (root, G_TRAVERSE_ALL),
+           (generated - start) / 1e6, (packed - generated) / 1e6);
+
+  g_free (data);
+  if (file)
+    g_object_unref (file);
+  nbt_node_free (root);
+  g_free (workload_name);
+  g_free (size_str);
+  g_free (compression_name);
+  g_free (output);
+  return 0;
+}
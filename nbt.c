@@ -15,13 +15,14 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
 #include "nbt.h"
+#include "nbt_private.h"
 
 #include <inttypes.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 #include <zlib.h>
 
@@ -29,6 +30,11 @@
 #define bswap_32(x) GUINT32_SWAP_LE_BE (x)
 #define bswap_64(x) GUINT64_SWAP_LE_BE (x)
 
+#define isValidTag(tag) ((tag) > TAG_End && (tag) <= TAG_Long_Array)
+
+/* The size of the block passed to the compressor and the output stream */
+#define PACK_BLOCK_SIZE (64 * 1024)
+
 typedef struct NBT_Buffer
 {
   uint8_t *data;
@@ -36,49 +42,80 @@ typedef struct NBT_Buffer
   size_t pos;
 } NBT_Buffer;
 
+/* Where the writers put the bytes: appended to `arr`, or into the `size`
+ * bytes at `slice`, a part of an array sized beforehand which one thread
+ * of `pack_parallel` writes alone */
+typedef struct PackOutput
+{
+  GByteArray *arr;
+  guint8 *slice;
+  gsize len;
+  gsize size;
+  /** More bytes than `size` were written, which are dropped */
+  gboolean overrun;
+} PackOutput;
+
+static void
+pack_output_append (PackOutput *out, const guint8 *data, gsize len)
+{
+  if (out->arr)
+    g_byte_array_append (out->arr, data, len);
+  else if (!out->overrun && len <= out->size - out->len)
+    {
+      memcpy (out->slice + out->len, data, len);
+      out->len += len;
+    }
+  else
+    out->overrun = TRUE;
+}
+
 static char *convert_string_to_mutf8 (const char *str);
-static int nbt_node_write_nbt_to_gbytearray (GByteArray *arr, NbtNode *node,
-                                             int writekey,
-                                             DhProgressFullSet set_func,
-                                             void *main_klass, int *n_node,
-                                             int nodes, clock_t start_time,
-                                             GCancellable *cancellable);
+static int nbt_node_write_nbt_to_gbytearray (PackOutput *arr, NbtNode *node,
+                                             int writekey, int level,
+                                             NbtProgress *progress,
+                                             NbtStats *stats);
 
 static void
-nbt_node_write_uint8_to_gbytearray (GByteArray *buf, uint8_t value)
+nbt_node_write_uint8_to_gbytearray (PackOutput *buf, uint8_t value)
 {
-  g_byte_array_append (buf, &value, 1);
+  pack_output_append (buf, &value, 1);
 }
 
 static void
-nbt_node_write_uint16_to_gbytearray (GByteArray *buf, uint16_t value)
+nbt_node_write_uint16_to_gbytearray (PackOutput *buf, uint16_t value)
 {
   guint16 real_value = bswap_16 (value);
-  g_byte_array_append (buf, (guint8 *)&real_value, 2);
+  pack_output_append (buf, (guint8 *)&real_value, 2);
 }
 
 static void
-nbt_node_write_uint32_to_gbytearray (GByteArray *buf, uint32_t value)
+nbt_node_write_uint32_to_gbytearray (PackOutput *buf, uint32_t value)
 {
   guint32 real_value = bswap_32 (value);
-  g_byte_array_append (buf, (guint8 *)&real_value, 4);
+  pack_output_append (buf, (guint8 *)&real_value, 4);
 }
 
 static void
-nbt_node_write_uint64_to_gbytearray (GByteArray *buf, uint64_t value)
+nbt_node_write_uint64_to_gbytearray (PackOutput *buf, uint64_t value)
 {
   guint64 real_value = bswap_64 (value);
-  g_byte_array_append (buf, (guint8 *)&real_value, 8);
+  pack_output_append (buf, (guint8 *)&real_value, 8);
 }
 
 static void
-nbt_node_write_key_to_gbytearray (GByteArray *buf, char *key, int type)
+nbt_node_write_key_to_gbytearray (PackOutput *buf, char *key, int type,
+                                  NbtStats *stats)
 {
   nbt_node_write_uint8_to_gbytearray (buf, type);
   if (key && key[0])
     {
       char *new_key = convert_string_to_mutf8 (key);
       gsize len = strlen (new_key);
+      if (stats)
+        {
+          stats->n_allocs++;
+          stats->alloc_bytes += len + 1;
+        }
       nbt_node_write_uint16_to_gbytearray (buf, len);
       int i;
       for (i = 0; i < len; i++)
@@ -90,7 +127,7 @@ nbt_node_write_key_to_gbytearray (GByteArray *buf, char *key, int type)
 }
 
 static void
-nbt_node_write_number_to_gbytearray (GByteArray *buf, uint64_t value, int type)
+nbt_node_write_number_to_gbytearray (PackOutput *buf, uint64_t value, int type)
 {
   switch (type)
     {
@@ -112,21 +149,24 @@ nbt_node_write_number_to_gbytearray (GByteArray *buf, uint64_t value, int type)
 }
 
 static void
-nbt_node_write_float_to_gbytearray (GByteArray *buf, float value)
+nbt_node_write_float_to_gbytearray (PackOutput *buf, float value)
 {
-  guint32 val = bswap_32 (*(uint32_t *)&value);
+  /* The byte order is swapped in the uint32 writer */
+  guint32 val;
+  memcpy (&val, &value, sizeof (val));
   nbt_node_write_uint32_to_gbytearray (buf, val);
 }
 
 static void
-nbt_node_write_double_to_gbytearray (GByteArray *buf, double value)
+nbt_node_write_double_to_gbytearray (PackOutput *buf, double value)
 {
-  guint64 val = bswap_64 (*(uint64_t *)&value);
+  guint64 val;
+  memcpy (&val, &value, sizeof (val));
   nbt_node_write_uint64_to_gbytearray (buf, val);
 }
 
 static void
-nbt_node_write_point_to_gbytearray (GByteArray *buf, double value, int type)
+nbt_node_write_point_to_gbytearray (PackOutput *buf, double value, int type)
 {
   switch (type)
     {
@@ -141,14 +181,64 @@ nbt_node_write_point_to_gbytearray (GByteArray *buf, double value, int type)
     }
 }
 
+/* The numbers of a packed list are swapped in blocks of this size */
+#define PACKED_LIST_BLOCK 512
+
+static void
+nbt_node_write_packed_list_to_gbytearray (PackOutput *arr, NbtData *data,
+                                          int level, NbtStats *stats)
+{
+  NBT_Tags type = nbt_data_list_type (data);
+  gsize size = nbt_reader_scalar_size (type);
+  const guint8 *value = data->value_a.value;
+  guint32 len = data->value_a.len;
+  nbt_node_write_uint8_to_gbytearray (arr, type);
+  nbt_node_write_uint32_to_gbytearray (arr, len);
+  if (stats)
+    {
+      stats->n_nodes[type] += len;
+      stats->max_depth = MAX (stats->max_depth, level + 1);
+    }
+  if (size == 1)
+    {
+      pack_output_append (arr, value, len);
+      return;
+    }
+  guint64 block[PACKED_LIST_BLOCK];
+  for (guint32 start = 0; start < len; start += PACKED_LIST_BLOCK)
+    {
+      guint32 n = MIN (len - start, PACKED_LIST_BLOCK);
+      memcpy (block, value + start * size, n * size);
+      switch (size)
+        {
+        case 2:
+          for (guint32 i = 0; i < n; i++)
+            ((guint16 *)block)[i] = bswap_16 (((guint16 *)block)[i]);
+          break;
+        case 4:
+          for (guint32 i = 0; i < n; i++)
+            ((guint32 *)block)[i] = bswap_32 (((guint32 *)block)[i]);
+          break;
+        default:
+          for (guint32 i = 0; i < n; i++)
+            block[i] = bswap_64 (block[i]);
+          break;
+        }
+      pack_output_append (arr, (const guint8 *)block, n * size);
+    }
+}
+
 static int
-nbt_node_write_list_to_gbytearray (GByteArray *arr, NbtNode *node,
-                                   DhProgressFullSet set_func,
-                                   void *main_klass, int *n_node, int nodes,
-                                   clock_t start_time,
-                                   GCancellable *cancellable)
+nbt_node_write_list_to_gbytearray (PackOutput *arr, NbtNode *node, int level,
+                                   NbtProgress *progress, NbtStats *stats)
 {
   int ret = 0;
+  if (nbt_data_is_packed_list (node->data))
+    {
+      nbt_node_write_packed_list_to_gbytearray (arr, node->data, level,
+                                                stats);
+      return 0;
+    }
   NbtNode *child = node->children;
   int count = 0;
   while (child)
@@ -167,32 +257,34 @@ nbt_node_write_list_to_gbytearray (GByteArray *arr, NbtNode *node,
   nbt_node_write_uint32_to_gbytearray (arr, count);
   while (child)
     {
-      ret = nbt_node_write_nbt_to_gbytearray (arr, child, 0, set_func,
-                                              main_klass, n_node, nodes,
-                                              start_time, cancellable);
+      ret = nbt_node_write_nbt_to_gbytearray (arr, child, 0, level + 1,
+                                              progress, stats);
       if (ret)
         return ret;
+      /* Only the children of the packed node are counted as the progress,
+       * so there's no need to count all the nodes before packing. */
+      if (level == 0)
+        progress->done++;
       child = child->next;
     }
   return 0;
 }
 
 static int
-nbt_node_write_compound_to_gbytearray (GByteArray *arr, NbtNode *node,
-                                       DhProgressFullSet set_func,
-                                       void *main_klass, int *n_node,
-                                       int nodes, clock_t start_time,
-                                       GCancellable *cancellable)
+nbt_node_write_compound_to_gbytearray (PackOutput *arr, NbtNode *node,
+                                       int level, NbtProgress *progress,
+                                       NbtStats *stats)
 {
   int ret = 0;
   NbtNode *child = node->children;
   while (child)
     {
-      ret = nbt_node_write_nbt_to_gbytearray (arr, child, 1, set_func,
-                                              main_klass, n_node, nodes,
-                                              start_time, cancellable);
+      ret = nbt_node_write_nbt_to_gbytearray (arr, child, 1, level + 1,
+                                              progress, stats);
       if (ret)
         return ret;
+      if (level == 0)
+        progress->done++;
       child = child->next;
     }
   nbt_node_write_uint8_to_gbytearray (arr, 0);
@@ -200,7 +292,7 @@ nbt_node_write_compound_to_gbytearray (GByteArray *arr, NbtNode *node,
 }
 
 static void
-nbt_node_write_array_to_gbytearray (GByteArray *arr, void *value, int32_t len,
+nbt_node_write_array_to_gbytearray (PackOutput *arr, void *value, int32_t len,
                                     int type)
 {
   nbt_node_write_uint32_to_gbytearray (arr, len);
@@ -233,11 +325,17 @@ nbt_node_write_array_to_gbytearray (GByteArray *arr, void *value, int32_t len,
 }
 
 static void
-nbt_node_write_string_to_gbytearray (GByteArray *arr, void *value)
+nbt_node_write_string_to_gbytearray (PackOutput *arr, void *value,
+                                     NbtStats *stats)
 {
   char *str = value;
   char *output_value = convert_string_to_mutf8 (str);
   gsize real_len = strlen (output_value);
+  if (stats)
+    {
+      stats->n_allocs++;
+      stats->alloc_bytes += real_len + 1;
+    }
   nbt_node_write_uint16_to_gbytearray (arr, real_len);
   int i;
   for (i = 0; i < real_len; i++)
@@ -246,28 +344,23 @@ nbt_node_write_string_to_gbytearray (GByteArray *arr, void *value)
 }
 
 static int
-nbt_node_write_nbt_to_gbytearray (GByteArray *arr, NbtNode *node, int writekey,
-                                  DhProgressFullSet set_func, void *main_klass,
-                                  int *n_node, int nodes, clock_t start_time,
-                                  GCancellable *cancellable)
+nbt_node_write_nbt_to_gbytearray (PackOutput *arr, NbtNode *node, int writekey,
+                                  int level, NbtProgress *progress,
+                                  NbtStats *stats)
 {
   int ret = 0;
   if (!node)
     return LIBNBT_ERROR_INTERNAL;
-  if (n_node)
-    (*n_node)++;
-
-  if (set_func && main_klass)
-    {
-      int passed_ms = 1000.0f * (clock () - start_time) / CLOCKS_PER_SEC;
-      if (passed_ms % 500 == 0 || (*n_node + 1) == nodes)
-        set_func (main_klass, (*n_node) * 100 / nodes, "Parsing NBT");
-    }
-  if (g_cancellable_is_cancelled (cancellable))
+  if (!nbt_progress_tick (progress, 1))
     return LIBNBT_ERROR_INTERNAL;
   NbtData *data = node->data;
+  if (stats && isValidTag (data->type))
+    {
+      stats->n_nodes[data->type]++;
+      stats->max_depth = MAX (stats->max_depth, level);
+    }
   if (writekey)
-    nbt_node_write_key_to_gbytearray (arr, data->key, data->type);
+    nbt_node_write_key_to_gbytearray (arr, data->key, data->type, stats);
   switch (data->type)
     {
     case TAG_Byte:
@@ -287,17 +380,15 @@ nbt_node_write_nbt_to_gbytearray (GByteArray *arr, NbtNode *node, int writekey,
                                           data->value_a.len, data->type);
       break;
     case TAG_String:
-      nbt_node_write_string_to_gbytearray (arr, data->value_a.value);
+      nbt_node_write_string_to_gbytearray (arr, data->value_a.value, stats);
       break;
     case TAG_List:
-      ret = nbt_node_write_list_to_gbytearray (arr, node, set_func, main_klass,
-                                               n_node, nodes, start_time,
-                                               cancellable);
+      ret = nbt_node_write_list_to_gbytearray (arr, node, level, progress,
+                                               stats);
       return ret;
     case TAG_Compound:
-      ret = nbt_node_write_compound_to_gbytearray (arr, node, set_func,
-                                                   main_klass, n_node, nodes,
-                                                   start_time, cancellable);
+      ret = nbt_node_write_compound_to_gbytearray (arr, node, level,
+                                                   progress, stats);
       return ret;
     default:
       return LIBNBT_ERROR_INTERNAL;
@@ -318,38 +409,607 @@ convert_string_to_mutf8 (const char *str)
         g_string_append_unichar (string, c);
       else
         {
-          int more_val = 0x10000;
-          c = c - more_val;
+          /* Supplementary characters are written as the surrogate pair,
+           * every half encoded as a 3-byte character */
+          c -= 0x10000;
+          guint16 high = 0xd800 + (c >> 10);
+          guint16 low = 0xdc00 + (c & 0x3ff);
           uint8_t temp[7];
-          int hi = (1 << 20) - 1 - ((1 << 10) - 1);
-          guint hipos = (c & hi) >> 10;
-          int mid3 = 0x3c0;
-          int mid4 = 0x3f;
-          temp[0] = 0b11101101;
-          temp[1] = 0b10100000 + (hipos & mid3);
-          temp[2] = 0b10000000 + (hipos & mid4);
-          temp[3] = temp[0];
-          temp[4] = 0b10110000 + (c & mid3);
-          temp[5] = 0b10000000 + (c & mid4);
+          temp[0] = 0xe0 | (high >> 12);
+          temp[1] = 0x80 | ((high >> 6) & 0x3f);
+          temp[2] = 0x80 | (high & 0x3f);
+          temp[3] = 0xe0 | (low >> 12);
+          temp[4] = 0x80 | ((low >> 6) & 0x3f);
+          temp[5] = 0x80 | (low & 0x3f);
           temp[6] = 0;
-          g_string_append (string, temp);
+          g_string_append (string, (const char *)temp);
         }
     }
   return g_string_free_and_steal (string);
 }
 
+/* The length of `str` converted by `convert_string_to_mutf8`, which stops
+ * at a null character like its `strlen` */
+static gsize
+mutf8_length (const char *str)
+{
+  gsize len = 0;
+  for (; *str; str = g_utf8_next_char (str))
+    {
+      gunichar c = g_utf8_get_char (str);
+      if (c == 0)
+        break;
+      len += c < 0x80 ? 1 : c < 0x800 ? 2 : c < 65536 ? 3 : 6;
+    }
+  return len;
+}
+
+/* The bytes written for `node` without its children, or 0 when its type
+ * can't be written */
+static gsize
+node_packed_size (const NbtNode *node, gboolean writekey)
+{
+  NbtData *data = node->data;
+  gsize size = 0;
+  if (writekey)
+    size = 3 + (data->key ? mutf8_length (data->key) : 0);
+  gsize len = data->value_a.len;
+  switch (data->type)
+    {
+    case TAG_Byte:
+    case TAG_Short:
+    case TAG_Int:
+    case TAG_Long:
+    case TAG_Float:
+    case TAG_Double:
+      return size + nbt_reader_scalar_size (data->type);
+    case TAG_Byte_Array:
+      return size + 4 + len;
+    case TAG_Int_Array:
+      return size + 4 + len * 4;
+    case TAG_Long_Array:
+      return size + 4 + len * 8;
+    case TAG_String:
+      return size + 2 + mutf8_length (data->value_a.value);
+    case TAG_List:
+      size += 5;
+      if (nbt_data_is_packed_list (data))
+        size += len * nbt_reader_scalar_size (nbt_data_list_type (data));
+      return size;
+    case TAG_Compound:
+      return size + 1;
+    default:
+      return 0;
+    }
+}
+
+/* The bytes written for `node` and its children, or 0 when a node can't
+ * be written */
+static gsize
+subtree_packed_size (const NbtNode *node, gboolean writekey)
+{
+  gsize size = node_packed_size (node, writekey);
+  if (!size)
+    return 0;
+  const NbtNode *current = node->children;
+  while (current)
+    {
+      NbtData *parent_data = current->parent->data;
+      gsize node_size
+          = node_packed_size (current, parent_data->type == TAG_Compound);
+      if (!node_size)
+        return 0;
+      size += node_size;
+      if (current->children)
+        {
+          current = current->children;
+          continue;
+        }
+      while (current != node && !current->next)
+        current = current->parent;
+      if (current == node)
+        break;
+      current = current->next;
+    }
+  return size;
+}
+
+/* Smaller trees are packed on the calling thread */
+#define PARALLEL_PACK_MIN (4 * 1024 * 1024)
+/* The least bytes of the children written by a task */
+#define PARALLEL_PACK_TASK_MIN (256 * 1024)
+
+/* A run of the children of the root, written by a thread into its slice
+ * of exactly `out.size` bytes of the result */
+typedef struct PackTask
+{
+  NbtNode *first;
+  guint n_children;
+  gboolean writekey;
+  GCancellable *cancellable;
+  PackOutput out;
+  NbtStats stats;
+  NbtStats *stats_p;
+  int ret;
+} PackTask;
+
+static void
+pack_task_run (gpointer task_data, gpointer user_data)
+{
+  PackTask *task = task_data;
+  NbtProgress progress;
+  nbt_progress_init (&progress, NULL, NULL, task->cancellable, 0, 0, 0,
+                     NULL);
+  NbtNode *child = task->first;
+  for (guint i = 0; i < task->n_children && !task->ret; i++)
+    {
+      task->ret = nbt_node_write_nbt_to_gbytearray (
+          &task->out, child, task->writekey, 1, &progress, task->stats_p);
+      child = child->next;
+    }
+  /* The slice is filled exactly unless the sizes are wrong */
+  if (!task->ret && (task->out.overrun || task->out.len != task->out.size))
+    task->ret = LIBNBT_ERROR_INTERNAL;
+  g_async_queue_push (user_data, task);
+}
+
+/* Write the root like `nbt_node_write_nbt_to_gbytearray`, with its
+ * children split into tasks run on a thread pool. The array is sized once
+ * and every task writes its children at their offset in it. The result is
+ * NULL when the tree is left to the serial path, because it's small or a
+ * node can't be written */
+static GByteArray *
+pack_parallel (NbtNode *node, NbtProgress *progress, NbtStats *stats,
+               int *ret)
+{
+  NbtData *data = node->data;
+  guint n_threads = g_get_num_processors ();
+  if ((data->type != TAG_Compound && data->type != TAG_List)
+      || nbt_data_is_packed_list (data) || !node->children
+      || !node->children->next || n_threads < 2)
+    return NULL;
+
+  /* Size the children to balance the tasks and place their slices */
+  gboolean writekey = data->type == TAG_Compound;
+  guint n_children = g_node_n_children (node);
+  gsize *sizes = g_new (gsize, n_children);
+  gsize total = 0;
+  guint i = 0;
+  for (NbtNode *child = node->children; child; child = child->next, i++)
+    {
+      sizes[i] = subtree_packed_size (child, writekey);
+      if (!sizes[i])
+        {
+          g_free (sizes);
+          return NULL;
+        }
+      total += sizes[i];
+    }
+  if (total < PARALLEL_PACK_MIN)
+    {
+      g_free (sizes);
+      return NULL;
+    }
+
+  /* The header of the root comes first, and the end of a compound last */
+  gsize root_size = node_packed_size (node, TRUE);
+  gsize header_size = root_size - (writekey ? 1 : 0);
+  GByteArray *arr = g_byte_array_sized_new (root_size + total);
+  g_byte_array_set_size (arr, root_size + total);
+
+  gsize task_size = MAX (total / (n_threads * 4), PARALLEL_PACK_TASK_MIN);
+  PackTask *tasks = g_new0 (PackTask, n_children);
+  guint n_tasks = 0;
+  gsize offset = header_size;
+  i = 0;
+  for (NbtNode *child = node->children; child; child = child->next, i++)
+    {
+      PackTask *task = &tasks[n_tasks];
+      if (!task->n_children)
+        {
+          task->first = child;
+          task->writekey = writekey;
+          task->cancellable = progress->cancellable;
+          task->out.slice = arr->data + offset;
+          task->stats_p = stats ? &task->stats : NULL;
+        }
+      task->n_children++;
+      task->out.size += sizes[i];
+      offset += sizes[i];
+      if (task->out.size >= task_size || !child->next)
+        n_tasks++;
+    }
+  g_free (sizes);
+
+  /* The root itself, as the serial writer does at level 0 */
+  PackOutput header = { NULL, arr->data, 0, header_size, FALSE };
+  nbt_progress_tick (progress, 1);
+  if (stats)
+    stats->n_nodes[data->type]++;
+  nbt_node_write_key_to_gbytearray (&header, data->key, data->type, stats);
+  if (data->type == TAG_List)
+    {
+      NbtData *child_data = node->children->data;
+      nbt_node_write_uint8_to_gbytearray (&header, child_data->type);
+      nbt_node_write_uint32_to_gbytearray (&header, n_children);
+    }
+  if (writekey)
+    arr->data[arr->len - 1] = TAG_End;
+
+  GAsyncQueue *done = g_async_queue_new ();
+  GThreadPool *pool = g_thread_pool_new (
+      pack_task_run, done, MIN (n_threads, n_tasks), FALSE, NULL);
+  for (i = 0; i < n_tasks; i++)
+    g_thread_pool_push (pool, &tasks[i], NULL);
+  /* The tasks poll the cancellable themselves */
+  for (i = 0; i < n_tasks; i++)
+    {
+      PackTask *task = g_async_queue_pop (done);
+      nbt_progress_advance (progress, task->n_children);
+    }
+  g_thread_pool_free (pool, FALSE, TRUE);
+  g_async_queue_unref (done);
+
+  /* The tasks count what the serial writer would, nothing more */
+  *ret = header.overrun || header.len != header_size ? LIBNBT_ERROR_INTERNAL
+                                                     : 0;
+  for (i = 0; i < n_tasks; i++)
+    {
+      PackTask *task = &tasks[i];
+      if (!*ret)
+        *ret = task->ret;
+      if (stats)
+        {
+          for (int type = 0; type <= TAG_Long_Array; type++)
+            stats->n_nodes[type] += task->stats.n_nodes[type];
+          stats->max_depth = MAX (stats->max_depth, task->stats.max_depth);
+          stats->n_allocs += task->stats.n_allocs;
+          stats->alloc_bytes += task->stats.alloc_bytes;
+        }
+    }
+  g_free (tasks);
+  return arr;
+}
+
+/* Compress `data` block by block to `os`, `compression` can be none */
+static gboolean
+write_compressed (GOutputStream *os, const guint8 *data, gsize len,
+                  NBT_Compression compression, NbtStats *stats,
+                  GCancellable *cancellable, GError **error)
+{
+  gint64 start = 0;
+  if (compression != NBT_Compression_GZIP
+      && compression != NBT_Compression_ZLIB)
+    {
+      start = stats ? g_get_monotonic_time () : 0;
+      gboolean ret = g_output_stream_write_all (os, data, len, NULL,
+                                                cancellable, error);
+      if (stats)
+        {
+          stats->io_time += g_get_monotonic_time () - start;
+          stats->bytes_out = len;
+        }
+      return ret;
+    }
+
+  GZlibCompressorFormat format = compression == NBT_Compression_GZIP
+                                     ? G_ZLIB_COMPRESSOR_FORMAT_GZIP
+                                     : G_ZLIB_COMPRESSOR_FORMAT_ZLIB;
+  GZlibCompressor *compressor = g_zlib_compressor_new (format, -1);
+  guint8 *block = g_malloc (PACK_BLOCK_SIZE);
+  if (stats)
+    {
+      stats->n_allocs++;
+      stats->alloc_bytes += PACK_BLOCK_SIZE;
+    }
+  gsize consumed = 0;
+  GConverterResult result = G_CONVERTER_CONVERTED;
+  gboolean ret = TRUE;
+  while (result != G_CONVERTER_FINISHED)
+    {
+      gsize current_consumed_len = 0;
+      gsize current_write_len = 0;
+      if (stats)
+        start = g_get_monotonic_time ();
+      result = g_converter_convert (
+          G_CONVERTER (compressor), data + consumed, len - consumed, block,
+          PACK_BLOCK_SIZE, G_CONVERTER_INPUT_AT_END, &current_consumed_len,
+          &current_write_len, error);
+      if (stats)
+        {
+          gint64 now = g_get_monotonic_time ();
+          stats->deflate_time += now - start;
+          start = now;
+        }
+      if (result == G_CONVERTER_ERROR)
+        {
+          ret = FALSE;
+          break;
+        }
+      consumed += current_consumed_len;
+      if (!g_output_stream_write_all (os, block, current_write_len, NULL,
+                                      cancellable, error))
+        {
+          ret = FALSE;
+          break;
+        }
+      if (stats)
+        {
+          stats->io_time += g_get_monotonic_time () - start;
+          stats->bytes_out += current_write_len;
+        }
+    }
+  if (stats && ret)
+    stats->compressed_size = stats->bytes_out;
+  g_free (block);
+  g_object_unref (compressor);
+  return ret;
+}
+
+/* The data compressed in parallel is split in blocks of this size, each
+ * primed with the window before it */
+#define PARALLEL_DEFLATE_BLOCK (128 * 1024)
+#define PARALLEL_DEFLATE_WINDOW (32 * 1024)
+
+/* A block deflated by a thread as raw deflate data, ended by a sync flush
+ * so the blocks can be joined, or by the final block of the stream */
+typedef struct DeflateTask
+{
+  const guint8 *data;
+  gsize len;
+  gsize dict_len;
+  gboolean last;
+  guint8 *out;
+  gsize out_len;
+  /* The CRC-32 or Adler-32 of the block, combined in order */
+  guint32 check;
+  gint64 time;
+  gboolean failed;
+  gboolean done;
+} DeflateTask;
+
+typedef struct DeflateState
+{
+  NBT_Compression compression;
+  GMutex mutex;
+  GCond cond;
+} DeflateState;
+
+static void
+deflate_task_run (gpointer task_data, gpointer user_data)
+{
+  DeflateTask *task = task_data;
+  DeflateState *state = user_data;
+  gint64 start = g_get_monotonic_time ();
+  z_stream strm = { 0 };
+  int ret = deflateInit2 (&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                          Z_DEFAULT_STRATEGY);
+  if (ret == Z_OK && task->dict_len)
+    ret = deflateSetDictionary (&strm, task->data - task->dict_len,
+                                task->dict_len);
+  if (ret == Z_OK)
+    {
+      /* The sync flush adds an empty stored block to the bound */
+      gsize size = deflateBound (&strm, task->len) + 16;
+      task->out = g_malloc (size);
+      strm.next_in = (Bytef *)task->data;
+      strm.avail_in = task->len;
+      strm.next_out = task->out;
+      strm.avail_out = size;
+      ret = deflate (&strm, task->last ? Z_FINISH : Z_SYNC_FLUSH);
+      task->failed = strm.avail_in || !strm.avail_out
+                     || ret != (task->last ? Z_STREAM_END : Z_OK);
+      task->out_len = size - strm.avail_out;
+      deflateEnd (&strm);
+    }
+  else
+    task->failed = TRUE;
+  if (state->compression == NBT_Compression_GZIP)
+    task->check = crc32 (0, task->data, task->len);
+  else
+    task->check = adler32 (1, task->data, task->len);
+  task->time = g_get_monotonic_time () - start;
+
+  g_mutex_lock (&state->mutex);
+  task->done = TRUE;
+  g_cond_broadcast (&state->cond);
+  g_mutex_unlock (&state->mutex);
+}
+
+/* Compress `data` like `write_compressed` with the blocks deflated on a
+ * thread pool, like pigz. The result is one gzip or zlib stream, which
+ * differs from the one of `write_compressed` but holds the same data */
+static gboolean
+write_compressed_parallel (GOutputStream *os, const guint8 *data, gsize len,
+                           NBT_Compression compression, NbtStats *stats,
+                           GCancellable *cancellable, GError **error)
+{
+  guint n_threads = g_get_num_processors ();
+  if (n_threads < 2 || len < 2 * PARALLEL_DEFLATE_BLOCK
+      || (compression != NBT_Compression_GZIP
+          && compression != NBT_Compression_ZLIB))
+    return write_compressed (os, data, len, compression, stats, cancellable,
+                             error);
+
+  gsize n_blocks
+      = (len + PARALLEL_DEFLATE_BLOCK - 1) / PARALLEL_DEFLATE_BLOCK;
+  DeflateTask *tasks = g_new0 (DeflateTask, n_blocks);
+  for (gsize i = 0; i < n_blocks; i++)
+    {
+      tasks[i].data = data + i * PARALLEL_DEFLATE_BLOCK;
+      tasks[i].len = MIN (len - i * PARALLEL_DEFLATE_BLOCK,
+                          PARALLEL_DEFLATE_BLOCK);
+      tasks[i].dict_len = i ? PARALLEL_DEFLATE_WINDOW : 0;
+      tasks[i].last = i == n_blocks - 1;
+    }
+  DeflateState state = { compression };
+  g_mutex_init (&state.mutex);
+  g_cond_init (&state.cond);
+  GThreadPool *pool = g_thread_pool_new (deflate_task_run, &state,
+                                         n_threads, FALSE, NULL);
+  /* Only a few blocks are deflated ahead of the one written */
+  gsize n_pushed = MIN (n_blocks, n_threads * 2);
+  for (gsize i = 0; i < n_pushed; i++)
+    g_thread_pool_push (pool, &tasks[i], NULL);
+
+  /* The headers written by zlib for the default level */
+  static const guint8 gzip_header[]
+      = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+  static const guint8 zlib_header[] = { 0x78, 0x9c };
+  gboolean gzip = compression == NBT_Compression_GZIP;
+  gint64 start = stats ? g_get_monotonic_time () : 0;
+  gsize header_len = gzip ? sizeof (gzip_header) : sizeof (zlib_header);
+  gboolean ret = g_output_stream_write_all (
+      os, gzip ? gzip_header : zlib_header, header_len, NULL, cancellable,
+      error);
+  if (stats)
+    {
+      stats->io_time += g_get_monotonic_time () - start;
+      stats->bytes_out += header_len;
+    }
+
+  guint32 check = gzip ? crc32 (0, NULL, 0) : adler32 (0, NULL, 0);
+  for (gsize i = 0; ret && i < n_blocks; i++)
+    {
+      DeflateTask *task = &tasks[i];
+      g_mutex_lock (&state.mutex);
+      while (!task->done)
+        g_cond_wait (&state.cond, &state.mutex);
+      g_mutex_unlock (&state.mutex);
+      if (n_pushed < n_blocks)
+        g_thread_pool_push (pool, &tasks[n_pushed++], NULL);
+      if (task->failed)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "Failed to compress the data.");
+          ret = FALSE;
+          break;
+        }
+      if (gzip)
+        check = crc32_combine (check, task->check, task->len);
+      else
+        check = adler32_combine (check, task->check, task->len);
+      if (stats)
+        {
+          stats->deflate_time += task->time;
+          stats->n_allocs++;
+          stats->alloc_bytes += task->out_len;
+          start = g_get_monotonic_time ();
+        }
+      ret = g_output_stream_write_all (os, task->out, task->out_len, NULL,
+                                       cancellable, error);
+      if (stats)
+        {
+          stats->io_time += g_get_monotonic_time () - start;
+          stats->bytes_out += task->out_len;
+        }
+      g_clear_pointer (&task->out, g_free);
+    }
+
+  if (ret)
+    {
+      /* gzip ends with the CRC-32 and the size in little endian, zlib
+       * with the Adler-32 in big endian */
+      guint32 trailer[2];
+      gsize trailer_len = gzip ? 8 : 4;
+      if (gzip)
+        {
+          trailer[0] = GUINT32_TO_LE (check);
+          trailer[1] = GUINT32_TO_LE ((guint32)len);
+        }
+      else
+        trailer[0] = GUINT32_TO_BE (check);
+      if (stats)
+        start = g_get_monotonic_time ();
+      ret = g_output_stream_write_all (os, trailer, trailer_len, NULL,
+                                       cancellable, error);
+      if (stats)
+        {
+          stats->io_time += g_get_monotonic_time () - start;
+          stats->bytes_out += trailer_len;
+        }
+    }
+  if (stats && ret)
+    stats->compressed_size = stats->bytes_out;
+
+  g_thread_pool_free (pool, TRUE, TRUE);
+  for (gsize i = 0; i < n_blocks; i++)
+    g_free (tasks[i].out);
+  g_free (tasks);
+  g_mutex_clear (&state.mutex);
+  g_cond_clear (&state.cond);
+  return ret;
+}
+
+/* Create the file with its parent directories, and open it for writing */
+static GOutputStream *
+open_output_file (GFile *file, GCancellable *cancellable, GError **error)
+{
+  if (!g_file_query_exists (file, NULL))
+    {
+      GError *err = NULL;
+      g_file_make_directory_with_parents (file, cancellable, &err);
+      if (!err)
+        g_file_delete (file, cancellable, &err);
+      if (err)
+        {
+          g_propagate_error (error, err);
+          return NULL;
+        }
+    }
+  GFileOutputStream *fos = g_file_replace (file, NULL, FALSE,
+                                           G_FILE_CREATE_NONE, cancellable,
+                                           error);
+  return fos ? G_OUTPUT_STREAM (fos) : NULL;
+}
+
 uint8_t *
 nbt_node_pack_full (NbtNode *node, size_t *length, NBT_Compression compression,
                     GError **error, DhProgressFullSet set_func,
                     void *main_klass, GCancellable *cancellable, GFile *file)
 {
+  return nbt_node_pack_full_stats (node, length, compression, error, set_func,
+                                   main_klass, cancellable, file, NULL);
+}
+
+uint8_t *
+nbt_node_pack_full_stats (NbtNode *node, size_t *length,
+                          NBT_Compression compression, GError **error,
+                          DhProgressFullSet set_func, void *main_klass,
+                          GCancellable *cancellable, GFile *file,
+                          NbtStats *stats)
+{
+  return nbt_node_pack_with_flags (node, length, compression,
+                                   NBT_PACK_FLAGS_NONE, error, set_func,
+                                   main_klass, cancellable, file, stats);
+}
+
+uint8_t *
+nbt_node_pack_with_flags (NbtNode *node, size_t *length,
+                          NBT_Compression compression, NbtPackFlags flags,
+                          GError **error, DhProgressFullSet set_func,
+                          void *main_klass, GCancellable *cancellable,
+                          GFile *file, NbtStats *stats)
+{
+  if (stats)
+    memset (stats, 0, sizeof (NbtStats));
+
   /* Write NBT buffer to ByteArray */
-  GByteArray *buf = g_byte_array_new ();
-  gsize n_node = g_node_n_nodes (node, G_TRAVERSE_ALL);
-  int n = 0;
-  int ret = nbt_node_write_nbt_to_gbytearray (buf, node, TRUE, set_func,
-                                              main_klass, &n, n_node, clock (),
-                                              cancellable);
+  GByteArray *buf = NULL;
+  NbtProgress progress;
+  nbt_progress_init (&progress, set_func, main_klass, cancellable, 0, 100,
+                     g_node_n_children (node), "Packing NBT");
+  gint64 start = stats ? g_get_monotonic_time () : 0;
+  int ret = 0;
+  if (node && flags & NBT_PACK_PARALLEL)
+    buf = pack_parallel (node, &progress, stats, &ret);
+  if (!buf)
+    {
+      buf = g_byte_array_new ();
+      PackOutput out = { buf };
+      ret = nbt_node_write_nbt_to_gbytearray (&out, node, TRUE, 0, &progress,
+                                              stats);
+    }
   if (ret || g_cancellable_is_cancelled (cancellable))
     {
       g_byte_array_free (buf, TRUE);
@@ -358,58 +1018,53 @@ nbt_node_pack_full (NbtNode *node, size_t *length, NBT_Compression compression,
                            "The task was cancelled in packing process.");
       return NULL;
     }
+  nbt_progress_finish (&progress, NULL);
+  if (stats)
+    {
+      stats->tree_time = g_get_monotonic_time () - start;
+      stats->bytes_in = buf->len;
+      stats->decompressed_size = buf->len;
+      stats->n_allocs++;
+      stats->alloc_bytes += buf->len;
+    }
+
+  /* Nothing to compress or write */
+  if (!file && compression != NBT_Compression_GZIP
+      && compression != NBT_Compression_ZLIB)
+    {
+      if (stats)
+        stats->bytes_out = buf->len;
+      if (length)
+        *length = buf->len;
+      return g_byte_array_free (buf, FALSE);
+    }
 
   /* Compress the data */
-  GBytes *original_bytes = g_byte_array_free_to_bytes (buf);
-  gsize original_len = 0;
-  guint8 *original_nbt = g_bytes_unref_to_data (original_bytes, &original_len);
   void *ret_data = NULL;
-
-  GZlibCompressorFormat format;
-  if (compression == NBT_Compression_GZIP)
-    format = G_ZLIB_COMPRESSOR_FORMAT_GZIP;
-  else if (compression == NBT_Compression_ZLIB)
-    format = G_ZLIB_COMPRESSOR_FORMAT_ZLIB;
-  else
-    format = G_ZLIB_COMPRESSOR_FORMAT_RAW;
-
-  GZlibCompressor *compressor = g_zlib_compressor_new (format, -1);
-  GInputStream *is = g_memory_input_stream_new_from_data (
-      original_nbt, original_len, g_free);
   GOutputStream *os = NULL;
   if (file)
     {
-      if (!g_file_query_exists (file, NULL))
-        {
-          g_file_make_directory_with_parents (file, cancellable, error);
-          if (error && *error)
-            goto error_handle_early;
-          g_file_delete (file, cancellable, error);
-          if (error && *error)
-            goto error_handle_early;
-        }
-      GFileOutputStream *fos = g_file_replace (
-          file, NULL, FALSE, G_FILE_CREATE_NONE, cancellable, error);
-      /* Replace file error */
-      if (error && *error)
+      os = open_output_file (file, cancellable, error);
+      if (!os)
         {
-        error_handle_early:
-          g_object_unref (compressor);
-          g_object_unref (is);
+          g_byte_array_free (buf, TRUE);
           return NULL;
         }
-      os = G_OUTPUT_STREAM (fos);
     }
   else
     os = g_memory_output_stream_new_resizable ();
-  GOutputStream *cos
-      = g_converter_output_stream_new (os, G_CONVERTER (compressor));
-  g_output_stream_splice (cos, is, G_OUTPUT_STREAM_SPLICE_NONE, cancellable,
-                          error);
-  if (error && *error)
+
+  gboolean written;
+  if (flags & NBT_PACK_PARALLEL_COMPRESS)
+    written = write_compressed_parallel (os, buf->data, buf->len,
+                                         compression, stats, cancellable,
+                                         error);
+  else
+    written = write_compressed (os, buf->data, buf->len, compression, stats,
+                                cancellable, error);
+  if (!written)
     goto error_handle;
-  g_output_stream_close (cos, cancellable, error);
-  if (error && *error)
+  if (!g_output_stream_close (os, cancellable, error))
     goto error_handle;
 
   if (!file)
@@ -420,20 +1075,302 @@ nbt_node_pack_full (NbtNode *node, size_t *length, NBT_Compression compression,
     }
 
 error_handle:
-  g_object_unref (cos);
-  g_object_unref (is);
+  g_byte_array_free (buf, TRUE);
   g_object_unref (os);
-  g_object_unref (compressor);
 
   return ret_data;
 }
 
+/* The SNBT is written to `buffer`, which is handed to the output stream
+ * every `PACK_BLOCK_SIZE` bytes, so dumping a big tree to a file doesn't
+ * hold the whole text in memory. Without a stream the buffer is the
+ * result. */
+typedef struct SnbtWriter
+{
+  GString *buffer;
+  GOutputStream *os;
+  GCancellable *cancellable;
+  NbtProgress *progress;
+  int max_level;
+  gboolean pretty_output;
+  gboolean space;
+  guint64 written;
+  GError *error;
+} SnbtWriter;
+
+/* The escaped form of the bytes in strings, 0 if the byte is copied as is.
+ * 'u' stands for a `\uXXXX` escape. The quotes are only escaped when they
+ * are the quote of the string. */
+static const char snbt_escapes[256] = {
+  ['\0'] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u',
+  [0x05] = 'u', [0x06] = 'u', [0x07] = 'u', ['\b'] = 'b', ['\t'] = 't',
+  ['\n'] = 'n', [0x0b] = 'u', ['\f'] = 'f', ['\r'] = 'r', [0x0e] = 'u',
+  [0x0f] = 'u', [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u',
+  [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u', [0x18] = 'u',
+  [0x19] = 'u', [0x1a] = 'u', [0x1b] = 'u', [0x1c] = 'u', [0x1d] = 'u',
+  [0x1e] = 'u', [0x1f] = 'u', ['"'] = '"',  ['\''] = '\'', ['\\'] = '\\',
+};
+
+static gboolean
+snbt_is_bare_key_char (guchar c)
+{
+  return g_ascii_isalnum (c) || c == '_' || c == '-' || c == '.' || c == '+';
+}
+
+static gboolean
+snbt_flush (SnbtWriter *writer, gsize threshold)
+{
+  GString *buffer = writer->buffer;
+  if (!writer->os || buffer->len < threshold || buffer->len == 0)
+    return TRUE;
+  if (!g_output_stream_write_all (writer->os, buffer->str, buffer->len, NULL,
+                                  writer->cancellable, &writer->error))
+    return FALSE;
+  writer->written += buffer->len;
+  g_string_truncate (buffer, 0);
+  return TRUE;
+}
+
+/* Quote and escape in one pass. The quote is the first one which doesn't
+ * appear in the string, so its place is kept until it's known. */
 static void
-snbt_write_nbt (GString *string, NbtNode *node, GError **error, int max_level,
-                gboolean pretty_output, gboolean space,
-                DhProgressFullSet set_func, void *main_klass,
-                GCancellable *cancellable)
+snbt_write_string (GString *buffer, const char *str)
 {
+  gsize quote_pos = buffer->len;
+  char quote = 0;
+  g_string_append_c (buffer, '"');
+  const char *run = str;
+  const char *p = str;
+  for (; *p; p++)
+    {
+      guchar c = *p;
+      char escape = snbt_escapes[c];
+      if (G_LIKELY (!escape))
+        continue;
+      if (c == '"' || c == '\'')
+        {
+          if (!quote)
+            quote = c == '"' ? '\'' : '"';
+          if (c != quote)
+            continue;
+        }
+      g_string_append_len (buffer, run, p - run);
+      run = p + 1;
+      if (escape == 'u')
+        g_string_append_printf (buffer, "\\u%04x", c);
+      else
+        {
+          char escaped[2] = { '\\', escape };
+          g_string_append_len (buffer, escaped, 2);
+        }
+    }
+  g_string_append_len (buffer, run, p - run);
+  buffer->str[quote_pos] = quote ? quote : '"';
+  g_string_append_c (buffer, buffer->str[quote_pos]);
+}
+
+static void
+snbt_write_key (GString *buffer, const char *key)
+{
+  const char *p = key;
+  while (*p && snbt_is_bare_key_char (*p))
+    p++;
+  if (*key && !*p)
+    g_string_append_len (buffer, key, p - key);
+  else
+    snbt_write_string (buffer, key);
+}
+
+static void
+snbt_write_integer (GString *buffer, gint64 value, char suffix)
+{
+  char num[NBT_FORMAT_BUFFER_SIZE + 1];
+  int len = nbt_format_int64 (num, value);
+  if (suffix)
+    num[len++] = suffix;
+  g_string_append_len (buffer, num, len);
+}
+
+/* SNBT has no form for NaN and the infinities, `NaNd` would be read back
+ * as a string, so they are refused */
+static gboolean
+snbt_write_floating (SnbtWriter *writer, double value, int type)
+{
+  char num[NBT_FORMAT_BUFFER_SIZE + 1];
+  int len;
+  if (!isfinite (value))
+    {
+      g_set_error (&writer->error, NBT_GLIB_PARSE_ERROR,
+                   NBT_GLIB_PARSE_ERROR_UNREPRESENTABLE,
+                   "The %s %g can't be written as SNBT.",
+                   type == TAG_Float ? "float" : "double", value);
+      return FALSE;
+    }
+  if (type == TAG_Float)
+    {
+      len = nbt_format_float (num, value);
+      num[len++] = 'f';
+    }
+  else
+    {
+      len = nbt_format_double (num, value);
+      num[len++] = 'd';
+    }
+  g_string_append_len (writer->buffer, num, len);
+  return TRUE;
+}
+
+static void
+snbt_write_separator (SnbtWriter *writer, char separator)
+{
+  g_string_append_c (writer->buffer, separator);
+  /* The line break does the job of the space in the pretty output */
+  if (writer->space && !(writer->pretty_output && separator == ','))
+    g_string_append_c (writer->buffer, ' ');
+}
+
+static void
+snbt_write_indent (SnbtWriter *writer, int level)
+{
+  if (!writer->pretty_output)
+    return;
+  g_string_append_c (writer->buffer, '\n');
+  for (int i = 0; i < level; i++)
+    g_string_append_len (writer->buffer, "    ", 4);
+}
+
+/* The elements of an array written between two flushes */
+#define SNBT_ARRAY_CHUNK 4096
+
+static gboolean
+snbt_write_array (SnbtWriter *writer, NbtData *data)
+{
+  GString *buffer = writer->buffer;
+  const char *prefix = data->type == TAG_Byte_Array  ? "[B;"
+                       : data->type == TAG_Int_Array ? "[I;"
+                                                     : "[L;";
+  g_string_append (buffer, prefix);
+  for (int32_t start = 0; start < data->value_a.len;
+       start += SNBT_ARRAY_CHUNK)
+    {
+      int32_t end = MIN (start + SNBT_ARRAY_CHUNK, data->value_a.len);
+      /* Format straight into the buffer, an element takes at most a
+       * number, its suffix, the comma and the space */
+      gsize old_len = buffer->len;
+      g_string_set_size (buffer, old_len + (gsize)(end - start)
+                                               * (NBT_FORMAT_BUFFER_SIZE + 3));
+      char *p = buffer->str + old_len;
+      for (int32_t i = start; i < end; i++)
+        {
+          /* The arrays stay on one line, even in the pretty output */
+          if (i)
+            *p++ = ',';
+          if (writer->space)
+            *p++ = ' ';
+          switch (data->type)
+            {
+            case TAG_Byte_Array:
+              p += nbt_format_int64 (p, ((gint8 *)data->value_a.value)[i]);
+              *p++ = 'b';
+              break;
+            case TAG_Int_Array:
+              p += nbt_format_int64 (p, ((gint32 *)data->value_a.value)[i]);
+              break;
+            default:
+              p += nbt_format_int64 (p, ((gint64 *)data->value_a.value)[i]);
+              *p++ = 'L';
+              break;
+            }
+        }
+      g_string_truncate (buffer, p - buffer->str);
+      /* An array alone can be bigger than many blocks */
+      if (!snbt_flush (writer, PACK_BLOCK_SIZE))
+        return FALSE;
+    }
+  g_string_append_c (buffer, ']');
+  return TRUE;
+}
+
+static gboolean
+snbt_write_nbt (SnbtWriter *writer, NbtNode *node, int level)
+{
+  GString *buffer = writer->buffer;
+  NbtData *data = node->data;
+  if (!nbt_progress_tick (writer->progress, 1))
+    return FALSE;
+  switch (data->type)
+    {
+    case TAG_Byte:
+      snbt_write_integer (buffer, (gint8)data->value_i, 'b');
+      break;
+    case TAG_Short:
+      snbt_write_integer (buffer, (gint16)data->value_i, 's');
+      break;
+    case TAG_Int:
+      snbt_write_integer (buffer, (gint32)data->value_i, 0);
+      break;
+    case TAG_Long:
+      snbt_write_integer (buffer, data->value_i, 'L');
+      break;
+    case TAG_Float:
+    case TAG_Double:
+      if (!snbt_write_floating (writer, data->value_d, data->type))
+        return FALSE;
+      break;
+    case TAG_Byte_Array:
+    case TAG_Int_Array:
+    case TAG_Long_Array:
+      if (!snbt_write_array (writer, data))
+        return FALSE;
+      break;
+    case TAG_String:
+      snbt_write_string (buffer, data->value_a.value);
+      break;
+    case TAG_List:
+    case TAG_Compound:
+      {
+        gboolean compound = data->type == TAG_Compound;
+        gboolean empty = !node->children && !nbt_data_is_packed_list (data);
+        if (!empty && writer->max_level >= 0 && level >= writer->max_level)
+          {
+            /* Too deep, only show that there's something */
+            g_string_append (buffer, "[...]");
+            break;
+          }
+        g_string_append_c (buffer, compound ? '{' : '[');
+        NbtListIter iter;
+        nbt_list_iter_init (&iter, node);
+        gboolean first = TRUE;
+        for (NbtNode *child; (child = nbt_list_iter_next (&iter));
+             first = FALSE)
+          {
+            if (!first)
+              snbt_write_separator (writer, ',');
+            snbt_write_indent (writer, level + 1);
+            if (compound)
+              {
+                NbtData *child_data = child->data;
+                snbt_write_key (buffer, child_data->key ? child_data->key
+                                                        : "");
+                snbt_write_separator (writer, ':');
+              }
+            if (!snbt_write_nbt (writer, child, level + 1))
+              return FALSE;
+            if (level == 0)
+              writer->progress->done++;
+          }
+        if (!empty)
+          snbt_write_indent (writer, level);
+        g_string_append_c (buffer, compound ? '}' : ']');
+        break;
+      }
+    default:
+      g_set_error (&writer->error, NBT_GLIB_PARSE_ERROR,
+                   NBT_GLIB_PARSE_ERROR_INVALID_TAG, "Invalid tag: %d.",
+                   data->type);
+      return FALSE;
+    }
+  return snbt_flush (writer, PACK_BLOCK_SIZE);
 }
 
 uint8_t *
@@ -442,11 +1379,52 @@ nbt_node_to_snbt_full (NbtNode *node, size_t *length, GError **error,
                        DhProgressFullSet set_func, void *main_klass,
                        GCancellable *cancellable, GFile *file)
 {
-  GString *string = g_string_new ("");
+  g_return_val_if_fail (node != NULL, NULL);
 
-  guint8 *ret;
-  ret = g_string_free_and_steal (string);
+  SnbtWriter writer = { 0 };
+  if (file)
+    {
+      writer.os = open_output_file (file, cancellable, error);
+      if (!writer.os)
+        return NULL;
+    }
+  NbtProgress progress;
+  nbt_progress_init (&progress, set_func, main_klass, cancellable, 0, 100,
+                     g_node_n_children (node), "Writing SNBT");
+  writer.buffer = g_string_sized_new (file ? PACK_BLOCK_SIZE * 2 : 256);
+  writer.cancellable = cancellable;
+  writer.progress = &progress;
+  writer.max_level = max_level;
+  writer.pretty_output = pretty_output;
+  writer.space = space;
+
+  gboolean ok = snbt_write_nbt (&writer, node, 0);
+  if (ok && writer.os)
+    ok = snbt_flush (&writer, 0)
+         && g_output_stream_close (writer.os, cancellable, &writer.error);
+  if (!ok)
+    {
+      if (!writer.error)
+        g_set_error_literal (&writer.error,
+                             g_quark_from_string ("NBT_NODE_ERROR_CANCELLED"),
+                             -1, "The task was cancelled in writing SNBT.");
+      g_propagate_error (error, writer.error);
+      g_string_free (writer.buffer, TRUE);
+      g_clear_object (&writer.os);
+      return NULL;
+    }
+  nbt_progress_finish (&progress, NULL);
+
+  if (writer.os)
+    {
+      /* Everything went to the file */
+      g_object_unref (writer.os);
+      g_string_free (writer.buffer, TRUE);
+      if (length)
+        *length = writer.written;
+      return NULL;
+    }
   if (length)
-    *length = strlen (ret);
-  return ret;
+    *length = writer.buffer->len;
+  return (uint8_t *)g_string_free_and_steal (writer.buffer);
 }
@@ -42,6 +42,26 @@ extern "C"
     NBT_Compression_NONE = 3,
   } NBT_Compression;
 
+  /**
+   * @brief The options of the packer.
+   */
+  typedef enum NbtPackFlags
+  {
+    NBT_PACK_FLAGS_NONE = 0,
+    /**
+     * Write the children of a large root on a thread pool, each into its
+     * own slice of the output. The output and the statistics are the same
+     * as without it.
+     */
+    NBT_PACK_PARALLEL = 1 << 0,
+    /**
+     * Compress a large output on a thread pool, in blocks primed with the
+     * data before them like pigz. The gzip or zlib stream differs from the
+     * one compressed on a single thread but holds the same data.
+     */
+    NBT_PACK_PARALLEL_COMPRESS = 1 << 1,
+  } NbtPackFlags;
+
 // Error code
 #define LIBNBT_ERROR_MASK 0xf0000000
 #define LIBNBT_ERROR_INTERNAL                                                 \
@@ -80,6 +100,52 @@ extern "C"
                                NBT_Compression compression, GError **error,
                                DhProgressFullSet set_func, void *main_klass,
                                GCancellable *cancellable, GFile *file);
+  /**
+   * @brief Pack the NBT node as the NBT text, with statistics.
+   * @param stats The statistics to fill, or NULL
+   * @sa nbt_node_pack_full
+   */
+  uint8_t *nbt_node_pack_full_stats (NbtNode *node, size_t *length,
+                                     NBT_Compression compression,
+                                     GError **error,
+                                     DhProgressFullSet set_func,
+                                     void *main_klass,
+                                     GCancellable *cancellable, GFile *file,
+                                     NbtStats *stats);
+  /**
+   * @brief Pack the NBT node as the NBT text, with the options.
+   * @param flags The options of the packer
+   * @sa nbt_node_pack_full_stats
+   */
+  uint8_t *nbt_node_pack_with_flags (NbtNode *node, size_t *length,
+                                     NBT_Compression compression,
+                                     NbtPackFlags flags, GError **error,
+                                     DhProgressFullSet set_func,
+                                     void *main_klass,
+                                     GCancellable *cancellable, GFile *file,
+                                     NbtStats *stats);
+  /**
+   * @brief Write the NBT node as the SNBT text, if `file` is NULL, output
+   * mode will be enabled.
+   *
+   * The floating numbers are written with the fewest digits which read back
+   * as the same value. NaN and the infinities have no SNBT form, so they
+   * fail with `NBT_GLIB_PARSE_ERROR_UNREPRESENTABLE`. When writing to the
+   * file, the text is written in blocks and never held as a whole.
+   * @param node The root node needed to write as SNBT
+   * @param length The length of the text, or NULL to ignore
+   * @param error Error code, or NULL to ignore
+   * @param max_level The lists and compounds deeper than it are replaced by
+   * `[...]`, -1 to disable
+   * @param pretty_output Put every element on its own indented line
+   * @param space Put a space after `:` and `,`
+   * @param set_func The setting function for progress
+   * @param main_klass The main class of the progress
+   * @param cancellable Cancellable object
+   * @param file File object, or NULL if using as the output mode
+   * @return The `'\0'` ended text when in output mode, or NULL when writing
+   * to the file or failed
+   */
   uint8_t *nbt_node_to_snbt_full (NbtNode *node, size_t *length,
                                   GError **error, int max_level,
                                   gboolean pretty_output, gboolean space,
@@ -0,0 +1,106 @@
+/*  nbt_allocator - Allocator part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_allocator.h"
+#include "nbt_private.h"
+
+/* The memory of an allocator starts with its allocator, padded to keep the
+ * alignment of what follows */
+typedef struct AllocHeader
+{
+  NbtAllocator *allocator;
+  gpointer padding;
+} AllocHeader;
+
+G_STATIC_ASSERT (sizeof (AllocHeader) == NBT_ALLOCATOR_HEADER_SIZE);
+
+/* The stack of the pushed allocators of every thread */
+static GPrivate allocator_stack
+    = G_PRIVATE_INIT ((GDestroyNotify)g_slist_free);
+
+void
+nbt_allocator_push_thread_default (NbtAllocator *allocator)
+{
+  g_return_if_fail (allocator && allocator->alloc && allocator->free);
+  GSList *stack = g_private_get (&allocator_stack);
+  g_private_set (&allocator_stack, g_slist_prepend (stack, allocator));
+}
+
+void
+nbt_allocator_pop_thread_default (NbtAllocator *allocator)
+{
+  GSList *stack = g_private_get (&allocator_stack);
+  g_return_if_fail (stack && stack->data == allocator);
+  g_private_set (&allocator_stack, g_slist_delete_link (stack, stack));
+}
+
+NbtAllocator *
+nbt_allocator_get_thread_default (void)
+{
+  GSList *stack = g_private_get (&allocator_stack);
+  return stack ? stack->data : NULL;
+}
+
+gpointer
+nbt_allocator_alloc (NbtAllocator *allocator, gsize size)
+{
+  AllocHeader *header
+      = allocator->alloc (sizeof (AllocHeader) + size, allocator->user_data);
+  header->allocator = allocator;
+  return header + 1;
+}
+
+void
+nbt_allocator_free (gpointer mem)
+{
+  AllocHeader *header = (AllocHeader *)mem - 1;
+  header->allocator->free (header, header->allocator->user_data);
+}
+
+gpointer
+nbt_part_alloc (gsize size, guint32 *flags, guint32 flag)
+{
+  NbtAllocator *allocator = nbt_allocator_get_thread_default ();
+  if (!allocator)
+    return nbt_pool_alloc (size);
+  *flags |= flag;
+  return nbt_allocator_alloc (allocator, size);
+}
+
+void
+nbt_part_free (gpointer mem, gsize size, gboolean custom)
+{
+  if (custom)
+    nbt_allocator_free (mem);
+  else
+    nbt_pool_free (mem, size);
+}
+
+NbtNode *
+nbt_node_new_with_allocator (guint8 *data, size_t length,
+                             NbtParseFlags flags, NbtAllocator *allocator,
+                             GError **err)
+{
+  if (allocator)
+    nbt_allocator_push_thread_default (allocator);
+  NbtNode *node = nbt_node_new_with_flags (data, length, flags, err, NULL,
+                                           NULL, NULL, 0, 0, NULL);
+  if (allocator)
+    nbt_allocator_pop_thread_default (allocator);
+  return node;
+}
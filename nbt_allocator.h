@@ -0,0 +1,74 @@
+/*  nbt_allocator - Allocator part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_ALLOCATOR_H
+#define DHLRC_NBT_ALLOCATOR_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The functions allocating the nodes of the trees.
+ *
+ * The nodes, their data, keys, strings and arrays made while the
+ * allocator is the default one of the thread come from `alloc`, and each
+ * remembers its allocator, so `nbt_node_free` gives it back to `free` from
+ * any thread. The allocator must live as long as the trees made by it.
+ * The values set later by the `nbt_node_set_*` functions come from
+ * `g_malloc`.
+ */
+typedef struct NbtAllocator
+{
+  /** Allocate `size` bytes aligned for any type, never failing */
+  gpointer (*alloc) (gsize size, gpointer user_data);
+  /** Free the memory given by `alloc` */
+  void (*free) (gpointer mem, gpointer user_data);
+  gpointer user_data;
+} NbtAllocator;
+
+/**
+ * @brief Make the allocator the default one of the calling thread, until
+ * `nbt_allocator_pop_thread_default` is called.
+ * @param allocator The allocator
+ */
+void nbt_allocator_push_thread_default (NbtAllocator *allocator);
+/**
+ * @brief Restore the default allocator before the push.
+ * @param allocator The allocator pushed last
+ */
+void nbt_allocator_pop_thread_default (NbtAllocator *allocator);
+/**
+ * @brief Get the default allocator of the calling thread.
+ * @return The allocator, or NULL when the trees come from `g_malloc`
+ */
+NbtAllocator *nbt_allocator_get_thread_default (void);
+
+/**
+ * @brief Parse the binary NBT into a tree made by the allocator.
+ * @param allocator The allocator, or NULL to use `g_malloc`
+ * @sa nbt_node_new_with_flags
+ */
+NbtNode *nbt_node_new_with_allocator (guint8 *data, size_t length,
+                                      NbtParseFlags flags,
+                                      NbtAllocator *allocator,
+                                      GError **err);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_ALLOCATOR_H
@@ -0,0 +1,390 @@
+/*  nbt_chunk - Chunk view part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_chunk.h"
+#include "nbt_hash.h"
+#include "nbt_packed.h"
+#include "nbt_util.h"
+
+#ifndef NBT_GLIB_DISABLE_TRANSLATION
+#include <libintl.h>
+#define _(text) gettext (text)
+#else
+#define _(text) text
+#endif
+
+#define SECTION_BLOCKS 4096
+/* The indices stop spanning two longs since 20w17a */
+#define ALIGNED_DATA_VERSION 2529
+
+GQuark
+nbt_chunk_error_quark (void)
+{
+  static GQuark q;
+  if G_UNLIKELY (q == 0)
+    q = g_quark_from_static_string ("nbt-glib-chunk-error-quark");
+  return q;
+}
+
+typedef struct Section
+{
+  int y;
+  /** The compound holding the palette and the data */
+  NbtNode *states;
+  NbtNode *palette;
+  /** The palette entries by their indices */
+  GPtrArray *entries;
+  /** The entries from this one on are owned by the section, they're added
+   * to the palette by the commit */
+  guint n_attached;
+  guint16 indices[SECTION_BLOCKS];
+  gboolean dirty;
+} Section;
+
+struct NbtChunk
+{
+  NbtNode *node;
+  NbtPackedLayout layout;
+  /** The keys are the ones before 1.18 */
+  gboolean legacy;
+  int min_y;
+  int max_y;
+  /** The sections by `y - min_y`, NULL where there's none */
+  Section **by_y;
+  GPtrArray *sections;
+};
+
+static void
+section_free (Section *section)
+{
+  for (guint i = section->n_attached; i < section->entries->len; i++)
+    nbt_node_free (g_ptr_array_index (section->entries, i));
+  g_ptr_array_free (section->entries, TRUE);
+  g_free (section);
+}
+
+static NbtNode *
+child_by_key (NbtNode *node, const char *key)
+{
+  if (!node || ((NbtData *)node->data)->type != TAG_Compound)
+    return NULL;
+  for (NbtNode *child = node->children; child; child = child->next)
+    if (g_strcmp0 (((NbtData *)child->data)->key, key) == 0)
+      return child;
+  return NULL;
+}
+
+static const char *
+entry_name (NbtNode *entry)
+{
+  NbtNode *name = child_by_key (entry, "Name");
+  return name ? nbt_node_get_string (name, NULL) : NULL;
+}
+
+static const char *
+data_key (NbtChunk *chunk)
+{
+  return chunk->legacy ? "BlockStates" : "data";
+}
+
+/* Decode the section, or return NULL when it has no blocks */
+static Section *
+section_new (NbtChunk *chunk, NbtNode *node, GError **error)
+{
+  gboolean failed = FALSE;
+  int y = nbt_node_get_byte (child_by_key (node, "Y"), &failed);
+  if (failed)
+    {
+      g_set_error_literal (error, NBT_CHUNK_ERROR, NBT_CHUNK_ERROR_INVALID,
+                           _ ("The section has no Y."));
+      return NULL;
+    }
+  NbtNode *states = chunk->legacy ? node : child_by_key (node, "block_states");
+  NbtNode *palette
+      = child_by_key (states, chunk->legacy ? "Palette" : "palette");
+  if (!palette || !palette->children)
+    return NULL;
+
+  Section *section = g_new0 (Section, 1);
+  section->y = y;
+  section->states = states;
+  section->palette = palette;
+  section->entries = g_ptr_array_new ();
+  for (NbtNode *entry = palette->children; entry; entry = entry->next)
+    g_ptr_array_add (section->entries, entry);
+
+  guint len = section->n_attached = section->entries->len;
+  NbtNode *data = child_by_key (states, data_key (chunk));
+  if (!data && len == 1)
+    return section;
+  int bits = nbt_packed_bits_for (len, 4);
+  guint16 max = 0;
+  if (len <= G_MAXUINT16
+      && nbt_node_get_packed (data, bits, chunk->layout, section->indices,
+                              SECTION_BLOCKS))
+    for (int i = 0; i < SECTION_BLOCKS; i++)
+      max = MAX (max, section->indices[i]);
+  else
+    max = G_MAXUINT16;
+  if (max >= len)
+    {
+      g_set_error (error, NBT_CHUNK_ERROR, NBT_CHUNK_ERROR_INVALID,
+                   _ ("The block states of the section %d are malformed."),
+                   y);
+      section_free (section);
+      return NULL;
+    }
+  return section;
+}
+
+NbtChunk *
+nbt_chunk_new (NbtNode *node, GError **error)
+{
+  g_return_val_if_fail (node, NULL);
+  NbtChunk *chunk = g_new0 (NbtChunk, 1);
+  chunk->node = node;
+  chunk->sections
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)section_free);
+
+  NbtNode *version = child_by_key (node, "DataVersion");
+  chunk->layout = version && nbt_node_get_int (version, NULL)
+                                 < ALIGNED_DATA_VERSION
+                      ? NBT_PACKED_SPANNING
+                      : NBT_PACKED_ALIGNED;
+  NbtNode *sections = child_by_key (node, "sections");
+  if (!sections)
+    {
+      sections = child_by_key (child_by_key (node, "Level"), "Sections");
+      chunk->legacy = TRUE;
+    }
+  if (!sections || ((NbtData *)sections->data)->type != TAG_List)
+    {
+      g_set_error_literal (error, NBT_CHUNK_ERROR, NBT_CHUNK_ERROR_INVALID,
+                           _ ("The chunk has no sections."));
+      nbt_chunk_free (chunk);
+      return NULL;
+    }
+
+  chunk->min_y = G_MAXINT;
+  chunk->max_y = G_MININT;
+  for (NbtNode *child = sections->children; child; child = child->next)
+    {
+      GError *internal_err = NULL;
+      Section *section = section_new (chunk, child, &internal_err);
+      if (internal_err)
+        {
+          g_propagate_error (error, internal_err);
+          nbt_chunk_free (chunk);
+          return NULL;
+        }
+      if (!section)
+        continue;
+      g_ptr_array_add (chunk->sections, section);
+      chunk->min_y = MIN (chunk->min_y, section->y);
+      chunk->max_y = MAX (chunk->max_y, section->y);
+    }
+  if (!chunk->sections->len)
+    {
+      chunk->min_y = chunk->max_y = 0;
+      return chunk;
+    }
+
+  /* A later section of the same height wins, like in the game */
+  chunk->by_y = g_new0 (Section *, chunk->max_y - chunk->min_y + 1);
+  for (guint i = 0; i < chunk->sections->len; i++)
+    {
+      Section *section = g_ptr_array_index (chunk->sections, i);
+      chunk->by_y[section->y - chunk->min_y] = section;
+    }
+  return chunk;
+}
+
+void
+nbt_chunk_free (NbtChunk *chunk)
+{
+  if (!chunk)
+    return;
+  g_ptr_array_free (chunk->sections, TRUE);
+  g_free (chunk->by_y);
+  g_free (chunk);
+}
+
+void
+nbt_chunk_get_section_range (NbtChunk *chunk, int *min_y, int *max_y)
+{
+  g_return_if_fail (chunk);
+  if (min_y)
+    *min_y = chunk->min_y;
+  if (max_y)
+    *max_y = chunk->max_y;
+}
+
+static Section *
+find_section (NbtChunk *chunk, int x, int y, int z, guint *index)
+{
+  if (x < 0 || x > 15 || z < 0 || z > 15 || !chunk->by_y)
+    return NULL;
+  int section_y = y < 0 ? (y - 15) / 16 : y / 16;
+  if (section_y < chunk->min_y || section_y > chunk->max_y)
+    return NULL;
+  *index = (y - section_y * 16) << 8 | z << 4 | x;
+  return chunk->by_y[section_y - chunk->min_y];
+}
+
+NbtNode *
+nbt_chunk_get_block (NbtChunk *chunk, int x, int y, int z)
+{
+  g_return_val_if_fail (chunk, NULL);
+  guint index;
+  Section *section = find_section (chunk, x, y, z, &index);
+  if (!section)
+    return NULL;
+  return g_ptr_array_index (section->entries, section->indices[index]);
+}
+
+const char *
+nbt_chunk_get_block_name (NbtChunk *chunk, int x, int y, int z)
+{
+  g_return_val_if_fail (chunk, NULL);
+  guint index;
+  Section *section = find_section (chunk, x, y, z, &index);
+  if (!section)
+    return NULL;
+  return entry_name (
+      g_ptr_array_index (section->entries, section->indices[index]));
+}
+
+gboolean
+nbt_chunk_set_block (NbtChunk *chunk, int x, int y, int z, NbtNode *state)
+{
+  g_return_val_if_fail (chunk && state, FALSE);
+  guint index;
+  Section *section = find_section (chunk, x, y, z, &index);
+  if (!section)
+    return FALSE;
+
+  guint len = section->entries->len;
+  guint i = 0;
+  for (; i < len; i++)
+    if (nbt_node_equal (g_ptr_array_index (section->entries, i), state))
+      break;
+  if (i == len)
+    {
+      g_return_val_if_fail (len < SECTION_BLOCKS, FALSE);
+      /* Checked here, the palette only gets it at the commit */
+      NbtNode *first = g_ptr_array_index (section->entries, 0);
+      g_return_val_if_fail (((NbtData *)state->data)->type
+                                == ((NbtData *)first->data)->type,
+                            FALSE);
+      NbtNode *entry = nbt_node_dup (state);
+      nbt_node_reset_key (entry, NULL);
+      g_ptr_array_add (section->entries, entry);
+    }
+  section->indices[index] = i;
+  section->dirty = TRUE;
+  return TRUE;
+}
+
+gboolean
+nbt_chunk_foreach_section (NbtChunk *chunk, NbtChunkSectionFunc func,
+                           gpointer user_data)
+{
+  g_return_val_if_fail (chunk && func, FALSE);
+  if (!chunk->by_y)
+    return TRUE;
+  for (int y = chunk->min_y; y <= chunk->max_y; y++)
+    {
+      Section *section = chunk->by_y[y - chunk->min_y];
+      if (section
+          && !func (y, section->indices,
+                    (NbtNode *const *)section->entries->pdata,
+                    section->entries->len, user_data))
+        return FALSE;
+    }
+  return TRUE;
+}
+
+static void
+section_commit (NbtChunk *chunk, Section *section)
+{
+  guint len = section->entries->len;
+  guint16 *remap = g_new0 (guint16, len);
+  gboolean *used = g_new0 (gboolean, len);
+  for (int i = 0; i < SECTION_BLOCKS; i++)
+    used[section->indices[i]] = TRUE;
+
+  /* Drop the unused entries, keeping the order of the others. The new ones
+   * come last, so they're appended in order */
+  guint n_used = 0;
+  for (guint i = 0; i < len; i++)
+    {
+      NbtNode *entry = g_ptr_array_index (section->entries, i);
+      if (!used[i])
+        {
+          g_node_unlink (entry);
+          nbt_node_free (entry);
+          continue;
+        }
+      if (i >= section->n_attached)
+        nbt_node_append (section->palette, entry);
+      remap[i] = n_used;
+      section->entries->pdata[n_used] = entry;
+      n_used++;
+    }
+  g_ptr_array_set_size (section->entries, n_used);
+  section->n_attached = n_used;
+  if (n_used < len)
+    for (int i = 0; i < SECTION_BLOCKS; i++)
+      section->indices[i] = remap[section->indices[i]];
+  g_free (remap);
+  g_free (used);
+
+  NbtNode *data = child_by_key (section->states, data_key (chunk));
+  if (n_used == 1 && !chunk->legacy)
+    {
+      /* A single state needs no data since 1.18 */
+      if (data)
+        {
+          g_node_unlink (data);
+          nbt_node_free (data);
+        }
+    }
+  else
+    {
+      if (!data)
+        {
+          data = nbt_node_new_long_array (data_key (chunk), NULL, 0);
+          nbt_node_append (section->states, data);
+        }
+      nbt_node_set_packed (data, section->indices, SECTION_BLOCKS,
+                           nbt_packed_bits_for (n_used, 4), chunk->layout);
+    }
+  section->dirty = FALSE;
+}
+
+void
+nbt_chunk_commit (NbtChunk *chunk)
+{
+  g_return_if_fail (chunk);
+  for (guint i = 0; i < chunk->sections->len; i++)
+    {
+      Section *section = g_ptr_array_index (chunk->sections, i);
+      if (section->dirty)
+        section_commit (chunk, section);
+    }
+}
@@ -0,0 +1,143 @@
+/*  nbt_chunk - Chunk view part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_CHUNK_H
+#define DHLRC_NBT_CHUNK_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The error domain of the chunk view.
+ * @sa NbtChunkError
+ */
+#define NBT_CHUNK_ERROR nbt_chunk_error_quark ()
+GQuark nbt_chunk_error_quark (void);
+
+/**
+ * @brief The error codes of the chunk view.
+ */
+typedef enum NbtChunkError
+{
+  /** The chunk has no sections, or a section is malformed */
+  NBT_CHUNK_ERROR_INVALID,
+} NbtChunkError;
+
+/**
+ * @brief A view of the blocks of a parsed chunk.
+ *
+ * The view decodes the block states of every section once and keeps the
+ * palettes resolved, so a block is found by its coordinates without
+ * walking the tree. Both the 1.18+ layout (`sections`, `block_states`) and
+ * the older one (`Level.Sections`, `Palette`, `BlockStates`) are read, the
+ * packing layout follows `DataVersion`.
+ *
+ * The view doesn't own the chunk, which must outlive it and must not be
+ * changed behind its back. The changed blocks are written back to the tree
+ * by `nbt_chunk_commit`.
+ */
+typedef struct NbtChunk NbtChunk;
+
+/**
+ * @brief Create the view of the chunk.
+ * @param chunk The compound of the chunk
+ * @param error Error code in `NBT_CHUNK_ERROR`, or NULL to ignore
+ * @return The view, or NULL when the chunk is malformed
+ */
+NbtChunk *nbt_chunk_new (NbtNode *chunk, GError **error);
+/**
+ * @brief Free the view, the uncommitted changes are lost.
+ */
+void nbt_chunk_free (NbtChunk *chunk);
+
+/**
+ * @brief Get the range of the section indexes, a section covers 16 blocks
+ * of height from `y * 16`.
+ * @param chunk The view
+ * @param min_y Filled with the lowest section index, or NULL
+ * @param max_y Filled with the highest section index, or NULL
+ */
+void nbt_chunk_get_section_range (NbtChunk *chunk, int *min_y, int *max_y);
+
+/**
+ * @brief Get the block state at the coordinates.
+ * @param chunk The view
+ * @param x The x in the chunk, from 0 to 15
+ * @param y The world height
+ * @param z The z in the chunk, from 0 to 15
+ * @return The compound of the palette entry, owned by the chunk, or NULL
+ * if there's no section there
+ */
+NbtNode *nbt_chunk_get_block (NbtChunk *chunk, int x, int y, int z);
+/**
+ * @brief Get the name of the block state at the coordinates, like
+ * `minecraft:stone`.
+ * @sa nbt_chunk_get_block
+ */
+const char *nbt_chunk_get_block_name (NbtChunk *chunk, int x, int y, int z);
+/**
+ * @brief Set the block state at the coordinates.
+ *
+ * The state is looked up in the palette of the section. A new one is kept
+ * by the view and only added to the palette by `nbt_chunk_commit`, the
+ * tree isn't changed before.
+ * @param chunk The view
+ * @param x The x in the chunk, from 0 to 15
+ * @param y The world height
+ * @param z The z in the chunk, from 0 to 15
+ * @param state The compound of the block state, which isn't consumed
+ * @return FALSE if there's no section there
+ */
+gboolean nbt_chunk_set_block (NbtChunk *chunk, int x, int y, int z,
+                              NbtNode *state);
+
+/**
+ * @brief The function called with every section.
+ * @param section_y The index of the section
+ * @param indices The 4096 palette indices of the blocks, the index of a
+ * block is `y << 8 | z << 4 | x` in the section
+ * @param palette The compounds of the palette entries
+ * @param palette_len The length of the palette
+ * @param user_data The user data
+ * @return FALSE to stop
+ */
+typedef gboolean (*NbtChunkSectionFunc) (int section_y,
+                                         const guint16 *indices,
+                                         NbtNode *const *palette,
+                                         guint palette_len,
+                                         gpointer user_data);
+/**
+ * @brief Iterate the sections from the lowest.
+ * @return FALSE if `func` stopped the iteration
+ */
+gboolean nbt_chunk_foreach_section (NbtChunk *chunk, NbtChunkSectionFunc func,
+                                    gpointer user_data);
+
+/**
+ * @brief Write the changed sections back to the chunk.
+ *
+ * The unused palette entries are removed and the indices are packed again
+ * with the fewest bits.
+ * @param chunk The view
+ */
+void nbt_chunk_commit (NbtChunk *chunk);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_CHUNK_H
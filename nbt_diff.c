@@ -0,0 +1,661 @@
+/*  nbt_diff - Diff and patch part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_diff.h"
+#include "nbt_hash.h"
+#include "nbt_private.h"
+#include "nbt_util.h"
+#include <string.h>
+
+#ifndef NBT_GLIB_DISABLE_TRANSLATION
+#include <libintl.h>
+#define _(text) gettext (text)
+#else
+#define _(text) text
+#endif
+
+/* Compounds with more children are matched with a hash table */
+#define DIFF_LINEAR_MAX 16
+
+/* How far the lists are searched for a matching element */
+#define DIFF_LOOKAHEAD 8
+
+GQuark
+nbt_diff_error_quark (void)
+{
+  static GQuark q;
+  if G_UNLIKELY (q == 0)
+    q = g_quark_from_static_string ("nbt-glib-diff-error-quark");
+  return q;
+}
+
+static void
+entry_free (gpointer data)
+{
+  NbtDiffEntry *entry = data;
+  g_free (entry->path);
+  nbt_node_free (entry->old_value);
+  nbt_node_free (entry->new_value);
+  g_free (entry);
+}
+
+static const char *
+node_key (NbtNode *node)
+{
+  const char *key = ((NbtData *)node->data)->key;
+  return key ? key : "";
+}
+
+static NBT_Tags
+node_type (NbtNode *node)
+{
+  return ((NbtData *)node->data)->type;
+}
+
+/* Paths */
+
+static gboolean
+is_bare_key_char (char c)
+{
+  return g_ascii_isalnum (c) || c == '_' || c == '-' || c == '+';
+}
+
+static void
+path_append_key (GString *path, const char *key)
+{
+  if (path->len)
+    g_string_append_c (path, '.');
+  const char *p = key;
+  while (is_bare_key_char (*p))
+    p++;
+  if (*key && !*p)
+    {
+      g_string_append (path, key);
+      return;
+    }
+  g_string_append_c (path, '"');
+  for (p = key; *p; p++)
+    {
+      if (*p == '"' || *p == '\\')
+        g_string_append_c (path, '\\');
+      g_string_append_c (path, *p);
+    }
+  g_string_append_c (path, '"');
+}
+
+static void
+path_append_index (GString *path, guint index)
+{
+  g_string_append_printf (path, "[%u]", index);
+}
+
+const char *
+nbt_path_parse_segment (const char *p, gboolean first, GString *key,
+                        gint64 *index)
+{
+  g_string_truncate (key, 0);
+  *index = -1;
+  if (*p == '[')
+    {
+      char *end = NULL;
+      p++;
+      if (!g_ascii_isdigit (*p))
+        return NULL;
+      guint64 value = g_ascii_strtoull (p, &end, 10);
+      if (*end != ']' || value > G_MAXINT32)
+        return NULL;
+      *index = value;
+      return end + 1;
+    }
+  if (!first && *p++ != '.')
+    return NULL;
+  if (*p == '"')
+    {
+      for (p++; *p != '"'; p++)
+        {
+          if (*p == '\\')
+            p++;
+          if (!*p)
+            return NULL;
+          g_string_append_c (key, *p);
+        }
+      return p + 1;
+    }
+  const char *start = p;
+  while (is_bare_key_char (*p))
+    p++;
+  if (p == start)
+    return NULL;
+  g_string_append_len (key, start, p - start);
+  return p;
+}
+
+static NbtNode *
+find_child (NbtNode *node, const char *key)
+{
+  for (NbtNode *child = node->children; child; child = child->next)
+    if (g_str_equal (node_key (child), key))
+      return child;
+  return NULL;
+}
+
+/* An element of a packed list has no node in the tree, it's given as the
+ * node of `element` */
+static NbtNode *
+step (NbtNode *node, const char *key, gint64 index, NbtListIter *element)
+{
+  if (index >= 0)
+    {
+      if (node_type (node) != TAG_List || index >= nbt_list_length (node))
+        return NULL;
+      if (!nbt_data_is_packed_list (node->data))
+        return g_node_nth_child (node, index);
+      nbt_list_iter_init (element, node);
+      element->index = index;
+      return nbt_list_iter_next (element);
+    }
+  return node_type (node) == TAG_Compound ? find_child (node, key) : NULL;
+}
+
+/* Walk the path but its last segment, which is left in `key` or `index`.
+ * `parent` is the node the last segment is looked up in, or NULL for the
+ * empty path */
+static gboolean
+walk_path (NbtNode *root, const char *path, NbtNode **parent, GString *key,
+           gint64 *index, NbtListIter *element)
+{
+  NbtNode *node = root;
+  gboolean has_segment = FALSE;
+  const char *p = path;
+  while (*p)
+    {
+      if (has_segment
+          && !(node = step (node, key->str, *index, element)))
+        return FALSE;
+      p = nbt_path_parse_segment (p, !has_segment, key, index);
+      if (!p)
+        return FALSE;
+      has_segment = TRUE;
+    }
+  *parent = has_segment ? node : NULL;
+  return TRUE;
+}
+
+NbtNode *
+nbt_node_lookup_path (NbtNode *root, const char *path)
+{
+  g_return_val_if_fail (root && path, NULL);
+  GString *key = g_string_new (NULL);
+  gint64 index;
+  NbtNode *parent;
+  NbtNode *node = NULL;
+  NbtListIter element;
+  if (walk_path (root, path, &parent, key, &index, &element))
+    node = parent ? step (parent, key->str, index, &element) : root;
+  g_string_free (key, TRUE);
+  /* The caller gets its own node for an element of a packed list */
+  return node == &element.node ? nbt_node_dup (node) : node;
+}
+
+/* Diff */
+
+typedef struct Differ
+{
+  GPtrArray *entries;
+  NbtHashCache *cache_a;
+  NbtHashCache *cache_b;
+  GString *path;
+} Differ;
+
+static void
+add_entry (Differ *differ, NbtDiffOp op, NbtNode *old_value,
+           NbtNode *new_value)
+{
+  NbtDiffEntry *entry = g_new (NbtDiffEntry, 1);
+  entry->op = op;
+  entry->path = g_strndup (differ->path->str, differ->path->len);
+  entry->old_value = old_value ? nbt_node_dup (old_value) : NULL;
+  entry->new_value = new_value ? nbt_node_dup (new_value) : NULL;
+  g_ptr_array_add (differ->entries, entry);
+}
+
+static gboolean
+same_subtree (Differ *differ, NbtNode *a, NbtNode *b)
+{
+  NBT_Tags type = node_type (a);
+  if (type != node_type (b))
+    return FALSE;
+  if (type != TAG_List && type != TAG_Compound)
+    return nbt_node_equal (a, b);
+  /* The hashes of the containers are cached, so every subtree is hashed
+   * once however deep the differences are */
+  NbtHash ha, hb;
+  nbt_node_hash_full (a, differ->cache_a, &ha);
+  nbt_node_hash_full (b, differ->cache_b, &hb);
+  return ha.low == hb.low && ha.high == hb.high;
+}
+
+static void diff_node (Differ *differ, NbtNode *a, NbtNode *b);
+
+static GHashTable *
+index_children (NbtNode *node)
+{
+  if (g_node_n_children (node) <= DIFF_LINEAR_MAX)
+    return NULL;
+  GHashTable *table = g_hash_table_new (g_str_hash, g_str_equal);
+  for (NbtNode *child = node->children; child; child = child->next)
+    g_hash_table_insert (table, (gpointer)node_key (child), child);
+  return table;
+}
+
+static NbtNode *
+lookup_child (NbtNode *node, GHashTable *table, const char *key)
+{
+  return table ? g_hash_table_lookup (table, key) : find_child (node, key);
+}
+
+static void
+diff_compound (Differ *differ, NbtNode *a, NbtNode *b)
+{
+  gsize len = differ->path->len;
+  GHashTable *table_a = index_children (a);
+  GHashTable *table_b = index_children (b);
+  for (NbtNode *child = a->children; child; child = child->next)
+    {
+      NbtNode *other = lookup_child (b, table_b, node_key (child));
+      path_append_key (differ->path, node_key (child));
+      if (other)
+        diff_node (differ, child, other);
+      else
+        add_entry (differ, NBT_DIFF_REMOVE, child, NULL);
+      g_string_truncate (differ->path, len);
+    }
+  for (NbtNode *child = b->children; child; child = child->next)
+    if (!lookup_child (a, table_a, node_key (child)))
+      {
+        path_append_key (differ->path, node_key (child));
+        add_entry (differ, NBT_DIFF_ADD, NULL, child);
+        g_string_truncate (differ->path, len);
+      }
+  if (table_a)
+    g_hash_table_destroy (table_a);
+  if (table_b)
+    g_hash_table_destroy (table_b);
+}
+
+/* Find the first node of the next `DIFF_LOOKAHEAD` nodes from `from` which
+ * is the same as `node`, and count the nodes before it */
+static gboolean
+look_ahead (Differ *differ, NbtNode *from, NbtNode *node, guint left,
+            guint *skipped)
+{
+  for (guint i = 0; i < MIN (left, DIFF_LOOKAHEAD) && from;
+       i++, from = from->next)
+    if (same_subtree (differ, from, node))
+      {
+        *skipped = i;
+        return TRUE;
+      }
+  return FALSE;
+}
+
+static void
+emit_at (Differ *differ, NbtDiffOp op, guint index, NbtNode *old_value,
+         NbtNode *new_value)
+{
+  gsize len = differ->path->len;
+  path_append_index (differ->path, index);
+  if (op == NBT_DIFF_CHANGE)
+    diff_node (differ, old_value, new_value);
+  else
+    add_entry (differ, op, old_value, new_value);
+  g_string_truncate (differ->path, len);
+}
+
+/* A run of the elements of a list, linked as siblings */
+typedef struct Elements
+{
+  NbtNode *first;
+  NbtNode *last;
+  guint len;
+  /** The temporary nodes of the numbers of a packed list, or NULL */
+  NbtListIter *packed;
+} Elements;
+
+static NBT_Tags
+element_type (NbtNode *list)
+{
+  if (nbt_data_is_packed_list (list->data))
+    return nbt_data_list_type (list->data);
+  return list->children ? node_type (list->children) : TAG_End;
+}
+
+/* The elements of the list from `start` to `end`. A list of nodes is taken
+ * whole, a packed list has no child nodes and its numbers in the run are
+ * read into temporary nodes, so the list isn't changed */
+static void
+elements_init (Elements *elements, NbtNode *list, guint start, guint end)
+{
+  elements->packed = NULL;
+  if (!nbt_data_is_packed_list (list->data))
+    {
+      elements->first = list->children;
+      elements->last = g_node_last_child (list);
+      elements->len = g_node_n_children (list);
+      return;
+    }
+  elements->len = end - start;
+  elements->first = elements->last = NULL;
+  if (!elements->len)
+    return;
+  NbtListIter *packed = g_new (NbtListIter, elements->len);
+  for (guint i = 0; i < elements->len; i++)
+    {
+      NbtListIter *element = &packed[i];
+      nbt_list_iter_init (element, list);
+      element->index = start + i;
+      NbtNode *node = nbt_list_iter_next (element);
+      node->prev = elements->last;
+      if (elements->last)
+        elements->last->next = node;
+      else
+        elements->first = node;
+      elements->last = node;
+    }
+  elements->packed = packed;
+}
+
+/* The common beginning and end of the lists are skipped, by their spans
+ * when both are packed. The middle parts are walked together: a short run
+ * of elements only found in one of them is added or removed, other
+ * elements are compared in place. The index `pos` is the one in the list
+ * with the previous edits applied */
+static void
+diff_list (Differ *differ, NbtNode *a, NbtNode *b)
+{
+  guint na = nbt_list_length (a);
+  guint nb = nbt_list_length (b);
+  if (na && nb && element_type (a) != element_type (b))
+    {
+      add_entry (differ, NBT_DIFF_CHANGE, a, b);
+      return;
+    }
+
+  guint pos = 0;
+  guint suffix = 0;
+  const NbtData *da = a->data;
+  const NbtData *db = b->data;
+  if (na && nb && nbt_data_is_packed_list (da)
+      && nbt_data_is_packed_list (db))
+    {
+      gsize size = nbt_reader_scalar_size (nbt_data_list_type (da));
+      const guint8 *va = da->value_a.value;
+      const guint8 *vb = db->value_a.value;
+      while (pos < na && pos < nb
+             && memcmp (va + pos * size, vb + pos * size, size) == 0)
+        pos++;
+      while (suffix < na - pos && suffix < nb - pos
+             && memcmp (va + (na - 1 - suffix) * size,
+                        vb + (nb - 1 - suffix) * size, size)
+                    == 0)
+        suffix++;
+    }
+  Elements ea;
+  Elements eb;
+  elements_init (&ea, a, pos, na - suffix);
+  elements_init (&eb, b, pos, nb - suffix);
+
+  NbtNode *ca = ea.first;
+  NbtNode *cb = eb.first;
+  guint ma = ea.len;
+  guint mb = eb.len;
+  while (ma && mb && same_subtree (differ, ca, cb))
+    {
+      ca = ca->next;
+      cb = cb->next;
+      ma--;
+      mb--;
+      pos++;
+    }
+  NbtNode *la = ea.last;
+  NbtNode *lb = eb.last;
+  while (ma && mb && same_subtree (differ, la, lb))
+    {
+      la = la->prev;
+      lb = lb->prev;
+      ma--;
+      mb--;
+    }
+
+  while (ma && mb)
+    {
+      guint inserted = 0;
+      guint removed = 0;
+      gboolean insertion = look_ahead (differ, cb->next, ca, mb - 1,
+                                       &inserted);
+      gboolean removal = look_ahead (differ, ca->next, cb, ma - 1, &removed);
+      if (same_subtree (differ, ca, cb))
+        insertion = removal = FALSE;
+      if (insertion && (!removal || inserted <= removed))
+        for (guint i = 0; i <= inserted; i++, cb = cb->next, mb--)
+          emit_at (differ, NBT_DIFF_ADD, pos++, NULL, cb);
+      else if (removal)
+        for (guint i = 0; i <= removed; i++, ca = ca->next, ma--)
+          emit_at (differ, NBT_DIFF_REMOVE, pos, ca, NULL);
+      else
+        {
+          emit_at (differ, NBT_DIFF_CHANGE, pos++, ca, cb);
+          ca = ca->next;
+          cb = cb->next;
+          ma--;
+          mb--;
+        }
+    }
+  for (; ma; ma--, ca = ca->next)
+    emit_at (differ, NBT_DIFF_REMOVE, pos, ca, NULL);
+  for (; mb; mb--, cb = cb->next)
+    emit_at (differ, NBT_DIFF_ADD, pos++, NULL, cb);
+  g_free (ea.packed);
+  g_free (eb.packed);
+}
+
+static void
+diff_node (Differ *differ, NbtNode *a, NbtNode *b)
+{
+  if (same_subtree (differ, a, b))
+    return;
+  NBT_Tags type = node_type (a);
+  if (type == node_type (b) && type == TAG_Compound)
+    diff_compound (differ, a, b);
+  else if (type == node_type (b) && type == TAG_List)
+    diff_list (differ, a, b);
+  else
+    add_entry (differ, NBT_DIFF_CHANGE, a, b);
+}
+
+GPtrArray *
+nbt_node_diff (NbtNode *a, NbtNode *b)
+{
+  g_return_val_if_fail (a && b, NULL);
+  Differ differ;
+  differ.entries = g_ptr_array_new_with_free_func (entry_free);
+  differ.cache_a = nbt_hash_cache_new ();
+  differ.cache_b = nbt_hash_cache_new ();
+  differ.path = g_string_new (NULL);
+  diff_node (&differ, a, b);
+  nbt_hash_cache_free (differ.cache_a);
+  nbt_hash_cache_free (differ.cache_b);
+  g_string_free (differ.path, TRUE);
+  return differ.entries;
+}
+
+GPtrArray *
+nbt_diff_invert (GPtrArray *diff)
+{
+  g_return_val_if_fail (diff, NULL);
+  GPtrArray *inverted
+      = g_ptr_array_new_full (diff->len, entry_free);
+  for (guint i = diff->len; i > 0; i--)
+    {
+      NbtDiffEntry *entry = g_ptr_array_index (diff, i - 1);
+      NbtDiffEntry *new_entry = g_new (NbtDiffEntry, 1);
+      new_entry->op = entry->op == NBT_DIFF_ADD      ? NBT_DIFF_REMOVE
+                      : entry->op == NBT_DIFF_REMOVE ? NBT_DIFF_ADD
+                                                     : NBT_DIFF_CHANGE;
+      new_entry->path = g_strdup (entry->path);
+      new_entry->old_value
+          = entry->new_value ? nbt_node_dup (entry->new_value) : NULL;
+      new_entry->new_value
+          = entry->old_value ? nbt_node_dup (entry->old_value) : NULL;
+      g_ptr_array_add (inverted, new_entry);
+    }
+  return inverted;
+}
+
+/* Patch */
+
+/* Replace the tag, the value and the children of the node by a copy of
+ * `value`, keeping the node itself and its key */
+static void
+replace_node (NbtNode *node, NbtNode *value)
+{
+  NbtNode *copy = nbt_node_dup (value);
+  NbtData *old_data = node->data;
+  NbtData *new_data = copy->data;
+  nbt_data_free_key (new_data);
+  /* The inline key stays with its data */
+  if (old_data->flags & NBT_DATA_INLINE_KEY)
+    new_data->key = g_strdup (old_data->key);
+  else
+    {
+      new_data->key = old_data->key;
+      new_data->flags |= old_data->flags & NBT_DATA_SHARED_KEY;
+      old_data->key = NULL;
+      old_data->flags &= ~NBT_DATA_SHARED_KEY;
+    }
+  /* The nodes keep their own allocations */
+  new_data->flags |= old_data->flags & NBT_DATA_NODE_MASK;
+  old_data->flags &= ~NBT_DATA_NODE_MASK;
+  node->data = new_data;
+  copy->data = old_data;
+
+  NbtNode *children = node->children;
+  node->children = copy->children;
+  copy->children = children;
+  for (NbtNode *child = node->children; child; child = child->next)
+    child->parent = node;
+  for (NbtNode *child = copy->children; child; child = child->next)
+    child->parent = copy;
+  nbt_node_free (copy);
+}
+
+static gboolean
+patch_entry (NbtNode *root, NbtDiffEntry *entry, GString *key,
+             GError **error)
+{
+  NbtNode *parent;
+  gint64 index;
+  NbtListIter element;
+  if (!walk_path (root, entry->path, &parent, key, &index, &element)
+      || (parent && node_type (parent) != (index >= 0 ? TAG_List
+                                                       : TAG_Compound)))
+    {
+      g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_INVALID_PATH,
+                   _ ("Invalid path \"%s\"."), entry->path);
+      return FALSE;
+    }
+  /* The patched list needs nodes for its elements */
+  if (parent && index >= 0)
+    nbt_node_unpack_list (parent);
+  NbtNode *target = parent ? step (parent, key->str, index, &element) : root;
+  NbtNode *expected
+      = entry->op == NBT_DIFF_ADD ? entry->new_value : entry->old_value;
+  if (!expected || (entry->op == NBT_DIFF_CHANGE && !entry->new_value))
+    {
+      g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_CONFLICT,
+                   _ ("The entry at \"%s\" has no value."), entry->path);
+      return FALSE;
+    }
+
+  if (entry->op == NBT_DIFF_ADD)
+    {
+      gboolean ok = parent != NULL;
+      if (ok && index >= 0)
+        ok = index <= g_node_n_children (parent)
+             && (!parent->children
+                 || node_type (parent->children) == node_type (expected));
+      else if (ok)
+        ok = target == NULL;
+      if (!ok)
+        {
+          g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_CONFLICT,
+                       _ ("Can't add the value at \"%s\"."), entry->path);
+          return FALSE;
+        }
+      NbtNode *node = nbt_node_dup (expected);
+      NbtData *data = node->data;
+      nbt_data_free_key (data);
+      data->key = index >= 0 ? NULL : g_strdup (key->str);
+      g_node_insert (parent, index >= 0 ? (gint)index : -1, node);
+      return TRUE;
+    }
+
+  if (!target || !nbt_node_equal (target, expected))
+    {
+      g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_CONFLICT,
+                   _ ("The value at \"%s\" doesn't match the old value."),
+                   entry->path);
+      return FALSE;
+    }
+  if (entry->op == NBT_DIFF_CHANGE)
+    {
+      if (index >= 0 && parent->children->next
+          && node_type (entry->new_value) != node_type (target))
+        {
+          g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_CONFLICT,
+                       _ ("Can't change the type of the element at \"%s\"."),
+                       entry->path);
+          return FALSE;
+        }
+      replace_node (target, entry->new_value);
+    }
+  else if (parent)
+    {
+      g_node_unlink (target);
+      nbt_node_free (target);
+    }
+  else
+    {
+      g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_INVALID_PATH,
+                   _ ("The root can't be removed."));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+gboolean
+nbt_node_patch (NbtNode *root, GPtrArray *diff, GError **error)
+{
+  g_return_val_if_fail (root && diff, FALSE);
+  GString *key = g_string_new (NULL);
+  gboolean ok = TRUE;
+  for (guint i = 0; i < diff->len && ok; i++)
+    ok = patch_entry (root, g_ptr_array_index (diff, i), key, error);
+  g_string_free (key, TRUE);
+  return ok;
+}
@@ -0,0 +1,121 @@
+/*  nbt_diff - Diff and patch part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_DIFF_H
+#define DHLRC_NBT_DIFF_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The error domain of the patch error.
+ * @sa NbtDiffError
+ */
+#define NBT_DIFF_ERROR nbt_diff_error_quark ()
+GQuark nbt_diff_error_quark (void);
+
+/**
+ * @brief The error code of the patch error.
+ */
+typedef enum
+{
+  /** The path is malformed or doesn't lead to a node */
+  NBT_DIFF_ERROR_INVALID_PATH,
+  /** The tree doesn't have the old value the entry expects */
+  NBT_DIFF_ERROR_CONFLICT,
+} NbtDiffError;
+
+/**
+ * @brief The kind of an edit.
+ */
+typedef enum NbtDiffOp
+{
+  /** `new_value` is inserted at the path */
+  NBT_DIFF_ADD,
+  /** `old_value` at the path is removed */
+  NBT_DIFF_REMOVE,
+  /** `old_value` at the path is replaced by `new_value` */
+  NBT_DIFF_CHANGE,
+} NbtDiffOp;
+
+/**
+ * @brief An edit of the edit script.
+ *
+ * The path is made of the keys of the compounds separated by `.` and the
+ * indexes of the lists in brackets, like `sections[3].biomes."a.b"`. The
+ * keys which aren't made of `[0-9A-Za-z_+-]` are quoted. The empty path is
+ * the root.
+ */
+typedef struct NbtDiffEntry
+{
+  NbtDiffOp op;
+  char *path;
+  /** The copy of the old subtree, NULL for `NBT_DIFF_ADD` */
+  NbtNode *old_value;
+  /** The copy of the new subtree, NULL for `NBT_DIFF_REMOVE` */
+  NbtNode *new_value;
+} NbtDiffEntry;
+
+/**
+ * @brief Compute the edit script which turns `a` into `b`.
+ *
+ * The identical subtrees are skipped by their structural hashes, the
+ * children of the compounds are matched by their keys and the common
+ * beginning and end of the lists are skipped, so an insertion in a long
+ * list is a single edit. The indexes of the entries refer to the tree
+ * with the previous entries applied. Neither tree is changed, the packed
+ * lists of numbers are compared in place.
+ * @param a The old tree
+ * @param b The new tree
+ * @return The array of `NbtDiffEntry`, empty if the trees are equal, to be
+ * freed by `g_ptr_array_unref`
+ */
+GPtrArray *nbt_node_diff (NbtNode *a, NbtNode *b);
+/**
+ * @brief Apply the edit script to the tree in order.
+ *
+ * Every entry checks the old value before changing the tree. When an entry
+ * fails, the previous entries are kept applied.
+ * @param root The tree to change
+ * @param diff The array of `NbtDiffEntry` from `nbt_node_diff`
+ * @param error Error code, or NULL to ignore
+ * @return TRUE if every entry is applied
+ */
+gboolean nbt_node_patch (NbtNode *root, GPtrArray *diff, GError **error);
+/**
+ * @brief Build the edit script which undoes `diff`.
+ * @param diff The array of `NbtDiffEntry`
+ * @return The inverted array, to be freed by `g_ptr_array_unref`
+ */
+GPtrArray *nbt_diff_invert (GPtrArray *diff);
+/**
+ * @brief Find the node at the path, in the syntax of `NbtDiffEntry`.
+ *
+ * The tree isn't changed. An element of a packed list of numbers has no
+ * node in the tree, it's returned as a new node without a parent.
+ * @param root The root of the tree
+ * @param path The path
+ * @return The node, or NULL if the path is malformed or not found. The
+ * node of a packed element is to be freed by `nbt_node_free`
+ */
+NbtNode *nbt_node_lookup_path (NbtNode *root, const char *path);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_DIFF_H
@@ -0,0 +1,394 @@
+/*  nbt_format - Number formatting part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_private.h"
+
+#include <math.h>
+#include <string.h>
+
+static const char digit_pairs[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+int
+nbt_format_int64 (char *buf, gint64 value)
+{
+  char tmp[20];
+  char *p = tmp + sizeof (tmp);
+  char *out = buf;
+  /* Negate as unsigned so G_MININT64 works */
+  guint64 u = value < 0 ? -(guint64)value : (guint64)value;
+  if (value < 0)
+    *out++ = '-';
+  while (u >= 100)
+    {
+      guint64 pair = u % 100;
+      u /= 100;
+      p -= 2;
+      memcpy (p, digit_pairs + pair * 2, 2);
+    }
+  if (u >= 10)
+    {
+      p -= 2;
+      memcpy (p, digit_pairs + u * 2, 2);
+    }
+  else
+    *--p = '0' + u;
+  int len = tmp + sizeof (tmp) - p;
+  memcpy (out, p, len);
+  out += len;
+  *out = '\0';
+  return out - buf;
+}
+
+static int
+format_special (char *buf, double value)
+{
+  const char *str = isnan (value) ? "NaN"
+                    : value > 0   ? "Infinity"
+                                  : "-Infinity";
+  strcpy (buf, str);
+  return strlen (str);
+}
+
+/* Integers are the most common floating values, and don't need to go
+ * through the printf machinery */
+static int
+format_integral (char *buf, double value)
+{
+  int len;
+  if (value == 0 && signbit (value))
+    {
+      buf[0] = '-';
+      buf[1] = '0';
+      len = 2;
+    }
+  else
+    len = nbt_format_int64 (buf, (gint64)value);
+  memcpy (buf + len, ".0", 3);
+  return len + 2;
+}
+
+/* The shortest digits are found with Grisu2 (Florian Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", 2010). It
+ * only uses 64-bit integers, and its output always reads back as the same
+ * value. In rare cases the output is one digit longer than the shortest. */
+
+typedef struct DiyFp
+{
+  guint64 f;
+  int e;
+} DiyFp;
+
+/* The normalized 10^k for k = -348, -340, ..., 340 */
+static const guint64 cached_powers_f[] = {
+  0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76,
+  0xcf42894a5dce35ea, 0x9a6bb0aa55653b2d, 0xe61acf033d1a45df,
+  0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f, 0xbe5691ef416bd60c,
+  0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+  0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57,
+  0xc21094364dfb5637, 0x9096ea6f3848984f, 0xd77485cb25823ac7,
+  0xa086cfcd97bf97f4, 0xef340a98172aace5, 0xb23867fb2a35b28e,
+  0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+  0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126,
+  0xb5b5ada8aaff80b8, 0x87625f056c7c4a8b, 0xc9bcff6034c13053,
+  0x964e858c91ba2655, 0xdff9772470297ebd, 0xa6dfbd9fb8e5b88f,
+  0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+  0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06,
+  0xaa242499697392d3, 0xfd87b5f28300ca0e, 0xbce5086492111aeb,
+  0x8cbccc096f5088cc, 0xd1b71758e219652c, 0x9c40000000000000,
+  0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+  0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068,
+  0x9f4f2726179a2245, 0xed63a231d4c4fb27, 0xb0de65388cc8ada8,
+  0x83c7088e1aab65db, 0xc45d1df942711d9a, 0x924d692ca61be758,
+  0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+  0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d,
+  0x952ab45cfa97a0b3, 0xde469fbd99a05fe3, 0xa59bc234db398c25,
+  0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece, 0x88fcf317f22241e2,
+  0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+  0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410,
+  0x8bab8eefb6409c1a, 0xd01fef10a657842c, 0x9b10a4e5e9913129,
+  0xe7109bfba19c0c9d, 0xac2820d9623bf429, 0x80444b5e7aa7cf85,
+  0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+  0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b,
+};
+
+static const gint16 cached_powers_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+  -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635,
+  -608, -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316,
+  -289, -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30, 56,
+  83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455,
+  481, 508, 534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853,
+  880, 907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const guint32 pow10_32[]
+    = { 1,      10,      100,      1000,      10000,
+        100000, 1000000, 10000000, 100000000, 1000000000 };
+
+static DiyFp
+diy_fp_multiply (DiyFp x, DiyFp y)
+{
+  guint64 a = x.f >> 32, b = x.f & 0xffffffff;
+  guint64 c = y.f >> 32, d = y.f & 0xffffffff;
+  guint64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  /* Round the lower half */
+  guint64 tmp = (bd >> 32) + (ad & 0xffffffff) + (bc & 0xffffffff)
+                + (G_GUINT64_CONSTANT (1) << 31);
+  DiyFp r = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+  return r;
+}
+
+static DiyFp
+diy_fp_normalize (DiyFp x)
+{
+  while (!(x.f & G_GUINT64_CONSTANT (0xff00000000000000)))
+    {
+      x.f <<= 8;
+      x.e -= 8;
+    }
+  while (!(x.f & G_GUINT64_CONSTANT (0x8000000000000000)))
+    {
+      x.f <<= 1;
+      x.e--;
+    }
+  return x;
+}
+
+static void
+grisu_round (char *digits, int len, guint64 delta, guint64 rest,
+             guint64 ten_kappa, guint64 wp_w)
+{
+  while (rest < wp_w && delta - rest >= ten_kappa
+         && (rest + ten_kappa < wp_w
+             || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+      digits[len - 1]--;
+      rest += ten_kappa;
+    }
+}
+
+static int
+grisu_digits (DiyFp w, DiyFp mp, guint64 delta, char *digits, int *k)
+{
+  int shift = -mp.e;
+  guint64 one = G_GUINT64_CONSTANT (1) << shift;
+  guint64 wp_w = mp.f - w.f;
+  guint32 p1 = mp.f >> shift;
+  guint64 p2 = mp.f & (one - 1);
+  int len = 0;
+  int kappa = 1;
+  while (kappa < 10 && p1 >= pow10_32[kappa])
+    kappa++;
+
+  /* The integral part */
+  while (kappa > 0)
+    {
+      guint32 d = p1 / pow10_32[kappa - 1];
+      p1 %= pow10_32[kappa - 1];
+      if (d || len)
+        digits[len++] = '0' + d;
+      kappa--;
+      guint64 rest = ((guint64)p1 << shift) + p2;
+      if (rest <= delta)
+        {
+          *k += kappa;
+          grisu_round (digits, len, delta, rest,
+                       (guint64)pow10_32[kappa] << shift, wp_w);
+          return len;
+        }
+    }
+
+  /* The fractional part */
+  guint64 unit = 1;
+  for (;;)
+    {
+      p2 *= 10;
+      delta *= 10;
+      unit *= 10;
+      char d = p2 >> shift;
+      if (d || len)
+        digits[len++] = '0' + d;
+      p2 &= one - 1;
+      kappa--;
+      if (p2 < delta)
+        {
+          *k += kappa;
+          grisu_round (digits, len, delta, p2, one, wp_w * unit);
+          return len;
+        }
+    }
+}
+
+/* `f * 2^e` is the positive value, `lower_closer` tells whether the
+ * previous value is closer than the next one. Return the number of the
+ * digits, the value is `digits * 10^k`. */
+static int
+grisu2 (guint64 f, int e, gboolean lower_closer, char *digits, int *k)
+{
+  DiyFp v = { f, e };
+  DiyFp plus = diy_fp_normalize ((DiyFp){ (f << 1) + 1, e - 1 });
+  DiyFp minus = lower_closer ? (DiyFp){ (f << 2) - 1, e - 2 }
+                             : (DiyFp){ (f << 1) - 1, e - 1 };
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  /* Find the cached power which brings the exponent to [-60, -32] */
+  double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+  int ik = (int)dk;
+  if (dk - ik > 0.0)
+    ik++;
+  int index = (ik >> 3) + 1;
+  *k = 348 - index * 8;
+  DiyFp c_mk = { cached_powers_f[index], cached_powers_e[index] };
+
+  DiyFp w = diy_fp_multiply (diy_fp_normalize (v), c_mk);
+  DiyFp wp = diy_fp_multiply (plus, c_mk);
+  DiyFp wm = diy_fp_multiply (minus, c_mk);
+  wm.f++;
+  wp.f--;
+  return grisu_digits (w, wp, wp.f - wm.f, digits, k);
+}
+
+/* Write `digits * 10^k` as a fixed number when it's not too big or small,
+ * and with an exponent otherwise */
+static int
+format_digits (char *buf, const char *digits, int len, int k)
+{
+  char *p = buf;
+  int point = len + k;
+  if (point > 0 && point <= 17)
+    {
+      if (point >= len)
+        {
+          memcpy (p, digits, len);
+          p += len;
+          memset (p, '0', point - len);
+          p += point - len;
+          memcpy (p, ".0", 2);
+          p += 2;
+        }
+      else
+        {
+          memcpy (p, digits, point);
+          p += point;
+          *p++ = '.';
+          memcpy (p, digits + point, len - point);
+          p += len - point;
+        }
+    }
+  else if (point <= 0 && point > -4)
+    {
+      memcpy (p, "0.", 2);
+      p += 2;
+      memset (p, '0', -point);
+      p += -point;
+      memcpy (p, digits, len);
+      p += len;
+    }
+  else
+    {
+      int exponent = point - 1;
+      *p++ = digits[0];
+      if (len > 1)
+        {
+          *p++ = '.';
+          memcpy (p, digits + 1, len - 1);
+          p += len - 1;
+        }
+      *p++ = 'e';
+      *p++ = exponent < 0 ? '-' : '+';
+      exponent = ABS (exponent);
+      if (exponent >= 100)
+        {
+          *p++ = '0' + exponent / 100;
+          exponent %= 100;
+        }
+      memcpy (p, digit_pairs + exponent * 2, 2);
+      p += 2;
+    }
+  *p = '\0';
+  return p - buf;
+}
+
+int
+nbt_format_double (char *buf, double value)
+{
+  if (!isfinite (value))
+    return format_special (buf, value);
+  if (value == floor (value) && fabs (value) < 1e15)
+    return format_integral (buf, value);
+
+  guint64 bits;
+  memcpy (&bits, &value, sizeof (bits));
+  char *p = buf;
+  if (bits >> 63)
+    *p++ = '-';
+  int biased = (bits >> 52) & 0x7ff;
+  guint64 f = bits & G_GUINT64_CONSTANT (0xfffffffffffff);
+  int e;
+  if (biased)
+    {
+      f |= G_GUINT64_CONSTANT (1) << 52;
+      e = biased - 1075;
+    }
+  else
+    e = -1074;
+  char digits[20];
+  int k;
+  int len = grisu2 (f, e, biased > 1 && f == G_GUINT64_CONSTANT (1) << 52,
+                    digits, &k);
+  return p - buf + format_digits (p, digits, len, k);
+}
+
+int
+nbt_format_float (char *buf, float value)
+{
+  if (!isfinite (value))
+    return format_special (buf, value);
+  if (value == floorf (value) && fabsf (value) < 16777216.0f)
+    return format_integral (buf, value);
+
+  guint32 bits;
+  memcpy (&bits, &value, sizeof (bits));
+  char *p = buf;
+  if (bits >> 31)
+    *p++ = '-';
+  int biased = (bits >> 23) & 0xff;
+  guint64 f = bits & 0x7fffff;
+  int e;
+  if (biased)
+    {
+      f |= 1 << 23;
+      e = biased - 150;
+    }
+  else
+    e = -149;
+  char digits[20];
+  int k;
+  int len = grisu2 (f, e, biased > 1 && f == 1 << 23, digits, &k);
+  return p - buf + format_digits (p, digits, len, k);
+}
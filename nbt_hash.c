@@ -0,0 +1,414 @@
+/*  nbt_hash - Structural hash part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_hash.h"
+#include "nbt_private.h"
+#include <string.h>
+
+/* The primes of xxHash64, the bulk loop is its four-lane round */
+#define PRIME1 G_GUINT64_CONSTANT (0x9E3779B185EBCA87)
+#define PRIME2 G_GUINT64_CONSTANT (0xC2B2AE3D27D4EB4F)
+#define PRIME3 G_GUINT64_CONSTANT (0x165667B19E3779F9)
+#define PRIME4 G_GUINT64_CONSTANT (0x85EBCA77C2B2AE63)
+#define PRIME5 G_GUINT64_CONSTANT (0x27D4EB2F165667C5)
+
+/* Compounds with more children are matched with a hash table */
+#define EQUAL_LINEAR_MAX 16
+
+struct NbtHashCache
+{
+  GHashTable *table;
+};
+
+static inline guint64
+rotl64 (guint64 x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline guint64
+fmix64 (guint64 k)
+{
+  k ^= k >> 33;
+  k *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+  k ^= k >> 33;
+  k *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+  k ^= k >> 33;
+  return k;
+}
+
+static inline guint64
+read64 (const guint8 *p)
+{
+  guint64 value;
+  memcpy (&value, p, sizeof (value));
+  return GUINT64_FROM_LE (value);
+}
+
+static inline guint64
+hash_round (guint64 acc, guint64 input)
+{
+  return rotl64 (acc + input * PRIME2, 31) * PRIME1;
+}
+
+/* Hash the bytes into 128 bits, the bytes are read as little-endian words
+ * so the result doesn't depend on the machine */
+static NbtHash
+hash_bytes (const void *data, gsize len, guint64 seed)
+{
+  const guint8 *p = data;
+  const guint8 *end = p + len;
+  guint64 v[4] = { seed + PRIME1 + PRIME2, seed + PRIME2, seed,
+                   seed - PRIME1 };
+  while (end - p >= 32)
+    {
+      v[0] = hash_round (v[0], read64 (p));
+      v[1] = hash_round (v[1], read64 (p + 8));
+      v[2] = hash_round (v[2], read64 (p + 16));
+      v[3] = hash_round (v[3], read64 (p + 24));
+      p += 32;
+    }
+  int lane = 0;
+  for (; end - p >= 8; p += 8, lane++)
+    v[lane] = hash_round (v[lane], read64 (p));
+  if (p < end)
+    {
+      guint64 tail = 0;
+      for (int i = 0; p < end; p++, i += 8)
+        tail |= (guint64)*p << i;
+      v[lane] = hash_round (v[lane], tail ^ PRIME5);
+    }
+
+  guint64 a = v[0] ^ rotl64 (v[2], 29);
+  guint64 b = v[1] ^ rotl64 (v[3], 41);
+  a += len * PRIME3;
+  b ^= len * PRIME4;
+  NbtHash hash;
+  hash.low = fmix64 (a + b * PRIME4);
+  hash.high = fmix64 (b + a * PRIME5);
+  return hash;
+}
+
+/* Hash the elements of the array as little-endian values */
+static NbtHash
+hash_array (NbtData *data, int size)
+{
+  gsize len = (gsize)MAX (data->value_a.len, 0) * size;
+  guint64 seed = data->type;
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  return hash_bytes (data->value_a.value, len, seed);
+#else
+  if (size == 1)
+    return hash_bytes (data->value_a.value, len, seed);
+  guint8 *swapped = g_malloc (len);
+  for (int32_t i = 0; i < data->value_a.len; i++)
+    {
+      if (size == 4)
+        {
+          guint32 value = GUINT32_TO_LE (((guint32 *)data->value_a.value)[i]);
+          memcpy (swapped + i * 4, &value, 4);
+        }
+      else
+        {
+          guint64 value = GUINT64_TO_LE (((guint64 *)data->value_a.value)[i]);
+          memcpy (swapped + i * 8, &value, 8);
+        }
+    }
+  NbtHash hash = hash_bytes (swapped, len, seed);
+  g_free (swapped);
+  return hash;
+#endif
+}
+
+static NbtHash
+hash_scalar (guint64 value, NBT_Tags type)
+{
+  NbtHash hash;
+  hash.low = fmix64 (value ^ (type * PRIME1));
+  hash.high = fmix64 (rotl64 (value, 32) + type * PRIME2 + PRIME5);
+  return hash;
+}
+
+static void
+hash_node (NbtNode *node, GHashTable *cache, NbtHash *hash)
+{
+  NbtData *data = node->data;
+  switch (data->type)
+    {
+    case TAG_Byte:
+      *hash = hash_scalar ((gint64)(gint8)data->value_i, data->type);
+      return;
+    case TAG_Short:
+      *hash = hash_scalar ((gint64)(gint16)data->value_i, data->type);
+      return;
+    case TAG_Int:
+      *hash = hash_scalar ((gint64)(gint32)data->value_i, data->type);
+      return;
+    case TAG_Long:
+      *hash = hash_scalar (data->value_i, data->type);
+      return;
+    case TAG_Float:
+    case TAG_Double:
+      {
+        guint64 bits;
+        memcpy (&bits, &data->value_d, sizeof (bits));
+        *hash = hash_scalar (bits, data->type);
+        return;
+      }
+    case TAG_String:
+      {
+        const char *str = data->value_a.value ? data->value_a.value : "";
+        *hash = hash_bytes (str, strlen (str), data->type);
+        return;
+      }
+    case TAG_Byte_Array:
+      *hash = hash_array (data, 1);
+      return;
+    case TAG_Int_Array:
+      *hash = hash_array (data, 4);
+      return;
+    case TAG_Long_Array:
+      *hash = hash_array (data, 8);
+      return;
+    case TAG_List:
+    case TAG_Compound:
+      break;
+    default:
+      *hash = hash_scalar (0, data->type);
+      return;
+    }
+
+  if (cache)
+    {
+      NbtHash *cached = g_hash_table_lookup (cache, node);
+      if (cached)
+        {
+          *hash = *cached;
+          return;
+        }
+    }
+
+  /* The list is combined in order, the compound sums the hashes of its
+   * (key, child) pairs so the order doesn't matter */
+  gboolean compound = data->type == TAG_Compound;
+  guint64 low = data->type * PRIME3;
+  guint64 high = data->type * PRIME4;
+  guint64 n = 0;
+  NbtListIter iter;
+  nbt_list_iter_init (&iter, node);
+  for (NbtNode *child; (child = nbt_list_iter_next (&iter)); n++)
+    {
+      NbtHash child_hash;
+      hash_node (child, cache, &child_hash);
+      if (compound)
+        {
+          const char *key = ((NbtData *)child->data)->key;
+          if (!key)
+            key = "";
+          NbtHash pair = hash_bytes (key, strlen (key), child_hash.low);
+          low += fmix64 (pair.low ^ child_hash.high);
+          high += fmix64 (pair.high + child_hash.low);
+        }
+      else
+        {
+          low = rotl64 (low ^ child_hash.low, 29) * PRIME1 + child_hash.high;
+          high = rotl64 (high ^ child_hash.high, 37) * PRIME2 + child_hash.low;
+        }
+    }
+  hash->low = fmix64 (low + n * PRIME5);
+  hash->high = fmix64 (high ^ rotl64 (low, 17) ^ n);
+
+  if (cache)
+    g_hash_table_insert (cache, node, g_memdup2 (hash, sizeof (NbtHash)));
+}
+
+NbtHashCache *
+nbt_hash_cache_new (void)
+{
+  NbtHashCache *cache = g_new (NbtHashCache, 1);
+  cache->table = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                        g_free);
+  return cache;
+}
+
+void
+nbt_hash_cache_free (NbtHashCache *cache)
+{
+  if (!cache)
+    return;
+  g_hash_table_destroy (cache->table);
+  g_free (cache);
+}
+
+void
+nbt_hash_cache_invalidate (NbtHashCache *cache, NbtNode *node)
+{
+  g_return_if_fail (cache != NULL);
+  for (; node; node = node->parent)
+    g_hash_table_remove (cache->table, node);
+}
+
+void
+nbt_hash_cache_clear (NbtHashCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+  g_hash_table_remove_all (cache->table);
+}
+
+void
+nbt_node_hash_full (NbtNode *node, NbtHashCache *cache, NbtHash *hash)
+{
+  g_return_if_fail (node != NULL && hash != NULL);
+  hash_node (node, cache ? cache->table : NULL, hash);
+}
+
+guint64
+nbt_node_hash (NbtNode *node)
+{
+  g_return_val_if_fail (node != NULL, 0);
+  NbtHash hash;
+  hash_node (node, NULL, &hash);
+  return hash.low;
+}
+
+static gboolean node_equal (NbtNode *a, NbtNode *b);
+
+static gboolean
+compound_equal (NbtNode *a, NbtNode *b)
+{
+  guint n = g_node_n_children (a);
+  if (n != g_node_n_children (b))
+    return FALSE;
+
+  GHashTable *keys = NULL;
+  if (n > EQUAL_LINEAR_MAX)
+    {
+      keys = g_hash_table_new (g_str_hash, g_str_equal);
+      for (NbtNode *child = b->children; child; child = child->next)
+        {
+          const char *key = ((NbtData *)child->data)->key;
+          g_hash_table_insert (keys, (gpointer)(key ? key : ""), child);
+        }
+    }
+
+  gboolean equal = TRUE;
+  for (NbtNode *child = a->children; child && equal; child = child->next)
+    {
+      const char *key = ((NbtData *)child->data)->key;
+      if (!key)
+        key = "";
+      NbtNode *other = NULL;
+      if (keys)
+        other = g_hash_table_lookup (keys, key);
+      else
+        for (other = b->children; other; other = other->next)
+          {
+            const char *other_key = ((NbtData *)other->data)->key;
+            if (g_str_equal (key, other_key ? other_key : ""))
+              break;
+          }
+      equal = other && node_equal (child, other);
+    }
+  if (keys)
+    g_hash_table_destroy (keys);
+  return equal;
+}
+
+static gboolean
+node_equal (NbtNode *a, NbtNode *b)
+{
+  NbtData *da = a->data;
+  NbtData *db = b->data;
+  if (da->type != db->type)
+    return FALSE;
+  switch (da->type)
+    {
+    case TAG_Byte:
+      return (gint8)da->value_i == (gint8)db->value_i;
+    case TAG_Short:
+      return (gint16)da->value_i == (gint16)db->value_i;
+    case TAG_Int:
+      return (gint32)da->value_i == (gint32)db->value_i;
+    case TAG_Long:
+      return da->value_i == db->value_i;
+    case TAG_Float:
+    case TAG_Double:
+      return memcmp (&da->value_d, &db->value_d, sizeof (double)) == 0;
+    case TAG_String:
+      return g_strcmp0 (da->value_a.value, db->value_a.value) == 0;
+    case TAG_Byte_Array:
+    case TAG_Int_Array:
+    case TAG_Long_Array:
+      {
+        gsize size = da->type == TAG_Byte_Array  ? 1
+                     : da->type == TAG_Int_Array ? 4
+                                                 : 8;
+        return da->value_a.len == db->value_a.len
+               && (da->value_a.len <= 0
+                   || memcmp (da->value_a.value, db->value_a.value,
+                              size * da->value_a.len)
+                          == 0);
+      }
+    case TAG_List:
+      {
+        if (nbt_data_is_packed_list (da) && nbt_data_is_packed_list (db)
+            && nbt_data_list_type (da) == nbt_data_list_type (db))
+          return da->value_a.len == db->value_a.len
+                 && memcmp (da->value_a.value, db->value_a.value,
+                            da->value_a.len
+                                * nbt_reader_scalar_size (
+                                    nbt_data_list_type (da)))
+                        == 0;
+        /* One of them may be packed, the elements are compared alike */
+        NbtListIter ia;
+        NbtListIter ib;
+        nbt_list_iter_init (&ia, a);
+        nbt_list_iter_init (&ib, b);
+        NbtNode *ca = nbt_list_iter_next (&ia);
+        NbtNode *cb = nbt_list_iter_next (&ib);
+        for (; ca && cb;
+             ca = nbt_list_iter_next (&ia), cb = nbt_list_iter_next (&ib))
+          if (!node_equal (ca, cb))
+            return FALSE;
+        return !ca && !cb;
+      }
+    case TAG_Compound:
+      return compound_equal (a, b);
+    default:
+      return TRUE;
+    }
+}
+
+gboolean
+nbt_node_equal (NbtNode *a, NbtNode *b)
+{
+  g_return_val_if_fail (a != NULL && b != NULL, FALSE);
+  return a == b || node_equal (a, b);
+}
+
+guint
+nbt_node_hash_func (gconstpointer node)
+{
+  return (guint)nbt_node_hash ((NbtNode *)node);
+}
+
+gboolean
+nbt_node_equal_func (gconstpointer a, gconstpointer b)
+{
+  return nbt_node_equal ((NbtNode *)a, (NbtNode *)b);
+}
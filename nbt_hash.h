@@ -0,0 +1,115 @@
+/*  nbt_hash - Structural hash part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_HASH_H
+#define DHLRC_NBT_HASH_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The 128-bit structural hash of a subtree.
+ *
+ * It only depends on the tags, the values and the keys of the children,
+ * not on the key of the hashed node itself, the order of the children of
+ * the compounds or the machine. It's not a cryptographic hash.
+ */
+typedef struct NbtHash
+{
+  guint64 low;
+  guint64 high;
+} NbtHash;
+
+/**
+ * @brief The cache of the hashes of the lists and compounds.
+ *
+ * The cache remembers the nodes by their address, so the cached node (and
+ * its ancestors) must be invalidated before it's changed or freed.
+ */
+typedef struct NbtHashCache NbtHashCache;
+
+/**
+ * @brief Create an empty hash cache.
+ * @return The cache, to be freed by `nbt_hash_cache_free`
+ */
+NbtHashCache *nbt_hash_cache_new (void);
+/**
+ * @brief Free the hash cache, the nodes are not touched.
+ * @param cache The cache
+ */
+void nbt_hash_cache_free (NbtHashCache *cache);
+/**
+ * @brief Forget the hashes of the node and its ancestors.
+ *
+ * Call it after changing the node, or on the parent after adding or
+ * removing a child.
+ * @param cache The cache
+ * @param node The changed node
+ */
+void nbt_hash_cache_invalidate (NbtHashCache *cache, NbtNode *node);
+/**
+ * @brief Forget every hash in the cache.
+ * @param cache The cache
+ */
+void nbt_hash_cache_clear (NbtHashCache *cache);
+
+/**
+ * @brief Compute the 128-bit structural hash of the subtree.
+ *
+ * The hash is computed bottom-up, the arrays and the strings are hashed in
+ * bulk and the children of a compound are combined regardless of their
+ * order.
+ * @param node The root of the subtree
+ * @param cache The cache to look up and fill, or NULL
+ * @param hash The result
+ */
+void nbt_node_hash_full (NbtNode *node, NbtHashCache *cache, NbtHash *hash);
+/**
+ * @brief Compute the 64-bit structural hash of the subtree.
+ * @param node The root of the subtree
+ * @return The low half of the 128-bit hash
+ * @sa nbt_node_hash_full
+ */
+guint64 nbt_node_hash (NbtNode *node);
+/**
+ * @brief Compare two subtrees structurally.
+ *
+ * The keys of `a` and `b` themselves are ignored, the children of the
+ * compounds are matched by their keys. The floating values are compared
+ * bitwise, so `NaN` equals itself.
+ * @param a The first subtree
+ * @param b The second subtree
+ * @return TRUE if the subtrees have the same structural hash by definition
+ */
+gboolean nbt_node_equal (NbtNode *a, NbtNode *b);
+
+/**
+ * @brief The `GHashFunc` of the subtrees, to use the trees as the keys of
+ * a `GHashTable` together with `nbt_node_equal_func`.
+ */
+guint nbt_node_hash_func (gconstpointer node);
+/**
+ * @brief The `GEqualFunc` of the subtrees.
+ * @sa nbt_node_hash_func
+ */
+gboolean nbt_node_equal_func (gconstpointer a, gconstpointer b);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_HASH_H
@@ -0,0 +1,977 @@
+/*  nbt_json - JSON part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_json.h"
+#include "nbt_private.h"
+#include "nbt_util.h"
+#include <string.h>
+
+#ifndef NBT_GLIB_DISABLE_TRANSLATION
+#include <libintl.h>
+#define _(text) gettext (text)
+#else
+#define _(text) text
+#endif
+
+/* The size of the blocks written to and read from the streams */
+#define JSON_BLOCK_SIZE (64 * 1024)
+
+/* Deeper documents are refused instead of overflowing the stack */
+#define JSON_MAX_DEPTH 512
+
+static const char *const type_names[]
+    = { "end",        "byte",   "short", "int",      "long",
+        "float",      "double", "byte_array", "string", "list",
+        "compound",   "int_array", "long_array" };
+
+/* Writing */
+
+typedef struct JsonWriter
+{
+  GString *buffer;
+  GOutputStream *os;
+  GCancellable *cancellable;
+  NbtJsonMode mode;
+  gboolean pretty_output;
+  GError *error;
+} JsonWriter;
+
+/* The escaped form of the bytes in strings, 0 if the byte is copied as is,
+ * 'u' stands for a `\u00XX` escape */
+static const char json_escapes[256] = {
+  [0x00] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u',
+  [0x05] = 'u', [0x06] = 'u', [0x07] = 'u', ['\b'] = 'b', ['\t'] = 't',
+  ['\n'] = 'n', [0x0b] = 'u', ['\f'] = 'f', ['\r'] = 'r', [0x0e] = 'u',
+  [0x0f] = 'u', [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u',
+  [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u', [0x18] = 'u',
+  [0x19] = 'u', [0x1a] = 'u', [0x1b] = 'u', [0x1c] = 'u', [0x1d] = 'u',
+  [0x1e] = 'u', [0x1f] = 'u', ['"'] = '"',  ['\\'] = '\\',
+};
+
+static gboolean
+json_flush (JsonWriter *writer, gsize threshold)
+{
+  GString *buffer = writer->buffer;
+  if (buffer->len < threshold || buffer->len == 0)
+    return TRUE;
+  if (!g_output_stream_write_all (writer->os, buffer->str, buffer->len, NULL,
+                                  writer->cancellable, &writer->error))
+    return FALSE;
+  g_string_truncate (buffer, 0);
+  return TRUE;
+}
+
+static void
+json_write_string (GString *buffer, const char *str)
+{
+  g_string_append_c (buffer, '"');
+  const char *run = str;
+  const char *p = str;
+  for (; *p; p++)
+    {
+      char escape = json_escapes[(guchar)*p];
+      if (G_LIKELY (!escape))
+        continue;
+      g_string_append_len (buffer, run, p - run);
+      run = p + 1;
+      if (escape == 'u')
+        g_string_append_printf (buffer, "\\u%04x", (guchar)*p);
+      else
+        {
+          char escaped[2] = { '\\', escape };
+          g_string_append_len (buffer, escaped, 2);
+        }
+    }
+  g_string_append_len (buffer, run, p - run);
+  g_string_append_c (buffer, '"');
+}
+
+static void
+json_write_indent (JsonWriter *writer, int level)
+{
+  if (!writer->pretty_output)
+    return;
+  g_string_append_c (writer->buffer, '\n');
+  for (int i = 0; i < level; i++)
+    g_string_append_len (writer->buffer, "  ", 2);
+}
+
+static void
+json_write_floating (JsonWriter *writer, double value, int type)
+{
+  char num[NBT_FORMAT_BUFFER_SIZE];
+  int len = type == TAG_Float ? nbt_format_float (num, value)
+                              : nbt_format_double (num, value);
+  /* NaN and the infinities are the only results starting with a letter */
+  gboolean finite = g_ascii_isdigit (num[len - 1]);
+  if (finite)
+    g_string_append_len (writer->buffer, num, len);
+  else if (writer->mode == NBT_JSON_TYPED)
+    json_write_string (writer->buffer, num);
+  else
+    g_string_append (writer->buffer, "null");
+}
+
+/* The arrays are formatted straight into the buffer, a block of elements
+ * at a time */
+static gboolean
+json_write_array (JsonWriter *writer, NbtData *data)
+{
+  GString *buffer = writer->buffer;
+  g_string_append_c (buffer, '[');
+  for (int32_t start = 0; start < data->value_a.len; start += 4096)
+    {
+      int32_t end = MIN (start + 4096, data->value_a.len);
+      gsize old_len = buffer->len;
+      g_string_set_size (buffer, old_len + (gsize)(end - start)
+                                               * (NBT_FORMAT_BUFFER_SIZE + 2));
+      char *p = buffer->str + old_len;
+      for (int32_t i = start; i < end; i++)
+        {
+          if (i)
+            {
+              *p++ = ',';
+              if (writer->pretty_output)
+                *p++ = ' ';
+            }
+          gint64 value = data->type == TAG_Byte_Array
+                             ? ((gint8 *)data->value_a.value)[i]
+                         : data->type == TAG_Int_Array
+                             ? ((gint32 *)data->value_a.value)[i]
+                             : ((gint64 *)data->value_a.value)[i];
+          p += nbt_format_int64 (p, value);
+        }
+      g_string_truncate (buffer, p - buffer->str);
+      if (!json_flush (writer, JSON_BLOCK_SIZE))
+        return FALSE;
+    }
+  g_string_append_c (buffer, ']');
+  return TRUE;
+}
+
+static gboolean
+json_write_value (JsonWriter *writer, NbtNode *node, int level)
+{
+  GString *buffer = writer->buffer;
+  NbtData *data = node->data;
+  gboolean typed = writer->mode == NBT_JSON_TYPED;
+  if (data->type <= TAG_End || data->type > TAG_Long_Array)
+    {
+      g_set_error (&writer->error, NBT_GLIB_PARSE_ERROR,
+                   NBT_GLIB_PARSE_ERROR_INVALID_TAG, _ ("Invalid tag: %d."),
+                   data->type);
+      return FALSE;
+    }
+  if (typed)
+    {
+      g_string_append (buffer, "{\"type\":");
+      if (writer->pretty_output)
+        g_string_append_c (buffer, ' ');
+      json_write_string (buffer, type_names[data->type]);
+      g_string_append (buffer, writer->pretty_output ? ", \"value\": "
+                                                     : ",\"value\":");
+    }
+
+  char num[NBT_FORMAT_BUFFER_SIZE];
+  switch (data->type)
+    {
+    case TAG_Byte:
+      g_string_append_len (buffer, num,
+                           nbt_format_int64 (num, (gint8)data->value_i));
+      break;
+    case TAG_Short:
+      g_string_append_len (buffer, num,
+                           nbt_format_int64 (num, (gint16)data->value_i));
+      break;
+    case TAG_Int:
+      g_string_append_len (buffer, num,
+                           nbt_format_int64 (num, (gint32)data->value_i));
+      break;
+    case TAG_Long:
+      g_string_append_len (buffer, num,
+                           nbt_format_int64 (num, data->value_i));
+      break;
+    case TAG_Float:
+    case TAG_Double:
+      json_write_floating (writer, data->value_d, data->type);
+      break;
+    case TAG_String:
+      json_write_string (buffer, data->value_a.value);
+      break;
+    case TAG_Byte_Array:
+    case TAG_Int_Array:
+    case TAG_Long_Array:
+      if (!json_write_array (writer, data))
+        return FALSE;
+      break;
+    case TAG_List:
+    case TAG_Compound:
+      {
+        gboolean compound = data->type == TAG_Compound;
+        gboolean empty = !node->children && !nbt_data_is_packed_list (data);
+        g_string_append_c (buffer, compound ? '{' : '[');
+        NbtListIter iter;
+        nbt_list_iter_init (&iter, node);
+        gboolean first = TRUE;
+        for (NbtNode *child; (child = nbt_list_iter_next (&iter));
+             first = FALSE)
+          {
+            if (!first)
+              g_string_append_c (buffer, ',');
+            json_write_indent (writer, level + 1);
+            if (compound)
+              {
+                NbtData *child_data = child->data;
+                json_write_string (buffer,
+                                   child_data->key ? child_data->key : "");
+                g_string_append (buffer,
+                                 writer->pretty_output ? ": " : ":");
+              }
+            if (!json_write_value (writer, child, level + 1))
+              return FALSE;
+          }
+        if (!empty)
+          json_write_indent (writer, level);
+        g_string_append_c (buffer, compound ? '}' : ']');
+        break;
+      }
+    default:
+      break;
+    }
+  if (typed)
+    g_string_append_c (buffer, '}');
+  return json_flush (writer, JSON_BLOCK_SIZE);
+}
+
+gboolean
+nbt_node_to_json_stream (NbtNode *node, GOutputStream *os, NbtJsonMode mode,
+                         gboolean pretty_output, GCancellable *cancellable,
+                         GError **error)
+{
+  g_return_val_if_fail (node != NULL, FALSE);
+  g_return_val_if_fail (G_IS_OUTPUT_STREAM (os), FALSE);
+
+  JsonWriter writer = { 0 };
+  writer.buffer = g_string_sized_new (JSON_BLOCK_SIZE * 2);
+  writer.os = os;
+  writer.cancellable = cancellable;
+  writer.mode = mode;
+  writer.pretty_output = pretty_output;
+
+  gboolean ok = json_write_value (&writer, node, 0);
+  if (ok && pretty_output)
+    g_string_append_c (writer.buffer, '\n');
+  if (ok)
+    ok = json_flush (&writer, 0);
+  g_string_free (writer.buffer, TRUE);
+  if (!ok)
+    g_propagate_error (error, writer.error);
+  return ok;
+}
+
+/* Reading */
+
+typedef struct JsonReader
+{
+  GInputStream *is;
+  GCancellable *cancellable;
+  NbtJsonMode mode;
+  char *buf;
+  gsize pos;
+  gsize len;
+  /** The offset of `buf` in the stream */
+  guint64 offset;
+  gboolean eof;
+  GError **error;
+  gboolean failed;
+} JsonReader;
+
+static void
+read_error (JsonReader *reader, const char *format, ...) G_GNUC_PRINTF (2, 3);
+
+/* Only the first error is kept */
+static void
+read_error (JsonReader *reader, const char *format, ...)
+{
+  if (reader->failed)
+    return;
+  reader->failed = TRUE;
+  va_list args;
+  va_start (args, format);
+  char *message = g_strdup_vprintf (format, args);
+  va_end (args);
+  g_set_error (reader->error, NBT_GLIB_PARSE_ERROR,
+               NBT_GLIB_PARSE_ERROR_SYNTAX,
+               _ ("At byte %" G_GUINT64_FORMAT ": %s"),
+               reader->offset + reader->pos, message);
+  g_free (message);
+}
+
+/* Make sure there's something to read, FALSE at the end or on error */
+static gboolean
+fill (JsonReader *reader)
+{
+  if (reader->pos < reader->len)
+    return TRUE;
+  if (reader->eof || reader->failed)
+    return FALSE;
+  GError *err = NULL;
+  gssize n = g_input_stream_read (reader->is, reader->buf, JSON_BLOCK_SIZE,
+                                  reader->cancellable, &err);
+  if (n < 0)
+    {
+      reader->failed = TRUE;
+      g_propagate_error (reader->error, err);
+      return FALSE;
+    }
+  reader->offset += reader->len;
+  reader->pos = 0;
+  reader->len = n;
+  reader->eof = n == 0;
+  return n > 0;
+}
+
+static int
+peek (JsonReader *reader)
+{
+  return fill (reader) ? (guchar)reader->buf[reader->pos] : -1;
+}
+
+static int
+next (JsonReader *reader)
+{
+  return fill (reader) ? (guchar)reader->buf[reader->pos++] : -1;
+}
+
+static int
+skip_whitespace (JsonReader *reader)
+{
+  for (;;)
+    {
+      if (!fill (reader))
+        return -1;
+      while (reader->pos < reader->len)
+        {
+          char c = reader->buf[reader->pos];
+          if (c != ' ' && c != '\n' && c != '\t' && c != '\r')
+            return (guchar)c;
+          reader->pos++;
+        }
+    }
+}
+
+static gboolean
+expect (JsonReader *reader, char c)
+{
+  if (skip_whitespace (reader) == c)
+    {
+      reader->pos++;
+      return TRUE;
+    }
+  read_error (reader, _ ("Expected '%c'."), c);
+  return FALSE;
+}
+
+static int
+read_hex4 (JsonReader *reader)
+{
+  int value = 0;
+  for (int i = 0; i < 4; i++)
+    {
+      int c = next (reader);
+      int d = c < 0 ? -1 : g_ascii_xdigit_value (c);
+      if (d < 0)
+        return -1;
+      value = value * 16 + d;
+    }
+  return value;
+}
+
+/* Read the string after its opening quote */
+static char *
+read_string (JsonReader *reader)
+{
+  GString *string = g_string_new (NULL);
+  for (;;)
+    {
+      if (!fill (reader))
+        {
+          read_error (reader, _ ("Unterminated string."));
+          goto error;
+        }
+      /* Copy the plain run in the current block */
+      const char *start = reader->buf + reader->pos;
+      const char *end = reader->buf + reader->len;
+      const char *p = start;
+      while (p < end && *p != '"' && *p != '\\' && (guchar)*p >= 0x20)
+        p++;
+      g_string_append_len (string, start, p - start);
+      reader->pos += p - start;
+      if (p == end)
+        continue;
+
+      int c = next (reader);
+      if (c == '"')
+        break;
+      if (c != '\\')
+        {
+          read_error (reader, _ ("Control character in string."));
+          goto error;
+        }
+      c = next (reader);
+      switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+          g_string_append_c (string, c);
+          break;
+        case 'b':
+          g_string_append_c (string, '\b');
+          break;
+        case 'f':
+          g_string_append_c (string, '\f');
+          break;
+        case 'n':
+          g_string_append_c (string, '\n');
+          break;
+        case 'r':
+          g_string_append_c (string, '\r');
+          break;
+        case 't':
+          g_string_append_c (string, '\t');
+          break;
+        case 'u':
+          {
+            int value = read_hex4 (reader);
+            if (value >= 0xd800 && value < 0xdc00 && next (reader) == '\\'
+                && next (reader) == 'u')
+              {
+                int low = read_hex4 (reader);
+                value = low >= 0xdc00 && low < 0xe000
+                            ? 0x10000 + ((value - 0xd800) << 10)
+                                  + (low - 0xdc00)
+                            : -1;
+              }
+            if (value < 0 || !g_unichar_validate (value))
+              {
+                read_error (reader, _ ("Invalid \\u escape."));
+                goto error;
+              }
+            g_string_append_unichar (string, value);
+            break;
+          }
+        default:
+          read_error (reader, _ ("Invalid escape."));
+          goto error;
+        }
+    }
+  if (!g_utf8_validate_len (string->str, string->len, NULL))
+    {
+      read_error (reader, _ ("Invalid UTF-8 in string."));
+      goto error;
+    }
+  return g_string_free (string, FALSE);
+
+error:
+  g_string_free (string, TRUE);
+  return NULL;
+}
+
+/* Read the characters of a number or a literal into `token` */
+static gboolean
+read_token (JsonReader *reader, char *token, gsize size)
+{
+  gsize len = 0;
+  for (;;)
+    {
+      int c = peek (reader);
+      if (c < 0 || !(g_ascii_isalnum (c) || c == '-' || c == '+' || c == '.'))
+        break;
+      if (len + 1 == size)
+        {
+          read_error (reader, _ ("The token is too long."));
+          return FALSE;
+        }
+      token[len++] = c;
+      reader->pos++;
+    }
+  token[len] = '\0';
+  if (!len)
+    {
+      read_error (reader, _ ("Expected a value."));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+token_to_integer (const char *token, gint64 *value)
+{
+  return g_ascii_string_to_signed (token, 10, G_MININT64, G_MAXINT64,
+                                   value, NULL);
+}
+
+static gboolean
+token_to_double (const char *token, double *value)
+{
+  char *end = NULL;
+  *value = g_ascii_strtod (token, &end);
+  return end != token && *end == '\0';
+}
+
+static void
+widen_number (NbtNode *node, NBT_Tags type)
+{
+  NbtData *data = node->data;
+  if (data->type == type)
+    return;
+  if (type == TAG_Double)
+    data->value_d = data->value_i;
+  data->type = type;
+}
+
+/* The lists of the lossy mode take the widest number type of their
+ * elements, other types have to be the same */
+static gboolean
+lossy_list_accepts (NbtNode *list, NbtNode *child)
+{
+  if (!list->children)
+    return TRUE;
+  NBT_Tags type = ((NbtData *)list->children->data)->type;
+  NBT_Tags child_type = ((NbtData *)child->data)->type;
+  if (type == child_type)
+    return TRUE;
+  if ((type != TAG_Int && type != TAG_Long && type != TAG_Double)
+      || (child_type != TAG_Int && child_type != TAG_Long
+          && child_type != TAG_Double))
+    return FALSE;
+  if (child_type < type)
+    widen_number (child, type);
+  else
+    for (NbtNode *node = list->children; node; node = node->next)
+      widen_number (node, child_type);
+  return TRUE;
+}
+
+static NbtNode *read_lossy (JsonReader *reader, const char *key, int depth);
+static NbtNode *read_typed (JsonReader *reader, const char *key, int depth);
+
+static NbtNode *
+read_element (JsonReader *reader, const char *key, int depth)
+{
+  if (depth > JSON_MAX_DEPTH)
+    {
+      read_error (reader, _ ("The document is nested too deep."));
+      return NULL;
+    }
+  return reader->mode == NBT_JSON_TYPED ? read_typed (reader, key, depth)
+                                        : read_lossy (reader, key, depth);
+}
+
+/* Read `{"key": element, ...}` as the children of `node` */
+static gboolean
+read_members (JsonReader *reader, NbtNode *node, int depth)
+{
+  if (!expect (reader, '{'))
+    return FALSE;
+  NbtNode *last = NULL;
+  if (skip_whitespace (reader) == '}')
+    {
+      reader->pos++;
+      return TRUE;
+    }
+  for (;;)
+    {
+      if (!expect (reader, '"'))
+        return FALSE;
+      char *key = read_string (reader);
+      if (!key || !expect (reader, ':'))
+        {
+          g_free (key);
+          return FALSE;
+        }
+      NbtNode *child = read_element (reader, key, depth + 1);
+      g_free (key);
+      if (!child)
+        return FALSE;
+      nbt_node_insert_after (node, last, child);
+      last = child;
+      int c = skip_whitespace (reader);
+      reader->pos++;
+      if (c == '}')
+        return TRUE;
+      if (c != ',')
+        {
+          reader->pos--;
+          read_error (reader, _ ("Expected ',' or '}'."));
+          return FALSE;
+        }
+    }
+}
+
+/* Read `[element, ...]` as the children of `node` */
+static gboolean
+read_elements (JsonReader *reader, NbtNode *node, int depth)
+{
+  if (!expect (reader, '['))
+    return FALSE;
+  NbtNode *last = NULL;
+  if (skip_whitespace (reader) == ']')
+    {
+      reader->pos++;
+      return TRUE;
+    }
+  for (;;)
+    {
+      NbtNode *child = read_element (reader, NULL, depth + 1);
+      if (!child)
+        return FALSE;
+      gboolean accepted
+          = reader->mode == NBT_JSON_TYPED
+                ? !last
+                      || ((NbtData *)child->data)->type
+                             == ((NbtData *)last->data)->type
+                : lossy_list_accepts (node, child);
+      if (!accepted)
+        {
+          read_error (reader, _ ("The elements of the list have different "
+                                 "types."));
+          nbt_node_free (child);
+          return FALSE;
+        }
+      nbt_node_insert_after (node, last, child);
+      last = child;
+      int c = skip_whitespace (reader);
+      reader->pos++;
+      if (c == ']')
+        return TRUE;
+      if (c != ',')
+        {
+          reader->pos--;
+          read_error (reader, _ ("Expected ',' or ']'."));
+          return FALSE;
+        }
+    }
+}
+
+static NbtNode *
+read_lossy (JsonReader *reader, const char *key, int depth)
+{
+  int c = skip_whitespace (reader);
+  switch (c)
+    {
+    case -1:
+      read_error (reader, _ ("Expected a value but got the end."));
+      return NULL;
+    case '{':
+      {
+        NbtNode *node = nbt_node_new_compound (key);
+        if (!read_members (reader, node, depth))
+          {
+            nbt_node_free (node);
+            return NULL;
+          }
+        return node;
+      }
+    case '[':
+      {
+        NbtNode *node = nbt_node_new_list (key);
+        if (!read_elements (reader, node, depth))
+          {
+            nbt_node_free (node);
+            return NULL;
+          }
+        return node;
+      }
+    case '"':
+      {
+        reader->pos++;
+        char *string = read_string (reader);
+        if (!string)
+          return NULL;
+        NbtNode *node = nbt_node_new_string (key, string);
+        g_free (string);
+        return node;
+      }
+    default:
+      {
+        char token[64];
+        gint64 i;
+        double d;
+        if (!read_token (reader, token, sizeof (token)))
+          return NULL;
+        if (g_str_equal (token, "true") || g_str_equal (token, "false"))
+          return nbt_node_new_byte (key, token[0] == 't');
+        if (token_to_integer (token, &i))
+          return i >= G_MININT32 && i <= G_MAXINT32
+                     ? nbt_node_new_int (key, i)
+                     : nbt_node_new_long (key, i);
+        if (token_to_double (token, &d))
+          return nbt_node_new_double (key, d);
+        read_error (reader, _ ("Invalid value '%s'."), token);
+        return NULL;
+      }
+    }
+}
+
+static NBT_Tags
+type_from_name (const char *name)
+{
+  for (int i = TAG_Byte; i <= TAG_Long_Array; i++)
+    if (g_str_equal (name, type_names[i]))
+      return i;
+  return TAG_End;
+}
+
+/* Read the key of a typed object and check it's `name` */
+static gboolean
+read_member_name (JsonReader *reader, const char *name)
+{
+  if (!expect (reader, '"'))
+    return FALSE;
+  char *key = read_string (reader);
+  gboolean ok = key && g_str_equal (key, name);
+  if (key && !ok)
+    read_error (reader, _ ("Expected the \"%s\" member."), name);
+  g_free (key);
+  return ok && expect (reader, ':');
+}
+
+static NbtNode *
+read_typed_array (JsonReader *reader, NBT_Tags type, const char *key)
+{
+  int size = type == TAG_Byte_Array ? 1 : type == TAG_Int_Array ? 4 : 8;
+  gint64 min = type == TAG_Byte_Array  ? G_MININT8
+               : type == TAG_Int_Array ? G_MININT32
+                                       : G_MININT64;
+  gint64 max = type == TAG_Byte_Array  ? G_MAXINT8
+               : type == TAG_Int_Array ? G_MAXINT32
+                                       : G_MAXINT64;
+  GArray *array = g_array_new (FALSE, FALSE, size);
+  NbtNode *node = NULL;
+  if (!expect (reader, '['))
+    goto out;
+  if (skip_whitespace (reader) == ']')
+    reader->pos++;
+  else
+    for (;;)
+      {
+        char token[64];
+        gint64 value;
+        skip_whitespace (reader);
+        if (!read_token (reader, token, sizeof (token)))
+          goto out;
+        if (!token_to_integer (token, &value) || value < min || value > max)
+          {
+            read_error (reader, _ ("Invalid element '%s' of the %s."), token,
+                        type_names[type]);
+            goto out;
+          }
+        if (type == TAG_Byte_Array)
+          {
+            gint8 v = value;
+            g_array_append_val (array, v);
+          }
+        else if (type == TAG_Int_Array)
+          {
+            gint32 v = value;
+            g_array_append_val (array, v);
+          }
+        else
+          g_array_append_val (array, value);
+        int c = skip_whitespace (reader);
+        reader->pos++;
+        if (c == ']')
+          break;
+        if (c != ',')
+          {
+            reader->pos--;
+            read_error (reader, _ ("Expected ',' or ']'."));
+            goto out;
+          }
+      }
+
+  if (type == TAG_Byte_Array)
+    node = nbt_node_new_byte_array (key, (gint8 *)array->data, array->len);
+  else if (type == TAG_Int_Array)
+    node = nbt_node_new_int_array (key, (gint32 *)array->data, array->len);
+  else
+    node = nbt_node_new_long_array (key, (gint64 *)array->data, array->len);
+out:
+  g_array_free (array, TRUE);
+  return node;
+}
+
+static NbtNode *
+read_typed_value (JsonReader *reader, NBT_Tags type, const char *key,
+                  int depth)
+{
+  char token[64];
+  gint64 i;
+  double d;
+  switch (type)
+    {
+    case TAG_Byte:
+    case TAG_Short:
+    case TAG_Int:
+    case TAG_Long:
+      {
+        skip_whitespace (reader);
+        if (!read_token (reader, token, sizeof (token)))
+          return NULL;
+        gint64 min = type == TAG_Byte    ? G_MININT8
+                     : type == TAG_Short ? G_MININT16
+                     : type == TAG_Int   ? G_MININT32
+                                         : G_MININT64;
+        gint64 max = type == TAG_Byte    ? G_MAXINT8
+                     : type == TAG_Short ? G_MAXINT16
+                     : type == TAG_Int   ? G_MAXINT32
+                                         : G_MAXINT64;
+        if (!token_to_integer (token, &i) || i < min || i > max)
+          {
+            read_error (reader, _ ("Invalid %s '%s'."), type_names[type],
+                        token);
+            return NULL;
+          }
+        return type == TAG_Byte    ? nbt_node_new_byte (key, i)
+               : type == TAG_Short ? nbt_node_new_short (key, i)
+               : type == TAG_Int   ? nbt_node_new_int (key, i)
+                                   : nbt_node_new_long (key, i);
+      }
+    case TAG_Float:
+    case TAG_Double:
+      if (skip_whitespace (reader) == '"')
+        {
+          /* NaN and the infinities */
+          reader->pos++;
+          char *string = read_string (reader);
+          if (!string)
+            return NULL;
+          gboolean ok = token_to_double (string, &d);
+          g_free (string);
+          if (!ok)
+            {
+              read_error (reader, _ ("Invalid %s."), type_names[type]);
+              return NULL;
+            }
+        }
+      else
+        {
+          if (!read_token (reader, token, sizeof (token)))
+            return NULL;
+          if (!token_to_double (token, &d))
+            {
+              read_error (reader, _ ("Invalid %s '%s'."), type_names[type],
+                          token);
+              return NULL;
+            }
+        }
+      return type == TAG_Float ? nbt_node_new_float (key, d)
+                               : nbt_node_new_double (key, d);
+    case TAG_String:
+      {
+        if (!expect (reader, '"'))
+          return NULL;
+        char *string = read_string (reader);
+        if (!string)
+          return NULL;
+        NbtNode *node = nbt_node_new_string (key, string);
+        g_free (string);
+        return node;
+      }
+    case TAG_Byte_Array:
+    case TAG_Int_Array:
+    case TAG_Long_Array:
+      return read_typed_array (reader, type, key);
+    case TAG_List:
+    case TAG_Compound:
+      {
+        NbtNode *node = type == TAG_List ? nbt_node_new_list (key)
+                                         : nbt_node_new_compound (key);
+        gboolean ok = type == TAG_List ? read_elements (reader, node, depth)
+                                       : read_members (reader, node, depth);
+        if (!ok)
+          {
+            nbt_node_free (node);
+            return NULL;
+          }
+        return node;
+      }
+    default:
+      return NULL;
+    }
+}
+
+static NbtNode *
+read_typed (JsonReader *reader, const char *key, int depth)
+{
+  if (!expect (reader, '{') || !read_member_name (reader, "type")
+      || !expect (reader, '"'))
+    return NULL;
+  char *name = read_string (reader);
+  if (!name)
+    return NULL;
+  NBT_Tags type = type_from_name (name);
+  if (type == TAG_End)
+    {
+      read_error (reader, _ ("Unknown type \"%s\"."), name);
+      g_free (name);
+      return NULL;
+    }
+  g_free (name);
+  if (!expect (reader, ',') || !read_member_name (reader, "value"))
+    return NULL;
+  NbtNode *node = read_typed_value (reader, type, key, depth);
+  if (node && !expect (reader, '}'))
+    {
+      nbt_node_free (node);
+      return NULL;
+    }
+  return node;
+}
+
+NbtNode *
+nbt_node_new_from_json_stream (GInputStream *is, NbtJsonMode mode,
+                               GCancellable *cancellable, GError **error)
+{
+  g_return_val_if_fail (G_IS_INPUT_STREAM (is), NULL);
+
+  JsonReader reader = { 0 };
+  reader.is = is;
+  reader.cancellable = cancellable;
+  reader.mode = mode;
+  reader.buf = g_malloc (JSON_BLOCK_SIZE);
+  reader.error = error;
+
+  NbtNode *root = read_element (&reader, "", 0);
+  if (root && skip_whitespace (&reader) != -1)
+    {
+      read_error (&reader, _ ("Some leftover text detected after parsing."));
+      nbt_node_free (root);
+      root = NULL;
+    }
+  else if (root && reader.failed)
+    {
+      /* Reading the leftover failed */
+      nbt_node_free (root);
+      root = NULL;
+    }
+  g_free (reader.buf);
+  return root;
+}
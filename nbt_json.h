@@ -0,0 +1,83 @@
+/*  nbt_json - JSON part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_JSON_H
+#define DHLRC_NBT_JSON_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The mapping between the NBT and the JSON
+ */
+typedef enum NbtJsonMode
+{
+  /**
+   * Every value is `{"type": "int", "value": 1}`, so the tags are kept.
+   * The type names are `byte`, `short`, `int`, `long`, `float`, `double`,
+   * `byte_array`, `string`, `list`, `compound`, `int_array` and
+   * `long_array`. The value of a compound is an object of such values, the
+   * value of a list is an array of them. The floating values which aren't
+   * finite are the strings `"NaN"`, `"Infinity"` and `"-Infinity"`.
+   */
+  NBT_JSON_TYPED,
+  /**
+   * Plain JSON: compounds are objects, lists and arrays are arrays. The
+   * tags are lost, reading back gives `int`, `long` or `double` numbers
+   * and `byte` for `true` and `false`. The floating values which aren't
+   * finite are `null`.
+   */
+  NBT_JSON_LOSSY,
+} NbtJsonMode;
+
+/**
+ * @brief Write the NBT node as JSON to the stream.
+ *
+ * The text is written in blocks, the whole document is never held in
+ * memory. The name of the root node isn't written.
+ * @param node The root node needed to write as JSON
+ * @param os The output stream, which isn't closed
+ * @param mode The mapping of the tags
+ * @param pretty_output Put every element on its own indented line
+ * @param cancellable Cancellable object
+ * @param error Error code, or NULL to ignore
+ * @return TRUE if the whole tree is written
+ */
+gboolean nbt_node_to_json_stream (NbtNode *node, GOutputStream *os,
+                                  NbtJsonMode mode, gboolean pretty_output,
+                                  GCancellable *cancellable, GError **error);
+/**
+ * @brief Read the NBT node from the JSON in the stream.
+ *
+ * The stream is read in blocks and the tree is built while reading. In the
+ * typed mode the `"type"` member has to come before `"value"`, as written
+ * by `nbt_node_to_json_stream`.
+ * @param is The input stream, which isn't closed
+ * @param mode The mapping of the tags
+ * @param cancellable Cancellable object
+ * @param error Error code, or NULL to ignore
+ * @return The root node of the NBT, or NULL when failed.
+ */
+NbtNode *nbt_node_new_from_json_stream (GInputStream *is, NbtJsonMode mode,
+                                        GCancellable *cancellable,
+                                        GError **error);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_JSON_H
@@ -0,0 +1,305 @@
+/*  nbt_packed - Packed long array part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_packed.h"
+#include "nbt_private.h"
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/* Every loop is expanded for each width, so the shifts and the masks are
+ * constants and the inner loops are unrolled */
+#define FOR_EACH_BITS(CASE)                                                   \
+  CASE (1)                                                                    \
+  CASE (2)                                                                    \
+  CASE (3)                                                                    \
+  CASE (4)                                                                    \
+  CASE (5)                                                                    \
+  CASE (6)                                                                    \
+  CASE (7)                                                                    \
+  CASE (8)                                                                    \
+  CASE (9)                                                                    \
+  CASE (10)                                                                   \
+  CASE (11)                                                                   \
+  CASE (12)                                                                   \
+  CASE (13)                                                                   \
+  CASE (14)                                                                   \
+  CASE (15)                                                                   \
+  CASE (16)
+
+#define MASK(bits) ((G_GUINT64_CONSTANT (1) << (bits)) - 1)
+
+gsize
+nbt_packed_length (gsize n_entries, int bits, NbtPackedLayout layout)
+{
+  g_return_val_if_fail (bits >= 1 && bits <= 16, 0);
+  if (layout == NBT_PACKED_ALIGNED)
+    {
+      int per_long = 64 / bits;
+      return (n_entries + per_long - 1) / per_long;
+    }
+  return (n_entries * bits + 63) / 64;
+}
+
+int
+nbt_packed_bits_for (guint palette_len, int min_bits)
+{
+  int bits = min_bits;
+  while (bits < 16 && (G_GUINT64_CONSTANT (1) << bits) < palette_len)
+    bits++;
+  return bits;
+}
+
+static inline void
+decode_aligned_with (const guint64 *longs, guint16 *entries,
+                     gsize n_entries, gsize first_long, int bits)
+{
+  int per_long = 64 / bits;
+  gsize n_full = n_entries / per_long;
+  for (gsize i = first_long; i < n_full; i++)
+    {
+      guint64 value = longs[i];
+      guint16 *out = entries + i * per_long;
+      for (int j = 0; j < per_long; j++)
+        out[j] = (value >> (j * bits)) & MASK (bits);
+    }
+  gsize done = MAX (n_full, first_long) * per_long;
+  for (gsize i = done; i < n_entries; i++)
+    entries[i] = (longs[i / per_long] >> (i % per_long * bits)) & MASK (bits);
+}
+
+#ifdef __AVX2__
+/* A long is broadcast to 16 lanes shifted by their own counts, then the low
+ * 16 bits of the lanes are gathered in order and stored at once. The lanes
+ * past the entries of the long are overwritten by the next one. */
+static gsize
+decode_aligned_avx2 (const guint64 *longs, guint16 *entries,
+                     gsize n_entries, int bits)
+{
+  int per_long = 64 / bits;
+  __m256i mask = _mm256_set1_epi64x (MASK (bits));
+  __m256i shifts[4];
+  __m256i gather[4];
+  for (int k = 0; k < 4; k++)
+    {
+      shifts[k]
+          = _mm256_setr_epi64x (4 * k * bits, (4 * k + 1) * bits,
+                                (4 * k + 2) * bits, (4 * k + 3) * bits);
+      /* The lanes of the k-th vector go to the k-th 32 bits of each half */
+      gint8 control[32];
+      memset (control, 0x80, sizeof (control));
+      for (int half = 0; half < 2; half++)
+        {
+          control[half * 16 + 4 * k] = 0;
+          control[half * 16 + 4 * k + 1] = 1;
+          control[half * 16 + 4 * k + 2] = 8;
+          control[half * 16 + 4 * k + 3] = 9;
+        }
+      gather[k] = _mm256_loadu_si256 ((const __m256i *)control);
+    }
+  /* The first half holds the entries 0, 1, 4, 5..., the second 2, 3, 6,
+   * 7... */
+  __m256i order = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+
+  gsize i = 0;
+  for (; i * per_long + 16 <= n_entries; i++)
+    {
+      __m256i value = _mm256_set1_epi64x (longs[i]);
+      __m256i packed = _mm256_setzero_si256 ();
+      for (int k = 0; k < 4; k++)
+        {
+          __m256i lanes = _mm256_and_si256 (
+              _mm256_srlv_epi64 (value, shifts[k]), mask);
+          packed = _mm256_or_si256 (packed,
+                                    _mm256_shuffle_epi8 (lanes, gather[k]));
+        }
+      packed = _mm256_permutevar8x32_epi32 (packed, order);
+      _mm256_storeu_si256 ((__m256i *)(entries + i * per_long), packed);
+    }
+  return i;
+}
+#endif
+
+static void
+decode_aligned (const guint64 *longs, guint16 *entries, gsize n_entries,
+                int bits)
+{
+  gsize first_long = 0;
+#ifdef __AVX2__
+  /* Fewer bits put more than 16 entries in a long */
+  if (bits >= 4)
+    first_long = decode_aligned_avx2 (longs, entries, n_entries, bits);
+#endif
+  switch (bits)
+    {
+#define CASE(b)                                                               \
+  case b:                                                                     \
+    decode_aligned_with (longs, entries, n_entries, first_long, b);           \
+    break;
+      FOR_EACH_BITS (CASE)
+#undef CASE
+    }
+}
+
+static inline void
+decode_spanning_with (const guint64 *longs, guint16 *entries,
+                      gsize n_entries, int bits)
+{
+  gsize bit = 0;
+  for (gsize i = 0; i < n_entries; i++, bit += bits)
+    {
+      gsize index = bit / 64;
+      int offset = bit % 64;
+      guint64 value = longs[index] >> offset;
+      if (offset + bits > 64)
+        value |= longs[index + 1] << (64 - offset);
+      entries[i] = value & MASK (bits);
+    }
+}
+
+static void
+decode_spanning (const guint64 *longs, guint16 *entries, gsize n_entries,
+                 int bits)
+{
+  switch (bits)
+    {
+#define CASE(b)                                                               \
+  case b:                                                                     \
+    decode_spanning_with (longs, entries, n_entries, b);                      \
+    break;
+      FOR_EACH_BITS (CASE)
+#undef CASE
+    }
+}
+
+gboolean
+nbt_packed_decode (const gint64 *longs, gsize n_longs, int bits,
+                   NbtPackedLayout layout, guint16 *entries, gsize n_entries)
+{
+  g_return_val_if_fail (bits >= 1 && bits <= 16, FALSE);
+  g_return_val_if_fail ((longs || !n_longs) && (entries || !n_entries),
+                        FALSE);
+  if (n_longs < nbt_packed_length (n_entries, bits, layout))
+    return FALSE;
+  if (layout == NBT_PACKED_ALIGNED)
+    decode_aligned ((const guint64 *)longs, entries, n_entries, bits);
+  else
+    decode_spanning ((const guint64 *)longs, entries, n_entries, bits);
+  return TRUE;
+}
+
+static inline void
+encode_aligned_with (const guint16 *entries, gsize n_entries,
+                     guint64 *longs, int bits)
+{
+  int per_long = 64 / bits;
+  gsize n_full = n_entries / per_long;
+  for (gsize i = 0; i < n_full; i++)
+    {
+      const guint16 *in = entries + i * per_long;
+      guint64 value = 0;
+      for (int j = 0; j < per_long; j++)
+        value |= (in[j] & MASK (bits)) << (j * bits);
+      longs[i] = value;
+    }
+  if (n_full * per_long < n_entries)
+    {
+      guint64 value = 0;
+      for (gsize i = n_full * per_long; i < n_entries; i++)
+        value |= (entries[i] & MASK (bits)) << (i % per_long * bits);
+      longs[n_full] = value;
+    }
+}
+
+static inline void
+encode_spanning_with (const guint16 *entries, gsize n_entries,
+                      guint64 *longs, int bits)
+{
+  memset (longs, 0, nbt_packed_length (n_entries, bits, NBT_PACKED_SPANNING)
+                        * sizeof (guint64));
+  gsize bit = 0;
+  for (gsize i = 0; i < n_entries; i++, bit += bits)
+    {
+      gsize index = bit / 64;
+      int offset = bit % 64;
+      guint64 value = entries[i] & MASK (bits);
+      longs[index] |= value << offset;
+      if (offset + bits > 64)
+        longs[index + 1] |= value >> (64 - offset);
+    }
+}
+
+void
+nbt_packed_encode (const guint16 *entries, gsize n_entries, int bits,
+                   NbtPackedLayout layout, gint64 *longs)
+{
+  g_return_if_fail (bits >= 1 && bits <= 16);
+  g_return_if_fail ((entries && longs) || !n_entries);
+  switch (bits)
+    {
+#define CASE(b)                                                               \
+  case b:                                                                     \
+    if (layout == NBT_PACKED_ALIGNED)                                         \
+      encode_aligned_with (entries, n_entries, (guint64 *)longs, b);          \
+    else                                                                      \
+      encode_spanning_with (entries, n_entries, (guint64 *)longs, b);         \
+    break;
+      FOR_EACH_BITS (CASE)
+#undef CASE
+    }
+}
+
+gboolean
+nbt_node_get_packed (const NbtNode *node, int bits, NbtPackedLayout layout,
+                     guint16 *entries, gsize n_entries)
+{
+  if (!node)
+    return FALSE;
+  NbtData *data = node->data;
+  if (data->type != TAG_Long_Array)
+    return FALSE;
+  return nbt_packed_decode (data->value_a.value, data->value_a.len, bits,
+                            layout, entries, n_entries);
+}
+
+gboolean
+nbt_node_set_packed (NbtNode *node, const guint16 *entries, gsize n_entries,
+                     int bits, NbtPackedLayout layout)
+{
+  g_return_val_if_fail (node && bits >= 1 && bits <= 16, FALSE);
+  NbtData *data = node->data;
+  if (data->type != TAG_Long_Array)
+    return FALSE;
+  gsize n_longs = nbt_packed_length (n_entries, bits, layout);
+  g_return_val_if_fail (n_longs <= G_MAXINT32, FALSE);
+
+  /* Reuse the array unless it's shared with another tree */
+  if (data->value_a.len != n_longs
+      || ((data->flags & NBT_DATA_SHARED_VALUE)
+          && !nbt_payload_is_unique (data->value_a.value)))
+    {
+      gint64 *longs = g_new (gint64, n_longs);
+      nbt_data_free_value (data);
+      data->value_a.value = longs;
+      data->value_a.len = n_longs;
+    }
+  nbt_packed_encode (entries, n_entries, bits, layout, data->value_a.value);
+  return TRUE;
+}
@@ -0,0 +1,110 @@
+/*  nbt_packed - Packed long array part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_PACKED_H
+#define DHLRC_NBT_PACKED_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The layout of the indices packed into a long array, like the
+ * block states, the biomes and the heightmaps of a chunk.
+ *
+ * The first index is in the lowest bits of the first long in both layouts.
+ */
+typedef enum NbtPackedLayout
+{
+  /** Since 1.16, an index never spans two longs, the high bits left over
+   * in a long are unused */
+  NBT_PACKED_ALIGNED,
+  /** Before 1.16, the indices are packed without gaps and can span two
+   * longs */
+  NBT_PACKED_SPANNING,
+} NbtPackedLayout;
+
+/**
+ * @brief Get the count of the longs needed to pack the indices.
+ * @param n_entries The count of the indices
+ * @param bits The bits per index, from 1 to 16
+ * @param layout The layout
+ * @return The count of the longs
+ */
+gsize nbt_packed_length (gsize n_entries, int bits, NbtPackedLayout layout);
+/**
+ * @brief Get the bits per index the game uses for a palette.
+ * @param palette_len The length of the palette
+ * @param min_bits The least bits, 4 for the block states and 1 for the
+ * biomes
+ * @return The bits per index
+ */
+int nbt_packed_bits_for (guint palette_len, int min_bits);
+
+/**
+ * @brief Unpack the indices from the long array.
+ * @param longs The packed longs
+ * @param n_longs The count of the longs
+ * @param bits The bits per index, from 1 to 16
+ * @param layout The layout
+ * @param entries The indices to fill
+ * @param n_entries The count of the indices
+ * @return FALSE if the longs are fewer than `nbt_packed_length` needs
+ */
+gboolean nbt_packed_decode (const gint64 *longs, gsize n_longs, int bits,
+                            NbtPackedLayout layout, guint16 *entries,
+                            gsize n_entries);
+/**
+ * @brief Pack the indices into the long array.
+ *
+ * The bits above `bits` of every index are dropped and the unused bits of
+ * the longs are zero.
+ * @param entries The indices
+ * @param n_entries The count of the indices
+ * @param bits The bits per index, from 1 to 16
+ * @param layout The layout
+ * @param longs The longs to fill, at least `nbt_packed_length` of them
+ */
+void nbt_packed_encode (const guint16 *entries, gsize n_entries, int bits,
+                        NbtPackedLayout layout, gint64 *longs);
+
+/**
+ * @brief Unpack the indices from the long array node, without copying it.
+ * @param node The long array node
+ * @sa nbt_packed_decode
+ * @return FALSE if the node isn't a long array or is too short
+ */
+gboolean nbt_node_get_packed (const NbtNode *node, int bits,
+                              NbtPackedLayout layout, guint16 *entries,
+                              gsize n_entries);
+/**
+ * @brief Pack the indices into the long array node.
+ *
+ * The array of the node is reused when it has the right length and isn't
+ * shared, or replaced.
+ * @param node The long array node
+ * @sa nbt_packed_encode
+ * @return FALSE if the node isn't a long array
+ */
+gboolean nbt_node_set_packed (NbtNode *node, const guint16 *entries,
+                              gsize n_entries, int bits,
+                              NbtPackedLayout layout);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_PACKED_H
@@ -17,8 +17,11 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
 #include "nbt_parse.h"
+#include "nbt_pool.h"
+#include "nbt_private.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <zlib.h>
 
 #ifndef NBT_GLIB_DISABLE_TRANSLATION
@@ -29,7 +32,7 @@
 #endif
 
 /* Since the macro's `-` will be formatted, we use the expanded function */
-static GQuark
+GQuark
 nbt_glib_parse_error_quark (void)
 {
   static GQuark q;
@@ -70,40 +73,411 @@ typedef struct NBT_Buffer
   uint8_t *data;
   size_t len;
   size_t pos;
+  NbtParseFlags flags;
 } NBT_Buffer;
 
-static void
-nbt_data_free (NbtNode *node)
+/* Count an allocation kept by the tree */
+#define stats_alloc(stats, size)                                              \
+  G_STMT_START                                                                \
+  {                                                                           \
+    if (stats)                                                                \
+      {                                                                       \
+        (stats)->n_allocs++;                                                  \
+        (stats)->alloc_bytes += (size);                                       \
+      }                                                                       \
+  }                                                                           \
+  G_STMT_END
+
+/* The header of the reference counted payloads, the payload follows it
+ * with the alignment of the 64-bit integers */
+typedef struct NbtPayload
+{
+  gint ref_count;
+  gint padding;
+} NbtPayload;
+
+G_STATIC_ASSERT (sizeof (NbtPayload) == 8);
+
+#define PAYLOAD_HEADER(payload) ((NbtPayload *)(payload) - 1)
+
+gpointer
+nbt_payload_new (gconstpointer data, gsize size)
+{
+  NbtPayload *header = g_malloc (sizeof (NbtPayload) + size);
+  header->ref_count = 1;
+  header->padding = 0;
+  if (size)
+    memcpy (header + 1, data, size);
+  return header + 1;
+}
+
+gpointer
+nbt_payload_ref (gpointer payload)
+{
+  g_atomic_int_inc (&PAYLOAD_HEADER (payload)->ref_count);
+  return payload;
+}
+
+void
+nbt_payload_unref (gpointer payload)
+{
+  if (g_atomic_int_dec_and_test (&PAYLOAD_HEADER (payload)->ref_count))
+    g_free (PAYLOAD_HEADER (payload));
+}
+
+gboolean
+nbt_payload_is_unique (gpointer payload)
+{
+  return g_atomic_int_get (&PAYLOAD_HEADER (payload)->ref_count) == 1;
+}
+
+void
+nbt_data_free_key (NbtData *data)
+{
+  if (data->key && (data->flags & NBT_DATA_SHARED_KEY))
+    nbt_payload_unref (data->key);
+  else if (data->key && !(data->flags & NBT_DATA_INLINE_KEY))
+    nbt_part_free (data->key, strlen (data->key) + 1,
+                   data->flags & NBT_DATA_CUSTOM_KEY);
+  data->key = NULL;
+  data->flags &= ~(NBT_DATA_SHARED_KEY | NBT_DATA_INLINE_KEY
+                   | NBT_DATA_CUSTOM_KEY);
+}
+
+void
+nbt_data_free_value (NbtData *data)
 {
-  NbtData *data = node->data;
-  if (data->key)
-    g_free (data->key);
   switch (data->type)
     {
+    case TAG_List:
+      if (!(data->flags & NBT_DATA_PACKED_LIST))
+        break;
+      /* fall through */
     case TAG_Byte_Array:
     case TAG_Long_Array:
     case TAG_Int_Array:
     case TAG_String:
-      if (data->value_a.value != NULL)
-        g_free (data->value_a.value);
+      if (data->value_a.value == NULL)
+        break;
+      if (data->flags & NBT_DATA_SHARED_VALUE)
+        nbt_payload_unref (data->value_a.value);
+      else if (!(data->flags & NBT_DATA_INLINE_VALUE))
+        nbt_part_free (data->value_a.value,
+                       data->type == TAG_String
+                           ? strlen (data->value_a.value) + 1
+                           : 0,
+                       data->flags & NBT_DATA_CUSTOM_VALUE);
+      data->value_a.value = NULL;
     default:
       break;
     }
-  g_free (data);
+  data->flags &= ~(NBT_DATA_SHARED_VALUE | NBT_DATA_INLINE_VALUE
+                   | NBT_DATA_CUSTOM_VALUE);
+}
+
+/* The children of a list are allocated in one block. Each element keeps
+ * the block, so the node and the data freed alone can find it, and the
+ * block is freed with the last of them */
+typedef struct NbtBlock
+{
+  gint ref_count;
+  guint32 flags;
+} NbtBlock;
+
+typedef struct NbtBlockElement
+{
+  NbtBlock *block;
+  GNode node;
+  NbtData data;
+} NbtBlockElement;
+
+static inline NbtBlock *
+node_block (GNode *node)
+{
+  return ((NbtBlockElement *)((char *)node
+                              - G_STRUCT_OFFSET (NbtBlockElement, node)))
+      ->block;
+}
+
+static inline NbtBlock *
+data_block (NbtData *data)
+{
+  return ((NbtBlockElement *)((char *)data
+                              - G_STRUCT_OFFSET (NbtBlockElement, data)))
+      ->block;
+}
+
+static void
+block_unref (NbtBlock *block, gint n)
+{
+  if (g_atomic_int_add (&block->ref_count, -n) == n)
+    nbt_part_free (block, 0, block->flags & NBT_DATA_CUSTOM);
+}
+
+/* The most children in a block. A list is read into as many blocks as it
+ * needs, each made once the previous one is filled, so a hostile length
+ * costs no more memory than the elements actually read, and the count of
+ * the block stays in its `gint` */
+#define NBT_BLOCK_MAX_ELEMENTS 4096
+
+/* Allocate `len` children of the list in one block and link them in order
+ * after `prev`, or first if it's NULL. The strings are kept inline in the
+ * space after each element */
+static NbtNode *
+block_new_children (NbtNode *node, NbtNode *prev, NBT_Tags tag,
+                    uint32_t len, NbtStats *stats)
+{
+  g_assert (len <= NBT_BLOCK_MAX_ELEMENTS);
+  gsize stride = sizeof (NbtBlockElement)
+                 + (tag == TAG_String ? NBT_DATA_INLINE_MAX : 0);
+  gsize size = sizeof (NbtBlock) + (gsize)len * stride;
+  guint32 flags = 0;
+  NbtBlock *block = nbt_part_alloc (size, &flags, NBT_DATA_CUSTOM);
+  stats_alloc (stats, size);
+  block->ref_count = 2 * len;
+  block->flags = flags;
+  char *p = (char *)(block + 1);
+  NbtNode *first = &((NbtBlockElement *)p)->node;
+  if (prev)
+    prev->next = first;
+  else
+    node->children = first;
+  for (uint32_t i = 0; i < len; i++, p += stride)
+    {
+      NbtBlockElement *element = (NbtBlockElement *)p;
+      element->block = block;
+      element->data = (NbtData){ .type = tag,
+                                 .flags = NBT_DATA_IN_BLOCK
+                                          | NBT_DATA_NODE_IN_BLOCK };
+      element->node = (GNode){ .data = &element->data,
+                               .prev = prev,
+                               .parent = node };
+      if (i)
+        prev->next = &element->node;
+      prev = &element->node;
+    }
+  return first;
+}
+
+static void
+nbt_data_free (NbtNode *node)
+{
+  NbtData *data = node->data;
+  /* With the inline texts, before they're freed */
+  gsize size = sizeof (NbtData);
+  if (data->flags & NBT_DATA_INLINE_KEY)
+    size += strlen (data->key) + 1;
+  if (data->flags & NBT_DATA_INLINE_VALUE)
+    size += strlen (data->value_a.value) + 1;
+  nbt_data_free_key (data);
+  nbt_data_free_value (data);
+  if (data->flags & NBT_DATA_IN_BLOCK)
+    block_unref (data_block (data), 1);
+  else
+    nbt_part_free (data, size, data->flags & NBT_DATA_CUSTOM);
 }
 
 void
 nbt_node_free (NbtNode *node)
 {
+  /* Go down to the first leaf, free it, and go on with its next sibling or
+   * its parent, which is a leaf once its last child is freed. The walk
+   * ends back at the parent of the given node */
+  NbtNode *top = node ? node->parent : NULL;
   while (node)
     {
-      GNode *next = node->next;
       if (node->children)
-        nbt_node_free (node->children);
+        {
+          node = node->children;
+          continue;
+        }
+      NbtNode *next = node->next;
+      NbtNode *parent = node->parent;
+      guint32 flags = ((NbtData *)node->data)->flags;
       nbt_data_free (node);
-      g_slice_free (GNode, node);
-      node = next;
+      if (flags & NBT_DATA_NODE_IN_BLOCK)
+        block_unref (node_block (node), 1);
+      else if (flags & NBT_DATA_NODE_CUSTOM)
+        nbt_allocator_free (node);
+      else
+        nbt_pool_node_free (node);
+      if (next)
+        node = next;
+      else if (parent != top)
+        {
+          parent->children = NULL;
+          node = parent;
+        }
+      else
+        node = NULL;
+    }
+}
+
+/* Count the key or the value, with the header of its payload or of its
+ * allocator */
+static void
+usage_add_part (NbtMemoryUsage *usage, guint64 *field, gpointer part,
+                gsize size, gboolean shared, gboolean custom)
+{
+  *field += size;
+  if (shared)
+    {
+      usage->overhead += sizeof (NbtPayload);
+      if (!nbt_payload_is_unique (part))
+        usage->shared += sizeof (NbtPayload) + size;
     }
+  else if (custom)
+    usage->overhead += NBT_ALLOCATOR_HEADER_SIZE;
+}
+
+static void
+usage_add_node (NbtMemoryUsage *usage, const NbtNode *node)
+{
+  NbtData *data = node->data;
+  guint32 flags = data->flags;
+  usage->nodes += sizeof (GNode);
+  usage->data += sizeof (NbtData);
+  if (flags & NBT_DATA_NODE_CUSTOM)
+    usage->overhead += NBT_ALLOCATOR_HEADER_SIZE;
+  if (flags & NBT_DATA_CUSTOM)
+    usage->overhead += NBT_ALLOCATOR_HEADER_SIZE;
+  if (flags & NBT_DATA_IN_BLOCK)
+    {
+      usage->overhead += sizeof (NbtBlock *);
+      /* The room kept for the inline string, used or not */
+      if (data->type == TAG_String)
+        usage->overhead += NBT_DATA_INLINE_MAX;
+    }
+  if (data->key)
+    {
+      gsize size = strlen (data->key) + 1;
+      usage_add_part (usage, &usage->keys, data->key, size,
+                      flags & NBT_DATA_SHARED_KEY,
+                      flags & NBT_DATA_CUSTOM_KEY);
+    }
+  guint64 *field;
+  gsize size;
+  switch (data->type)
+    {
+    case TAG_String:
+      if (!data->value_a.value)
+        return;
+      field = &usage->strings;
+      size = strlen (data->value_a.value) + 1;
+      if ((flags & NBT_DATA_IN_BLOCK) && (flags & NBT_DATA_INLINE_VALUE))
+        usage->overhead -= size;
+      break;
+    case TAG_Byte_Array:
+      field = &usage->byte_arrays;
+      size = data->value_a.len;
+      break;
+    case TAG_Int_Array:
+      field = &usage->int_arrays;
+      size = (gsize)data->value_a.len * 4;
+      break;
+    case TAG_Long_Array:
+      field = &usage->long_arrays;
+      size = (gsize)data->value_a.len * 8;
+      break;
+    case TAG_List:
+      if (!nbt_data_is_packed_list (data))
+        return;
+      field = &usage->packed_lists;
+      size = (gsize)data->value_a.len
+             * nbt_reader_scalar_size (nbt_data_list_type (data));
+      break;
+    default:
+      return;
+    }
+  if (data->value_a.value)
+    usage_add_part (usage, field, data->value_a.value, size,
+                    flags & NBT_DATA_SHARED_VALUE,
+                    flags & NBT_DATA_CUSTOM_VALUE);
+}
+
+guint64
+nbt_node_memory_usage (const NbtNode *node, NbtMemoryUsage *usage)
+{
+  NbtMemoryUsage local = { 0 };
+  g_return_val_if_fail (node, 0);
+  /* Walk the subtree by its links, like `nbt_node_free` */
+  const NbtNode *current = node;
+  while (TRUE)
+    {
+      usage_add_node (&local, current);
+      if (current->children)
+        {
+          current = current->children;
+          continue;
+        }
+      while (current != node && !current->next)
+        current = current->parent;
+      if (current == node)
+        break;
+      current = current->next;
+    }
+  if (usage)
+    *usage = local;
+  return local.nodes + local.data + local.keys + local.strings
+         + local.byte_arrays + local.int_arrays + local.long_arrays
+         + local.packed_lists + local.overhead;
+}
+
+/* The trees waiting for the reaper thread. `nbt_node_free_flush` takes the
+ * count of the trees queued so far and waits for the count of the freed
+ * ones to reach it, the trees queued later aren't waited for */
+static GAsyncQueue *reaper_queue;
+static GMutex reaper_mutex;
+static GCond reaper_cond;
+static guint64 reaper_queued;
+static guint64 reaper_freed;
+
+static gpointer
+reaper_thread (gpointer data)
+{
+  GAsyncQueue *queue = data;
+  while (TRUE)
+    {
+      NbtNode *node = g_async_queue_pop (queue);
+      nbt_node_free (node);
+      /* The pool of this thread would only grow, no parse takes from it */
+      if (g_async_queue_length (queue) <= 0)
+        nbt_pool_trim ();
+      g_mutex_lock (&reaper_mutex);
+      reaper_freed++;
+      g_cond_broadcast (&reaper_cond);
+      g_mutex_unlock (&reaper_mutex);
+    }
+  return NULL;
+}
+
+void
+nbt_node_free_deferred (NbtNode *node)
+{
+  if (!node)
+    return;
+  g_node_unlink (node);
+  if (g_once_init_enter (&reaper_queue))
+    {
+      GAsyncQueue *queue = g_async_queue_new ();
+      g_thread_unref (g_thread_new ("nbt-reaper", reaper_thread, queue));
+      g_once_init_leave (&reaper_queue, queue);
+    }
+  /* Pushed with the lock, so the trees are freed in the order counted */
+  g_mutex_lock (&reaper_mutex);
+  reaper_queued++;
+  g_async_queue_push (reaper_queue, node);
+  g_mutex_unlock (&reaper_mutex);
+}
+
+void
+nbt_node_free_flush (void)
+{
+  g_mutex_lock (&reaper_mutex);
+  guint64 ticket = reaper_queued;
+  while (reaper_freed < ticket)
+    g_cond_wait (&reaper_cond, &reaper_mutex);
+  g_mutex_unlock (&reaper_mutex);
 }
 
 static int
@@ -185,37 +559,100 @@ LIBNBT_getDouble (NBT_Buffer *buffer, double *result)
   return 8;
 }
 
-static int
-LIBNBT_getKey (NBT_Buffer *buffer, char **result)
+/* The bytes kept after the data for a key or a string of `len` bytes, 0
+ * when there's none or it's allocated apart */
+static gsize
+inline_text_size (const char *text, gsize len)
+{
+  return text && len < NBT_DATA_INLINE_MAX ? len + 1 : 0;
+}
+
+/* Put the key and the string into the data, the short ones after it where
+ * the room was left for them */
+static void
+data_set_texts (NbtData *data, const char *key, gsize key_len,
+                const char *string, gsize string_len, NbtStats *stats)
 {
-  uint16_t len;
-  if (!LIBNBT_getUint16 (buffer, &len))
+  char *tail = (char *)(data + 1);
+  if (inline_text_size (key, key_len))
     {
-      return 0;
+      memcpy (tail, key, key_len);
+      tail[key_len] = 0;
+      data->key = tail;
+      data->flags |= NBT_DATA_INLINE_KEY;
+      tail += key_len + 1;
     }
-  if (len == 0)
+  else if (key)
     {
-      *result = 0;
-      return 2;
+      data->key
+          = nbt_part_alloc (key_len + 1, &data->flags, NBT_DATA_CUSTOM_KEY);
+      memcpy (data->key, key, key_len);
+      data->key[key_len] = 0;
+      stats_alloc (stats, key_len + 1);
     }
-  if (buffer->pos + len > buffer->len)
+  if (inline_text_size (string, string_len))
     {
-      return 0;
+      memcpy (tail, string, string_len);
+      tail[string_len] = 0;
+      data->value_a.value = tail;
+      data->flags |= NBT_DATA_INLINE_VALUE;
+    }
+  else if (string)
+    {
+      char *value = nbt_part_alloc (string_len + 1, &data->flags,
+                                    NBT_DATA_CUSTOM_VALUE);
+      memcpy (value, string, string_len);
+      value[string_len] = 0;
+      data->value_a.value = value;
+      stats_alloc (stats, string_len + 1);
     }
-  *result = g_malloc (len + 1);
-  memcpy (*result, buffer->data + buffer->pos, len);
-  (*result)[len] = 0;
-  buffer->pos += len;
-  return 2 + len;
 }
 
-static NbtNode *
-create_nbt (NBT_Tags tag)
+NbtData *
+nbt_data_new_full (NBT_Tags tag, const char *key, gsize key_len,
+                   const char *string, gsize string_len, NbtStats *stats)
+{
+  gsize tail_size = inline_text_size (key, key_len)
+                    + inline_text_size (string, string_len);
+  guint32 flags = 0;
+  NbtData *data = nbt_part_alloc (sizeof (NbtData) + tail_size, &flags,
+                                  NBT_DATA_CUSTOM);
+  *data = (NbtData){ .type = tag, .flags = flags };
+  stats_alloc (stats, sizeof (NbtData) + tail_size);
+  data_set_texts (data, key, key_len, string, string_len, stats);
+  return data;
+}
+
+NbtData *
+nbt_data_new (NBT_Tags tag, const char *key, const char *string)
 {
-  NbtData *data = g_new0 (NbtData, 1);
-  data->type = tag;
-  NbtNode *root = g_node_new (data);
-  return root;
+  NbtData *data = nbt_data_new_full (tag, key, key ? strlen (key) : 0,
+                                     string, string ? strlen (string) : 0,
+                                     NULL);
+  if (tag == TAG_String)
+    data->value_a.len = 1;
+  return data;
+}
+
+NbtNode *
+nbt_node_create (NBT_Tags tag)
+{
+  guint32 flags = 0;
+  NbtData *data = nbt_part_alloc (sizeof (NbtData), &flags, NBT_DATA_CUSTOM);
+  *data = (NbtData){ .type = tag, .flags = flags };
+  return nbt_node_new_for_data (data);
+}
+
+NbtNode *
+nbt_node_new_for_data (NbtData *data)
+{
+  NbtAllocator *allocator = nbt_allocator_get_thread_default ();
+  if (!allocator)
+    return nbt_pool_node_new (data);
+  GNode *node = nbt_allocator_alloc (allocator, sizeof (GNode));
+  *node = (GNode){ .data = data };
+  data->flags |= NBT_DATA_NODE_CUSTOM;
+  return node;
 }
 
 static NBT_Buffer *
@@ -227,9 +664,48 @@ init_buffer (uint8_t *data, int length)
   buffer->data = data;
   buffer->len = length;
   buffer->pos = 0;
+  buffer->flags = NBT_PARSE_FLAGS_NONE;
   return buffer;
 }
 
+/* Read the numbers of the list into one array in the host order */
+static gboolean
+parse_packed_list (NbtData *data, NBT_Buffer *buffer, NBT_Tags list_type,
+                   uint32_t len, NbtStats *stats)
+{
+  gsize size = nbt_reader_scalar_size (list_type);
+  if ((guint64)len * size > buffer->len - buffer->pos)
+    return FALSE;
+  guint8 *value = nbt_part_alloc ((gsize)len * size, &data->flags,
+                                  NBT_DATA_CUSTOM_VALUE);
+  memcpy (value, buffer->data + buffer->pos, (gsize)len * size);
+  buffer->pos += (gsize)len * size;
+  switch (size)
+    {
+    case 2:
+      for (uint32_t i = 0; i < len; i++)
+        ((guint16 *)value)[i] = bswap_16 (((guint16 *)value)[i]);
+      break;
+    case 4:
+      for (uint32_t i = 0; i < len; i++)
+        ((guint32 *)value)[i] = bswap_32 (((guint32 *)value)[i]);
+      break;
+    case 8:
+      for (uint32_t i = 0; i < len; i++)
+        ((guint64 *)value)[i] = bswap_64 (((guint64 *)value)[i]);
+      break;
+    default:
+      break;
+    }
+  data->value_a.value = value;
+  data->value_a.len = len;
+  data->flags |= NBT_DATA_PACKED_LIST | list_type << NBT_DATA_LIST_TYPE_SHIFT;
+  if (stats)
+    stats->n_nodes[list_type] += len;
+  stats_alloc (stats, (gsize)len * size);
+  return TRUE;
+}
+
 static int
 skip_len (const char *str)
 {
@@ -262,6 +738,10 @@ convert_string (const char *str, size_t len)
     {
       int skip_len_tmp = skip_len (str);
       guint16 c = 0;
+      /* The continuation bytes might be cut by the end */
+      for (int j = 1; j < skip_len_tmp; j++)
+        if ((str[j] & 0xc0) != 0x80)
+          skip_len_tmp = 0;
       if (skip_len_tmp == 1)
         c = (guint8)*str;
       else if (skip_len_tmp == 2)
@@ -281,20 +761,70 @@ convert_string (const char *str, size_t len)
   return utf8;
 }
 
+/* Read the modified UTF-8 text of `len` bytes. The ASCII text, which is
+ * the common case, is given in place, the other text is converted into
+ * `owned` */
+static gboolean
+read_text (NBT_Buffer *buffer, gsize len, const char **text, gsize *text_len,
+           char **owned)
+{
+  const char *raw = (const char *)buffer->data + buffer->pos;
+  gsize i = 0;
+  while (i < len && (gint8)raw[i] > 0)
+    i++;
+  *owned = NULL;
+  if (i < len)
+    {
+      char *copy = g_strndup (raw, len);
+      *owned = convert_string (copy, strlen (copy));
+      g_free (copy);
+      if (!*owned)
+        return FALSE;
+      raw = *owned;
+      i = strlen (*owned);
+    }
+  *text = raw;
+  *text_len = i;
+  buffer->pos += len;
+  return TRUE;
+}
+
+/* The least bytes a value of the tag takes in the list */
+static gsize
+min_value_size (NBT_Tags tag)
+{
+  gsize size = nbt_reader_scalar_size (tag);
+  if (size)
+    return size;
+  switch (tag)
+    {
+    case TAG_String:
+      return 2;
+    case TAG_List:
+      return 5;
+    case TAG_Compound:
+      return 1;
+    default:
+      return 4;
+    }
+}
+
+/* Parse a value into `*nodep`. The node of a list element is made with its
+ * block, any other node is made here once its key and string are read, so
+ * its data is allocated at its final size */
 static int
-parse_value (NbtNode *node, NBT_Buffer *buffer, uint8_t skipkey,
-             DhProgressFullSet set_func, void *main_klass,
-             GCancellable *cancellable, int min, int max, clock_t start_time,
-             GError **err)
+parse_value (NbtNode **nodep, NBT_Tags tag, NBT_Buffer *buffer,
+             uint8_t skipkey, int depth, NbtProgress *progress,
+             NbtStats *stats, GError **err)
 {
-  if (!node || !buffer || !buffer->data)
+  if (!nodep || !buffer || !buffer->data)
     {
       g_set_error_literal (
           err, NBT_GLIB_PARSE_ERROR, NBT_GLIB_PARSE_ERROR_INTERNAL,
           _ ("Some internal error happened, which is not your fault."));
       return 1;
     }
-  if (g_cancellable_is_cancelled (cancellable))
+  if (!nbt_progress_set (progress, buffer->pos))
     {
       g_set_error_literal (err, NBT_GLIB_PARSE_ERROR,
                            NBT_GLIB_PARSE_ERROR_CANCELLED,
@@ -302,59 +832,93 @@ parse_value (NbtNode *node, NBT_Buffer *buffer, uint8_t skipkey,
       return 1;
     }
 
-  if (set_func && main_klass)
+  if (tag == TAG_End && !LIBNBT_getUint8 (buffer, (uint8_t *)&tag))
     {
-      clock_t passed_ms = 1000 * (clock () - start_time) / CLOCKS_PER_SEC;
-      if (passed_ms % 500 == 0)
-        set_func (main_klass, min + buffer->pos * (max - min) / buffer->len,
-                  _ ("Parsing NBT file to NBT node tree."));
+      g_set_error_literal (err, NBT_GLIB_PARSE_ERROR,
+                           NBT_GLIB_PARSE_ERROR_INTERRUPTED,
+                           _ ("Couldn't get the type after the End type."));
+      return 1;
     }
-
-  NbtData *data = node->data;
-  NBT_Tags tag = data->type;
-  if (tag == TAG_End)
+  /* The tags of the children of compounds come from the data too, and
+   * index the statistics */
+  if (!isValidTag (tag))
     {
-      if (!LIBNBT_getUint8 (buffer, (uint8_t *)&tag))
-        {
-          g_set_error_literal (
-              err, NBT_GLIB_PARSE_ERROR, NBT_GLIB_PARSE_ERROR_INTERRUPTED,
-              _ ("Couldn't get the type after the End type."));
-          return 1;
-        }
-      if (!isValidTag (tag))
-        {
-          g_set_error_literal (err, NBT_GLIB_PARSE_ERROR,
-                               NBT_GLIB_PARSE_ERROR_INVALID_TAG,
-                               _ ("The tag is invalid."));
-          return 1;
-        }
-      data->type = tag;
+      g_set_error_literal (err, NBT_GLIB_PARSE_ERROR,
+                           NBT_GLIB_PARSE_ERROR_INVALID_TAG,
+                           _ ("The tag is invalid."));
+      return 1;
+    }
+  if (stats)
+    {
+      stats->n_nodes[tag]++;
+      stats->max_depth = MAX (stats->max_depth, depth);
     }
   const char *type = NULL;
+  const char *key = NULL;
+  gsize key_len = 0;
+  char *owned_key = NULL;
   if (!skipkey)
     {
-      char *key = NULL;
-      if (!LIBNBT_getKey (buffer, &key))
+      uint16_t len;
+      if (!LIBNBT_getUint16 (buffer, &len) || buffer->pos + len > buffer->len)
         {
           g_set_error_literal (err, NBT_GLIB_PARSE_ERROR,
                                NBT_GLIB_PARSE_ERROR_INTERRUPTED,
                                _ ("Couldn't get key."));
           return 1;
         }
-      char *new_key = NULL;
-      if (key)
+      /* The empty key is kept as NULL */
+      if (len && !read_text (buffer, len, &key, &key_len, &owned_key))
         {
-          new_key = convert_string (key, strlen (key));
-          g_free (key);
-          if (!new_key)
-            {
-              type = "key";
-              goto case_default;
-            }
+          type = "key";
+          goto case_default;
+        }
+    }
+  const char *string = NULL;
+  gsize string_len = 0;
+  char *owned_string = NULL;
+  uint16_t string_raw_len = 0;
+  if (tag == TAG_String)
+    {
+      if (!LIBNBT_getUint16 (buffer, &string_raw_len))
+        {
+          g_free (owned_key);
+          goto array_length_get_error;
+        }
+      if (buffer->pos + string_raw_len > buffer->len)
+        {
+          g_free (owned_key);
+          goto array_error;
+        }
+      /* The convertion of string might fail */
+      if (!read_text (buffer, string_raw_len, &string, &string_len,
+                      &owned_string))
+        {
+          g_free (owned_key);
+          type = _ ("string");
+          goto case_default;
         }
-      data->key = new_key;
     }
 
+  NbtData *data;
+  if (*nodep)
+    {
+      /* The element of a block has room for the string, and never a key */
+      data = (*nodep)->data;
+      data_set_texts (data, NULL, 0, string, string_len, stats);
+    }
+  else
+    {
+      data = nbt_data_new_full (tag, key, key_len, string, string_len,
+                                stats);
+      *nodep = nbt_node_new_for_data (data);
+      stats_alloc (stats, sizeof (GNode));
+    }
+  g_free (owned_key);
+  g_free (owned_string);
+  if (tag == TAG_String)
+    data->value_a.len = string_raw_len + 1;
+  NbtNode *node = *nodep;
   switch (tag)
     {
     case TAG_Byte:
@@ -431,35 +995,16 @@ parse_value (NbtNode *node, NBT_Buffer *buffer, uint8_t skipkey,
         data->value_a.len = len;
         if (buffer->pos + len > buffer->len)
           goto array_error;
-        data->value_a.value = g_new0 (uint8_t, len);
+        data->value_a.value
+            = nbt_part_alloc (len, &data->flags, NBT_DATA_CUSTOM_VALUE);
+        stats_alloc (stats, len);
         memcpy (data->value_a.value, buffer->data + buffer->pos, len);
         buffer->pos += len;
         break;
       }
     case TAG_String:
-      {
-        uint16_t len;
-        if (!LIBNBT_getUint16 (buffer, &len))
-          goto array_length_get_error;
-        data->value_a.len = len + 1;
-        if (buffer->pos + len > buffer->len)
-          goto array_error;
-        guint8 *value = g_new0 (uint8_t, len + 1);
-        memcpy (value, buffer->data + buffer->pos, len);
-        value[len] = 0;
-        char *new_value = convert_string (value, strlen (value));
-        /* The convertion of string might fail */
-        if (new_value == NULL)
-          {
-            g_free (value);
-            type = _ ("string");
-            goto case_default;
-          }
-        g_free (value);
-        data->value_a.value = new_value;
-        buffer->pos += len;
-        break;
-      }
+      /* Read with the key */
+      break;
     case TAG_List:
       {
         uint8_t list_type;
@@ -473,26 +1018,56 @@ parse_value (NbtNode *node, NBT_Buffer *buffer, uint8_t skipkey,
         uint32_t len;
         if (!LIBNBT_getUint32 (buffer, &len))
           goto array_length_get_error;
-        if (list_type == TAG_End && len != 0)
+        /* The type of an empty list isn't kept, any other one must be
+         * valid before it's used for the children */
+        if (len != 0 && !isValidTag (list_type))
           {
             g_set_error_literal (err, NBT_GLIB_PARSE_ERROR,
                                  NBT_GLIB_PARSE_ERROR_INVALID_TAG,
                                  _ ("The tag of the list is invalid."));
             return 1;
           }
-        NbtNode *last = NULL;
-        for (int i = 0; i < len; i++)
+        if ((buffer->flags & NBT_PARSE_PACK_LISTS) && len
+            && nbt_reader_scalar_size (list_type))
           {
-            NbtNode *child = create_nbt (list_type);
-            int ret = parse_value (child, buffer, 1, set_func, main_klass,
-                                   cancellable, min, max, start_time, err);
+            if (!parse_packed_list (data, buffer, list_type, len, stats))
+              goto array_error;
+            break;
+          }
+        if (len == 0)
+          break;
+        /* Refuse the length the rest of the data can't hold before
+         * allocating for it */
+        if (len > (buffer->len - buffer->pos) / min_value_size (list_type))
+          goto array_error;
+        NbtNode *child = NULL;
+        uint32_t end = 0;
+        for (uint32_t i = 0; i < len; i++)
+          {
+            if (i == end)
+              {
+                end += MIN (len - i, NBT_BLOCK_MAX_ELEMENTS);
+                child = block_new_children (node, child, list_type,
+                                            end - i, stats);
+              }
+            else
+              child = child->next;
+            int ret = parse_value (&child, list_type, buffer, 1, depth + 1,
+                                   progress, stats, err);
             if (ret)
               {
+                /* Keep the parsed children, drop the rest of the block */
+                NbtNode *rest = child->next;
+                if (child->prev)
+                  child->prev->next = NULL;
+                else
+                  node->children = NULL;
+                child->next = NULL;
                 nbt_node_free (child);
+                if (rest)
+                  block_unref (node_block (rest), 2 * (end - 1 - i));
                 return ret;
               }
-
-            last = g_node_insert_after (node, last, child);
           }
         break;
       }
@@ -509,12 +1084,13 @@ parse_value (NbtNode *node, NBT_Buffer *buffer, uint8_t skipkey,
               }
             if (list_type == 0)
               break;
-            NbtNode *child = create_nbt (list_type);
-            int ret = parse_value (child, buffer, 0, set_func, main_klass,
-                                   cancellable, min, max, start_time, err);
+            NbtNode *child = NULL;
+            int ret = parse_value (&child, list_type, buffer, 0, depth + 1,
+                                   progress, stats, err);
             if (ret)
               {
-                nbt_node_free (child);
+                if (child)
+                  nbt_node_free (child);
                 return ret;
               }
             last = g_node_insert_after (node, last, child);
@@ -527,9 +1103,11 @@ parse_value (NbtNode *node, NBT_Buffer *buffer, uint8_t skipkey,
         if (!LIBNBT_getUint32 (buffer, &len))
           goto array_length_get_error;
         data->value_a.len = len;
-        if (buffer->pos + len * 4 > buffer->len)
+        if ((guint64)len * 4 > buffer->len - buffer->pos)
           goto array_error;
-        data->value_a.value = g_new0 (uint32_t, len);
+        data->value_a.value = nbt_part_alloc (
+            (gsize)len * 4, &data->flags, NBT_DATA_CUSTOM_VALUE);
+        stats_alloc (stats, len * sizeof (uint32_t));
         memcpy (data->value_a.value, buffer->data + buffer->pos, len * 4);
         buffer->pos += len * 4;
         int i;
@@ -546,9 +1124,11 @@ parse_value (NbtNode *node, NBT_Buffer *buffer, uint8_t skipkey,
         if (!LIBNBT_getUint32 (buffer, &len))
           goto array_length_get_error;
         data->value_a.len = len;
-        if (buffer->pos + len * 8 > buffer->len)
+        if ((guint64)len * 8 > buffer->len - buffer->pos)
           goto array_error;
-        data->value_a.value = g_new0 (uint64_t, len);
+        data->value_a.value = nbt_part_alloc (
+            (gsize)len * 8, &data->flags, NBT_DATA_CUSTOM_VALUE);
+        stats_alloc (stats, len * sizeof (uint64_t));
         memcpy (data->value_a.value, buffer->data + buffer->pos, len * 8);
         buffer->pos += len * 8;
         int i;
@@ -577,102 +1157,187 @@ parse_value (NbtNode *node, NBT_Buffer *buffer, uint8_t skipkey,
   return 0;
 }
 
-NbtNode *
-nbt_node_new_opt (uint8_t *data, size_t length, GError **err,
-                  DhProgressFullSet set_func, void *klass,
-                  GCancellable *cancellable, int min, int max)
+/* Decompress `data` to a new buffer, returns NULL when failed or cancelled */
+static guint8 *
+inflate_data (const uint8_t *data, size_t length, GZlibCompressorFormat format,
+              size_t *out_len, NbtProgress *progress, NbtStats *stats,
+              GError **err)
 {
-  NBT_Buffer *buffer;
-  GZlibCompressorFormat format;
-  gboolean no_compression = FALSE;
-  /* Unzip data */
-  if (length > 1 && data[0] == 0x1f && data[1] == 0x8b)
-    /* File is Gzip */
-    format = G_ZLIB_COMPRESSOR_FORMAT_GZIP;
-  else if (data[0] == 0x78)
-    /* File is Zlib */
-    format = G_ZLIB_COMPRESSOR_FORMAT_ZLIB;
-  else
-    no_compression = TRUE;
+  GZlibDecompressor *decompressor = g_zlib_decompressor_new (format);
+  /* NBT usually shrinks to 1/4 ~ 1/10 when compressed */
+  gsize buf_len = MAX (length * 4, 4096);
+  gsize pos = 0;
+  guint8 *buf = g_malloc (buf_len);
+  gsize consumed = 0;
+  GConverterResult result = G_CONVERTER_CONVERTED;
+  gint64 start = stats ? g_get_monotonic_time () : 0;
 
-  if (!no_compression)
+  while (result != G_CONVERTER_FINISHED)
     {
-      guint8 *buf_data = g_new0 (uint8_t, length);
-      guint8 *buf_data_p = buf_data;
-      gsize buf_p_len = length;
-      GZlibDecompressor *decompressor = g_zlib_decompressor_new (format);
-      gsize buf_len = length;
-      GConverterResult result = G_CONVERTER_ERROR;
-      clock_t start = clock ();
-      gsize original_len = length;
-      for (; result != G_CONVERTER_FINISHED;)
+      if (!nbt_progress_set (progress, consumed))
+        break;
+      GError *internal_err = NULL;
+      gsize current_consumed_len = 0;
+      gsize current_write_len = 0;
+      /* The convertion might not be completed */
+      result = g_converter_convert (
+          G_CONVERTER (decompressor), data + consumed, length - consumed,
+          buf + pos, buf_len - pos, G_CONVERTER_INPUT_AT_END,
+          &current_consumed_len, &current_write_len, &internal_err);
+      if (result == G_CONVERTER_ERROR)
         {
-          if (g_cancellable_is_cancelled (cancellable))
-            break;
-          GError *internal_err = NULL;
-          gsize current_consumed_len = 0;
-          gsize current_write_len = 0;
-          /* The convertion might not be completed */
-          result = g_converter_convert (
-              G_CONVERTER (decompressor), data, length, buf_data, buf_len,
-              G_CONVERTER_NO_FLAGS, &current_consumed_len, &current_write_len,
-              &internal_err);
-          if (set_func && klass)
-            {
-              clock_t passed_ms = 1000 * (clock () - start) / CLOCKS_PER_SEC;
-              if (passed_ms % 500 == 0)
-                set_func (klass, (original_len - length) * 100 / original_len,
-                          _ ("Decompressing."));
-            }
-          if (result == G_CONVERTER_ERROR)
+          /* There's no space in buf */
+          if (g_error_matches (internal_err, G_IO_ERROR, G_IO_ERROR_NO_SPACE))
             {
-              /* There's no space in buf */
-              if (internal_err->code == G_IO_ERROR_NO_SPACE)
-                {
-                  buf_len += 128;
-                  buf_p_len += 128;
-                  buf_data_p = g_realloc (buf_data_p, buf_p_len);
-                  buf_data = buf_data_p + (buf_p_len - buf_len);
-                  g_error_free (internal_err);
-                  continue;
-                }
-              if (err)
-                {
-                  *err = internal_err;
-                  break;
-                }
-            }
-          data += current_consumed_len;
-          length -= current_consumed_len;
-          buf_data += current_write_len;
-          buf_len -= current_write_len;
-          if (buf_len == 0)
-            {
-              buf_len += 128;
-              buf_p_len += 128;
-              buf_data_p = g_realloc (buf_data_p, buf_p_len);
-              buf_data = buf_data_p + (buf_p_len - buf_len);
+              g_error_free (internal_err);
+              buf_len *= 2;
+              buf = g_realloc (buf, buf_len);
+              continue;
             }
+          g_propagate_error (err, internal_err);
+          break;
         }
-
-      if (err && *err || result == G_CONVERTER_ERROR)
+      consumed += current_consumed_len;
+      pos += current_write_len;
+      if (pos == buf_len)
         {
-          g_free (buf_data_p);
-          return NULL;
+          buf_len *= 2;
+          buf = g_realloc (buf, buf_len);
         }
+    }
+  g_object_unref (decompressor);
 
-      buffer = init_buffer (buf_data_p, buf_p_len - buf_len);
+  if (stats)
+    stats->inflate_time = g_get_monotonic_time () - start;
 
-      /* Cancelled */
-      if (g_cancellable_is_cancelled (cancellable))
-        {
-          g_free (buffer->data);
-          g_free (buffer);
-          g_set_error_literal (err, NBT_GLIB_PARSE_ERROR,
-                               NBT_GLIB_PARSE_ERROR_CANCELLED,
-                               _ ("The parsing progress has been cancelled."));
-          return NULL;
-        }
+  if (result != G_CONVERTER_FINISHED)
+    {
+      g_free (buf);
+      if (progress->cancelled)
+        g_set_error_literal (err, NBT_GLIB_PARSE_ERROR,
+                             NBT_GLIB_PARSE_ERROR_CANCELLED,
+                             _ ("The parsing progress has been cancelled."));
+      return NULL;
+    }
+  *out_len = pos;
+  return buf;
+}
+
+/* Find whether the data is gzip or zlib, FALSE if it isn't compressed */
+static gboolean
+compressed_format (const uint8_t *data, size_t length,
+                   GZlibCompressorFormat *format)
+{
+  if (length > 1 && data[0] == 0x1f && data[1] == 0x8b)
+    /* File is Gzip */
+    *format = G_ZLIB_COMPRESSOR_FORMAT_GZIP;
+  else if (length > 0 && data[0] == 0x78)
+    /* File is Zlib */
+    *format = G_ZLIB_COMPRESSOR_FORMAT_ZLIB;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+/* The size `data` is expected to inflate to: the size kept at the end of
+ * gzip, which is modulo 2^32, or the guess of `inflate_data` */
+static guint64
+inflated_size_hint (const uint8_t *data, size_t length,
+                    GZlibCompressorFormat format)
+{
+  if (format == G_ZLIB_COMPRESSOR_FORMAT_GZIP && length >= 18)
+    {
+      guint32 size;
+      memcpy (&size, data + length - 4, sizeof (size));
+      size = GUINT32_FROM_LE (size);
+      if (size >= length)
+        return size;
+    }
+  return MAX (length * 4, 4096);
+}
+
+guint8 *
+nbt_decompress (const guint8 *data, size_t length, size_t *out_len,
+                GError **err)
+{
+  GZlibCompressorFormat format;
+  if (!compressed_format (data, length, &format))
+    {
+      *out_len = length;
+      return (guint8 *)data;
+    }
+  NbtProgress progress;
+  nbt_progress_init (&progress, NULL, NULL, NULL, 0, 0, 0, NULL);
+  return inflate_data (data, length, format, out_len, &progress, NULL, err);
+}
+
+NbtNode *
+nbt_node_parse_value (const guint8 *data, size_t length, size_t *pos,
+                      NBT_Tags tag, gboolean has_key, GError **err)
+{
+  NBT_Buffer buffer
+      = { (uint8_t *)data, length, *pos, NBT_PARSE_FLAGS_NONE };
+  NbtProgress progress;
+  nbt_progress_init (&progress, NULL, NULL, NULL, 0, 0, 0, NULL);
+  NbtNode *node = NULL;
+  if (parse_value (&node, tag, &buffer, !has_key, 0, &progress, NULL, err))
+    {
+      if (node)
+        nbt_node_free (node);
+      return NULL;
+    }
+  *pos = buffer.pos;
+  return node;
+}
+
+NbtNode *
+nbt_node_new_full (uint8_t *data, size_t length, GError **err,
+                   DhProgressFullSet set_func, void *klass,
+                   GCancellable *cancellable, int min, int max,
+                   NbtStats *stats)
+{
+  return nbt_node_new_with_flags (data, length, NBT_PARSE_FLAGS_NONE, err,
+                                  set_func, klass, cancellable, min, max,
+                                  stats);
+}
+
+NbtNode *
+nbt_node_new_with_flags (uint8_t *data, size_t length, NbtParseFlags flags,
+                         GError **err, DhProgressFullSet set_func, void *klass,
+                         GCancellable *cancellable, int min, int max,
+                         NbtStats *stats)
+{
+  NBT_Buffer *buffer;
+  GZlibCompressorFormat format;
+  gboolean no_compression = FALSE;
+  NbtProgress progress;
+
+  if (stats)
+    {
+      memset (stats, 0, sizeof (NbtStats));
+      stats->bytes_in = length;
+    }
+
+  /* Unzip data */
+  no_compression = !compressed_format (data, length, &format);
+
+  /* The range of the progress is split between decompressing and parsing,
+   * by the compressed and the decompressed size */
+  int parse_min = min;
+  if (!no_compression)
+    {
+      size_t buf_len = 0;
+      guint64 hint = inflated_size_hint (data, length, format);
+      parse_min = min + (gint64)(max - min) * length / (length + hint);
+      nbt_progress_init (&progress, set_func, klass, cancellable, min,
+                         parse_min, length, _ ("Decompressing."));
+      guint8 *buf_data = inflate_data (data, length, format, &buf_len,
+                                       &progress, stats, err);
+      if (!buf_data)
+        return NULL;
+      buffer = init_buffer (buf_data, buf_len);
+      if (stats)
+        stats->compressed_size = length;
     }
   else
     {
@@ -681,21 +1346,29 @@ nbt_node_new_opt (uint8_t *data, size_t length, GError **err,
       buffer = init_buffer (data_dup, length);
     }
 
-  NbtNode *root = create_nbt (TAG_End);
-  int ret = parse_value (root, buffer, 0, set_func, klass, cancellable, min,
-                         max, clock (), err);
+  if (stats)
+    stats->decompressed_size = buffer->len;
+  buffer->flags = flags;
+
+  nbt_progress_init (&progress, set_func, klass, cancellable, parse_min, max,
+                     buffer->len, _ ("Parsing NBT file to NBT node tree."));
+  gint64 start = stats ? g_get_monotonic_time () : 0;
+  NbtNode *root = NULL;
+  int ret = parse_value (&root, TAG_End, buffer, 0, 0, &progress, stats, err);
   g_free (buffer->data);
+  if (stats)
+    stats->tree_time = g_get_monotonic_time () - start;
 
   if (ret != 0)
     {
-      g_node_destroy (root);
+      if (root)
+        nbt_node_free (root);
       g_free (buffer);
       return NULL;
     }
   else
     {
-      if (set_func && klass)
-        set_func (klass, max, _ ("Parsing finished!"));
+      nbt_progress_finish (&progress, _ ("Parsing finished!"));
       if (buffer->pos != buffer->len)
         g_set_error_literal (err, NBT_GLIB_PARSE_ERROR,
                              NBT_GLIB_PARSE_ERROR_LEFTOVER_DATA,
@@ -706,9 +1379,19 @@ nbt_node_new_opt (uint8_t *data, size_t length, GError **err,
 }
 
 NbtNode *
-nbt_node_new_from_filename (const char *filename, GError **err,
-                            DhProgressFullSet set_func, void *main_klass,
-                            GCancellable *cancellable, int min, int max)
+nbt_node_new_opt (uint8_t *data, size_t length, GError **err,
+                  DhProgressFullSet set_func, void *klass,
+                  GCancellable *cancellable, int min, int max)
+{
+  return nbt_node_new_full (data, length, err, set_func, klass, cancellable,
+                            min, max, NULL);
+}
+
+NbtNode *
+nbt_node_new_from_filename_full (const char *filename, GError **err,
+                                 DhProgressFullSet set_func, void *main_klass,
+                                 GCancellable *cancellable, int min, int max,
+                                 NbtStats *stats)
 {
   if (set_func && main_klass)
     set_func (main_klass, min, _ ("Parsing file."));
@@ -716,6 +1399,7 @@ nbt_node_new_from_filename (const char *filename, GError **err,
   GFile *file = g_file_new_for_path (filename);
   guint8 *data = NULL;
   gsize len = 0;
+  gint64 start = stats ? g_get_monotonic_time () : 0;
   if (!g_file_load_contents (file, cancellable, (char **)&data, &len, NULL,
                              &internal_err))
     {
@@ -728,13 +1412,25 @@ nbt_node_new_from_filename (const char *filename, GError **err,
         set_func (main_klass, max, _ ("Parsing file failed."));
       return NULL;
     }
-  NbtNode *ret = nbt_node_new_opt (data, len, err, set_func, main_klass,
-                                   cancellable, min, max);
+  gint64 io_time = stats ? g_get_monotonic_time () - start : 0;
+  NbtNode *ret = nbt_node_new_full (data, len, err, set_func, main_klass,
+                                    cancellable, min, max, stats);
+  if (stats)
+    stats->io_time = io_time;
   g_object_unref (file);
   g_free (data);
   return ret;
 }
 
+NbtNode *
+nbt_node_new_from_filename (const char *filename, GError **err,
+                            DhProgressFullSet set_func, void *main_klass,
+                            GCancellable *cancellable, int min, int max)
+{
+  return nbt_node_new_from_filename_full (filename, err, set_func, main_klass,
+                                          cancellable, min, max, NULL);
+}
+
 NbtNode *
 nbt_node_new_with_progress (uint8_t *data, size_t length,
                             DhProgressFullSet set_func, void *main_klass,
@@ -748,4 +1444,4 @@ NbtNode *
 nbt_node_new (uint8_t *data, size_t length)
 {
   return nbt_node_new_opt (data, length, NULL, NULL, NULL, NULL, 0, 0);
-}
\ No newline at end of file
+}
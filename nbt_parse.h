@@ -30,6 +30,7 @@ G_BEGIN_DECLS
  * @sa NbtGlibParseError
  */
 #define NBT_GLIB_PARSE_ERROR nbt_glib_parse_error_quark ()
+GQuark nbt_glib_parse_error_quark (void);
 
 /**
  * @brief The error code of the parse error.
@@ -48,6 +49,10 @@ typedef enum
   NBT_GLIB_PARSE_ERROR_CANCELLED,
   /** Invalid tag */
   NBT_GLIB_PARSE_ERROR_INVALID_TAG,
+  /** The SNBT text has a syntax error */
+  NBT_GLIB_PARSE_ERROR_SYNTAX,
+  /** The value has no form in the text written, like a NaN in SNBT */
+  NBT_GLIB_PARSE_ERROR_UNREPRESENTABLE,
 } NbtGlibParseError;
 
 /**
@@ -79,6 +84,23 @@ typedef struct NbtData
   /** NBT tag. see `NBT_Tags` */
   enum NBT_Tags type;
 
+  /**
+   * @brief Internal flags, don't change them.
+   *
+   * They tell where the node, the key and the value are allocated, and
+   * whether the key and the array or string are payloads shared between
+   * the duplicates made by `nbt_node_dup`, which never changes the node it
+   * copies. A shared value is read-only, call `nbt_node_unshare` (or use
+   * the setters) before writing to it.
+   *
+   * This field breaks the ABI on 32-bit targets. On LP64 targets it fills
+   * the padding after `type`, so the size and offsets stay the same. On
+   * ILP32 targets there's no padding, so `key` and the value move by 4
+   * bytes and the struct grows. Code built against the headers without
+   * `flags` must be rebuilt there.
+   */
+  guint32 flags;
+
   /** NBT tag name. Nullable when no name defined. '\0' ended */
   char *key;
 
@@ -131,6 +153,83 @@ typedef struct NbtData
  */
 typedef GNode NbtNode;
 
+/**
+ * @brief The statistics of a parsing or packing call.
+ *
+ * Pass it to the `_full` functions to fill it, the time is in microseconds.
+ */
+typedef struct NbtStats
+{
+  /** Size of the data passed to the parser, or of the raw NBT packed */
+  guint64 bytes_in;
+  /** Size of the data written by the packer, 0 when parsing */
+  guint64 bytes_out;
+  /** Size of the compressed data, 0 when it's not compressed */
+  guint64 compressed_size;
+  /** Size of the raw (decompressed) NBT */
+  guint64 decompressed_size;
+  /** Time spent in reading or writing the file */
+  gint64 io_time;
+  /** Time spent in decompressing */
+  gint64 inflate_time;
+  /** Time spent in building the tree, or serializing it when packing */
+  gint64 tree_time;
+  /** Time spent in compressing */
+  gint64 deflate_time;
+  /** Count of the nodes of every type, indexed by `NBT_Tags` */
+  guint64 n_nodes[TAG_Long_Array + 1];
+  /** The max depth of the tree, the root is 0 */
+  int max_depth;
+  /** Count of the allocations kept by the tree, or made when packing */
+  guint64 n_allocs;
+  /** Bytes of the allocations above */
+  guint64 alloc_bytes;
+} NbtStats;
+
+/**
+ * @brief The bytes held by a tree, by kind.
+ *
+ * The keys and strings kept inline in their data are counted as keys and
+ * strings. The small header of each list block and the bookkeeping of the
+ * allocator itself aren't counted.
+ */
+typedef struct NbtMemoryUsage
+{
+  /** The `GNode` of every node */
+  guint64 nodes;
+  /** The `NbtData` of every node */
+  guint64 data;
+  guint64 keys;
+  guint64 strings;
+  guint64 byte_arrays;
+  guint64 int_arrays;
+  guint64 long_arrays;
+  /** The numbers of the packed lists */
+  guint64 packed_lists;
+  /** The headers of the shared payloads and of the custom allocators, and
+   * the room of the list blocks */
+  guint64 overhead;
+  /** Of the bytes above, those of the payloads shared with other trees,
+   * which aren't given back when the tree is freed */
+  guint64 shared;
+} NbtMemoryUsage;
+
+/**
+ * @brief The options of the parser.
+ */
+typedef enum NbtParseFlags
+{
+  NBT_PARSE_FLAGS_NONE = 0,
+  /**
+   * Keep the lists of numbers (byte, short, int, long, float and double)
+   * as one array in the list node instead of a child per number, see
+   * `nbt_node_get_list_span`. Such a list has no children until
+   * `nbt_node_unpack_list` is called, the functions of the library handle
+   * both forms.
+   */
+  NBT_PARSE_PACK_LISTS = 1 << 0,
+} NbtParseFlags;
+
 /**
  * @brief The full progress setting function
  * @param klass The class of the progress
@@ -145,6 +244,23 @@ NbtNode *nbt_node_new_from_filename (const char *filename, GError **err,
                                      void *main_klass,
                                      GCancellable *cancellable, int min,
                                      int max);
+/**
+ * @brief Create a new NBT node from a file, with statistics
+ * @param filename The name of the file
+ * @param err Error code, or NULL to ignore
+ * @param set_func The setting function for progress
+ * @param main_klass The class of the progress
+ * @param cancellable Cancellable object
+ * @param min The minimum value of the progress
+ * @param max The maximum value of the progress
+ * @param stats The statistics to fill, or NULL
+ * @return The node of the NBT, or NULL when cancelled or failed.
+ */
+NbtNode *nbt_node_new_from_filename_full (const char *filename, GError **err,
+                                          DhProgressFullSet set_func,
+                                          void *main_klass,
+                                          GCancellable *cancellable, int min,
+                                          int max, NbtStats *stats);
 /**
  * @brief Create a new NBT node from data
  * @param data The original data of NBT
@@ -183,11 +299,86 @@ NbtNode *nbt_node_new (guint8 *data, size_t length);
 NbtNode *nbt_node_new_opt (guint8 *data, size_t length, GError **err,
                            DhProgressFullSet set_func, void *klass,
                            GCancellable *cancellable, int min, int max);
+/**
+ * @brief Create a new NBT node from data, with progress, error and
+ * statistics
+ * @param data The original data of NBT
+ * @param length The length of the data
+ * @param err Error code, or NULL to ignore
+ * @param set_func The setting function for progress
+ * @param klass The class of the progress
+ * @param cancellable Cancellable object
+ * @param min The minimum value of the progress
+ * @param max The maximum value of the progress
+ * @param stats The statistics to fill, or NULL
+ * @return The node of the NBT, or NULL when cancelled or failed.
+ */
+NbtNode *nbt_node_new_full (guint8 *data, size_t length, GError **err,
+                            DhProgressFullSet set_func, void *klass,
+                            GCancellable *cancellable, int min, int max,
+                            NbtStats *stats);
+/**
+ * @brief Like `nbt_node_new_full`, with the options of the parser.
+ * @param flags The options of the parser
+ * @sa nbt_node_new_full
+ */
+NbtNode *nbt_node_new_with_flags (guint8 *data, size_t length,
+                                  NbtParseFlags flags, GError **err,
+                                  DhProgressFullSet set_func, void *klass,
+                                  GCancellable *cancellable, int min,
+                                  int max, NbtStats *stats);
+/**
+ * @brief Create a new NBT node from the SNBT text
+ *
+ * The typed arrays (`[B;…]`, `[I;…]`, `[L;…]`), the number suffixes,
+ * `true`/`false` and the escapes of the quoted strings are supported. A
+ * double without its suffix needs a `.`, like `1.5` or `1.e5`. The
+ * unquoted words which aren't numbers, or are out of the range of their
+ * type, are strings.
+ * @param text The SNBT text in UTF-8
+ * @param length The length of the text, or -1 if it's '\0' ended
+ * @param error_offset The byte offset of the error in the text, or NULL to
+ * ignore
+ * @param err Error code, or NULL to ignore
+ * @return The node of the NBT, or NULL when failed.
+ */
+NbtNode *nbt_node_new_from_snbt (const char *text, gssize length,
+                                 gsize *error_offset, GError **err);
 /**
  * @brief Free the node.
+ *
+ * The tree is walked by its own links instead of recursion, so the depth
+ * of the tree doesn't matter.
  * @param node The root node needed to be freed.
  */
 void nbt_node_free (NbtNode *node);
+/**
+ * @brief Count the bytes held by the node and its children, without
+ * serializing them.
+ * @param node The node
+ * @param usage The bytes by kind, or NULL
+ * @return The total bytes, `shared` excepted
+ */
+guint64 nbt_node_memory_usage (const NbtNode *node, NbtMemoryUsage *usage);
+/**
+ * @brief Give the tree to a background thread to be freed, and return at
+ * once.
+ *
+ * The node is unlinked from its parent first, and only its own tree is
+ * freed. The thread is started by the first call and frees the trees in
+ * order.
+ * @param node The node needed to be freed, or NULL
+ * @sa nbt_node_free_flush
+ */
+void nbt_node_free_deferred (NbtNode *node);
+/**
+ * @brief Wait until the trees given to `nbt_node_free_deferred` before
+ * are freed.
+ *
+ * The trees given after the call, from any thread, aren't waited for, so
+ * it returns while other threads keep freeing.
+ */
+void nbt_node_free_flush (void);
 
 G_END_DECLS
 
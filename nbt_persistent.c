@@ -0,0 +1,463 @@
+/*  nbt_persistent - Persistent tree part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_persistent.h"
+#include "nbt_diff.h"
+#include "nbt_private.h"
+#include <string.h>
+
+#ifndef NBT_GLIB_DISABLE_TRANSLATION
+#include <libintl.h>
+#define _(text) gettext (text)
+#else
+#define _(text) text
+#endif
+
+struct NbtPNode
+{
+  gint ref_count;
+  guint n_children;
+  /* The key and the value are always shared payloads */
+  NbtData data;
+  NbtPNode *children[];
+};
+
+struct NbtPCell
+{
+  GMutex lock;
+  NbtPNode *root;
+};
+
+typedef enum
+{
+  EDIT_SET,
+  EDIT_INSERT,
+  EDIT_REMOVE,
+} EditOp;
+
+typedef struct Segment
+{
+  char *key;
+  gint64 index;
+} Segment;
+
+static gboolean
+has_value (const NbtData *data)
+{
+  return (data->type == TAG_String || data->type == TAG_Byte_Array
+          || data->type == TAG_Int_Array || data->type == TAG_Long_Array)
+         && data->value_a.value;
+}
+
+/* Allocate the node with the data of `data`, whose payloads are referenced
+ * if they're shared and copied otherwise. The children are left for the
+ * caller */
+static NbtPNode *
+pnode_alloc (const NbtData *data, guint n_children)
+{
+  NbtPNode *pnode
+      = g_malloc (sizeof (NbtPNode) + n_children * sizeof (NbtPNode *));
+  pnode->ref_count = 1;
+  pnode->n_children = n_children;
+  nbt_data_copy_shared (&pnode->data, data);
+  return pnode;
+}
+
+static NbtPNode *
+pnode_from_node (NbtNode *node)
+{
+  const NbtData *data = node->data;
+  NbtPNode *pnode;
+  if (nbt_data_is_packed_list (data))
+    {
+      /* The persistent list keeps a child per number */
+      NbtData list = *data;
+      list.flags &= ~(NBT_DATA_SHARED_VALUE | NBT_DATA_PACKED_LIST
+                      | NBT_DATA_LIST_TYPE_MASK);
+      list.value_a.value = NULL;
+      list.value_a.len = 0;
+      pnode = pnode_alloc (&list, data->value_a.len);
+    }
+  else
+    pnode = pnode_alloc (data, g_node_n_children (node));
+  guint i = 0;
+  NbtListIter iter;
+  nbt_list_iter_init (&iter, node);
+  for (NbtNode *child; (child = nbt_list_iter_next (&iter));)
+    pnode->children[i++] = pnode_from_node (child);
+  return pnode;
+}
+
+NbtPNode *
+nbt_pnode_new_from_node (NbtNode *node)
+{
+  g_return_val_if_fail (node, NULL);
+  return pnode_from_node (node);
+}
+
+NbtNode *
+nbt_pnode_to_node (NbtPNode *pnode)
+{
+  g_return_val_if_fail (pnode, NULL);
+  NbtData *data = g_new (NbtData, 1);
+  *data = pnode->data;
+  if (data->key)
+    nbt_payload_ref (data->key);
+  if (has_value (data))
+    nbt_payload_ref (data->value_a.value);
+  NbtNode *node = g_node_new (data);
+  NbtNode *last = NULL;
+  for (guint i = 0; i < pnode->n_children; i++)
+    last = g_node_insert_after (node, last,
+                                nbt_pnode_to_node (pnode->children[i]));
+  return node;
+}
+
+NbtPNode *
+nbt_pnode_ref (NbtPNode *pnode)
+{
+  g_return_val_if_fail (pnode, NULL);
+  g_atomic_int_inc (&pnode->ref_count);
+  return pnode;
+}
+
+void
+nbt_pnode_unref (NbtPNode *pnode)
+{
+  if (!pnode || !g_atomic_int_dec_and_test (&pnode->ref_count))
+    return;
+  for (guint i = 0; i < pnode->n_children; i++)
+    nbt_pnode_unref (pnode->children[i]);
+  nbt_data_free_key (&pnode->data);
+  nbt_data_free_value (&pnode->data);
+  g_free (pnode);
+}
+
+const NbtData *
+nbt_pnode_get_data (NbtPNode *pnode)
+{
+  g_return_val_if_fail (pnode, NULL);
+  return &pnode->data;
+}
+
+guint
+nbt_pnode_n_children (NbtPNode *pnode)
+{
+  g_return_val_if_fail (pnode, 0);
+  return pnode->n_children;
+}
+
+NbtPNode *
+nbt_pnode_nth_child (NbtPNode *pnode, guint n)
+{
+  g_return_val_if_fail (pnode, NULL);
+  return n < pnode->n_children ? pnode->children[n] : NULL;
+}
+
+static gint64
+key_index (NbtPNode *pnode, const char *key)
+{
+  for (guint i = 0; i < pnode->n_children; i++)
+    if (g_strcmp0 (pnode->children[i]->data.key, key) == 0)
+      return i;
+  return -1;
+}
+
+NbtPNode *
+nbt_pnode_child_by_key (NbtPNode *pnode, const char *key)
+{
+  g_return_val_if_fail (pnode && key, NULL);
+  if (pnode->data.type != TAG_Compound)
+    return NULL;
+  gint64 i = key_index (pnode, key);
+  return i < 0 ? NULL : pnode->children[i];
+}
+
+static void
+segments_free (GArray *segments)
+{
+  for (guint i = 0; i < segments->len; i++)
+    g_free (g_array_index (segments, Segment, i).key);
+  g_array_free (segments, TRUE);
+}
+
+static GArray *
+parse_path (const char *path)
+{
+  GArray *segments = g_array_new (FALSE, FALSE, sizeof (Segment));
+  GString *key = g_string_new (NULL);
+  for (const char *p = path; *p;)
+    {
+      Segment segment;
+      p = nbt_path_parse_segment (p, segments->len == 0, key,
+                                  &segment.index);
+      if (!p)
+        {
+          segments_free (segments);
+          segments = NULL;
+          break;
+        }
+      segment.key = segment.index < 0 ? g_strdup (key->str) : NULL;
+      g_array_append_val (segments, segment);
+    }
+  g_string_free (key, TRUE);
+  return segments;
+}
+
+NbtPNode *
+nbt_pnode_lookup_path (NbtPNode *root, const char *path)
+{
+  g_return_val_if_fail (root && path, NULL);
+  GArray *segments = parse_path (path);
+  if (!segments)
+    return NULL;
+  NbtPNode *pnode = root;
+  for (guint i = 0; i < segments->len && pnode; i++)
+    {
+      Segment *segment = &g_array_index (segments, Segment, i);
+      if (segment->index >= 0)
+        pnode = pnode->data.type == TAG_List
+                    ? nbt_pnode_nth_child (pnode, segment->index)
+                    : NULL;
+      else
+        pnode = nbt_pnode_child_by_key (pnode, segment->key);
+    }
+  segments_free (segments);
+  return pnode;
+}
+
+/* Copy the node sharing its children, but the child at `index`, which is
+ * replaced by `child` (taken), gets `child` inserted before it or is
+ * removed */
+static NbtPNode *
+pnode_copy_edit (NbtPNode *pnode, guint index, EditOp op, NbtPNode *child)
+{
+  guint n = pnode->n_children + (op == EDIT_INSERT)
+            - (op == EDIT_REMOVE);
+  NbtPNode *copy = pnode_alloc (&pnode->data, n);
+  guint j = 0;
+  for (guint i = 0; i < pnode->n_children; i++)
+    {
+      if (i == index && op != EDIT_SET)
+        {
+          if (op == EDIT_INSERT)
+            copy->children[j++] = child;
+          else
+            continue;
+        }
+      copy->children[j++] = i == index && op == EDIT_SET
+                                ? child
+                                : nbt_pnode_ref (pnode->children[i]);
+    }
+  if (op == EDIT_INSERT && index == pnode->n_children)
+    copy->children[j++] = child;
+  return copy;
+}
+
+/* The value with the key, copied if its key is different */
+static NbtPNode *
+pnode_with_key (NbtPNode *value, const char *key)
+{
+  if (g_strcmp0 (value->data.key, key) == 0)
+    return nbt_pnode_ref (value);
+  NbtData data = value->data;
+  data.key = NULL;
+  data.flags &= ~NBT_DATA_SHARED_KEY;
+  NbtPNode *copy = pnode_alloc (&data, value->n_children);
+  if (key)
+    {
+      copy->data.key = nbt_payload_new (key, strlen (key) + 1);
+      copy->data.flags |= NBT_DATA_SHARED_KEY;
+    }
+  for (guint i = 0; i < value->n_children; i++)
+    copy->children[i] = nbt_pnode_ref (value->children[i]);
+  return copy;
+}
+
+static NbtPNode *
+edit (NbtPNode *pnode, Segment *segment, guint n_segments, EditOp op,
+      NbtPNode *value, const char *path, GError **error)
+{
+  gboolean list = segment->index >= 0;
+  if (pnode->data.type != (list ? TAG_List : TAG_Compound))
+    goto invalid_path;
+  gint64 index = list ? segment->index : key_index (pnode, segment->key);
+  gboolean found = index >= 0 && index < pnode->n_children;
+
+  if (n_segments > 1)
+    {
+      if (!found)
+        goto invalid_path;
+      NbtPNode *child = edit (pnode->children[index], segment + 1,
+                              n_segments - 1, op, value, path, error);
+      return child ? pnode_copy_edit (pnode, index, EDIT_SET, child) : NULL;
+    }
+
+  if (op == EDIT_REMOVE)
+    {
+      if (!found)
+        goto invalid_path;
+      return pnode_copy_edit (pnode, index, EDIT_REMOVE, NULL);
+    }
+  if (list)
+    {
+      if (op == EDIT_SET ? !found : index > pnode->n_children)
+        goto invalid_path;
+      /* The other elements decide the type of the list */
+      for (guint i = 0; i < pnode->n_children; i++)
+        {
+          if (op == EDIT_SET && i == index)
+            continue;
+          if (pnode->children[i]->data.type != value->data.type)
+            {
+              g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_CONFLICT,
+                           _ ("The list at \"%s\" has another type."),
+                           path);
+              return NULL;
+            }
+          break;
+        }
+      return pnode_copy_edit (pnode, index, op,
+                              pnode_with_key (value, NULL));
+    }
+  if (found && op == EDIT_INSERT)
+    {
+      g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_CONFLICT,
+                   _ ("The key at \"%s\" exists."), path);
+      return NULL;
+    }
+  NbtPNode *child = pnode_with_key (value, segment->key);
+  return found ? pnode_copy_edit (pnode, index, EDIT_SET, child)
+               : pnode_copy_edit (pnode, pnode->n_children, EDIT_INSERT,
+                                  child);
+
+invalid_path:
+  g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_INVALID_PATH,
+               _ ("Invalid path \"%s\"."), path);
+  return NULL;
+}
+
+static NbtPNode *
+edit_path (NbtPNode *root, const char *path, EditOp op, NbtPNode *value,
+           GError **error)
+{
+  GArray *segments = parse_path (path);
+  if (!segments)
+    {
+      g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_INVALID_PATH,
+                   _ ("Invalid path \"%s\"."), path);
+      return NULL;
+    }
+  NbtPNode *new_root = NULL;
+  if (segments->len)
+    new_root = edit (root, (Segment *)segments->data, segments->len, op,
+                     value, path, error);
+  else if (op == EDIT_SET)
+    new_root = pnode_with_key (value, root->data.key);
+  else
+    g_set_error (error, NBT_DIFF_ERROR, NBT_DIFF_ERROR_INVALID_PATH,
+                 _ ("The root can't be inserted or removed."));
+  segments_free (segments);
+  return new_root;
+}
+
+NbtPNode *
+nbt_pnode_set (NbtPNode *root, const char *path, NbtPNode *value,
+               GError **error)
+{
+  g_return_val_if_fail (root && path && value, NULL);
+  return edit_path (root, path, EDIT_SET, value, error);
+}
+
+NbtPNode *
+nbt_pnode_insert (NbtPNode *root, const char *path, NbtPNode *value,
+                  GError **error)
+{
+  g_return_val_if_fail (root && path && value, NULL);
+  return edit_path (root, path, EDIT_INSERT, value, error);
+}
+
+NbtPNode *
+nbt_pnode_remove (NbtPNode *root, const char *path, GError **error)
+{
+  g_return_val_if_fail (root && path, NULL);
+  return edit_path (root, path, EDIT_REMOVE, NULL, error);
+}
+
+NbtPCell *
+nbt_pcell_new (NbtPNode *root)
+{
+  NbtPCell *cell = g_new (NbtPCell, 1);
+  g_mutex_init (&cell->lock);
+  cell->root = root ? nbt_pnode_ref (root) : NULL;
+  return cell;
+}
+
+void
+nbt_pcell_free (NbtPCell *cell)
+{
+  if (!cell)
+    return;
+  nbt_pnode_unref (cell->root);
+  g_mutex_clear (&cell->lock);
+  g_free (cell);
+}
+
+/* The lock only covers taking the reference, the readers never hold it
+ * while reading the tree */
+NbtPNode *
+nbt_pcell_get (NbtPCell *cell)
+{
+  g_return_val_if_fail (cell, NULL);
+  g_mutex_lock (&cell->lock);
+  NbtPNode *root = cell->root ? nbt_pnode_ref (cell->root) : NULL;
+  g_mutex_unlock (&cell->lock);
+  return root;
+}
+
+void
+nbt_pcell_set (NbtPCell *cell, NbtPNode *root)
+{
+  g_return_if_fail (cell);
+  if (root)
+    nbt_pnode_ref (root);
+  g_mutex_lock (&cell->lock);
+  NbtPNode *old_root = cell->root;
+  cell->root = root;
+  g_mutex_unlock (&cell->lock);
+  nbt_pnode_unref (old_root);
+}
+
+gboolean
+nbt_pcell_compare_and_set (NbtPCell *cell, NbtPNode *expected,
+                           NbtPNode *root)
+{
+  g_return_val_if_fail (cell, FALSE);
+  NbtPNode *old_root = NULL;
+  gboolean replaced = FALSE;
+  g_mutex_lock (&cell->lock);
+  if (cell->root == expected)
+    {
+      old_root = cell->root;
+      cell->root = root ? nbt_pnode_ref (root) : NULL;
+      replaced = TRUE;
+    }
+  g_mutex_unlock (&cell->lock);
+  nbt_pnode_unref (old_root);
+  return replaced;
+}
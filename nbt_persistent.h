@@ -0,0 +1,158 @@
+/*  nbt_persistent - Persistent tree part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_PERSISTENT_H
+#define DHLRC_NBT_PERSISTENT_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The node of an immutable NBT tree.
+ *
+ * A `NbtPNode` never changes after it's made, so it can be read from many
+ * threads without locking. An edit returns a new root which shares every
+ * untouched subtree with the old one: only the nodes on the edited path
+ * are copied. The nodes are reference counted atomically, a subtree is
+ * freed when the last root holding it is unreferenced.
+ *
+ * The paths use the syntax of `NbtDiffEntry`, like `sections[3].Y`.
+ */
+typedef struct NbtPNode NbtPNode;
+
+/**
+ * @brief Convert the tree into an immutable tree.
+ *
+ * The keys, strings and arrays are shared as by `nbt_node_dup`: the ones
+ * `node` already shares with its duplicates get a reference, the others
+ * are copied once. `node` isn't changed.
+ * @param node The root of the tree
+ * @return The immutable root with one reference
+ */
+NbtPNode *nbt_pnode_new_from_node (NbtNode *node);
+/**
+ * @brief Convert the immutable tree into a new mutable tree.
+ * @param pnode The root of the immutable tree
+ * @return The mutable tree, to be freed by `nbt_node_free`
+ */
+NbtNode *nbt_pnode_to_node (NbtPNode *pnode);
+/**
+ * @brief Add a reference to the node.
+ * @return The node
+ */
+NbtPNode *nbt_pnode_ref (NbtPNode *pnode);
+/**
+ * @brief Drop a reference to the node, free it with the last one.
+ */
+void nbt_pnode_unref (NbtPNode *pnode);
+
+/**
+ * @brief Get the tag, the key and the value of the node.
+ *
+ * The data is read-only and lives as long as the node.
+ */
+const NbtData *nbt_pnode_get_data (NbtPNode *pnode);
+/**
+ * @brief Get the count of the children of a list or compound.
+ */
+guint nbt_pnode_n_children (NbtPNode *pnode);
+/**
+ * @brief Get the child at the index, owned by the node.
+ * @return The child, or NULL if the index is out of range
+ */
+NbtPNode *nbt_pnode_nth_child (NbtPNode *pnode, guint n);
+/**
+ * @brief Get the child of a compound with the key, owned by the node.
+ * @return The child, or NULL if not found
+ */
+NbtPNode *nbt_pnode_child_by_key (NbtPNode *pnode, const char *key);
+/**
+ * @brief Find the node at the path, owned by `root`.
+ * @return The node, or NULL if the path is malformed or not found
+ */
+NbtPNode *nbt_pnode_lookup_path (NbtPNode *root, const char *path);
+
+/**
+ * @brief Replace the node at the path, or add it to a compound.
+ *
+ * The last key of the path becomes the key of the value.
+ * @param root The root, which isn't changed
+ * @param path The path of the node
+ * @param value The new node, which isn't consumed
+ * @param error Error code in `NBT_DIFF_ERROR`, or NULL to ignore
+ * @return The new root with one reference, or NULL when failed
+ */
+NbtPNode *nbt_pnode_set (NbtPNode *root, const char *path, NbtPNode *value,
+                         GError **error);
+/**
+ * @brief Insert the node into a list at the index of the path, or add it to
+ * a compound which doesn't have the key.
+ * @sa nbt_pnode_set
+ */
+NbtPNode *nbt_pnode_insert (NbtPNode *root, const char *path,
+                            NbtPNode *value, GError **error);
+/**
+ * @brief Remove the node at the path.
+ * @sa nbt_pnode_set
+ */
+NbtPNode *nbt_pnode_remove (NbtPNode *root, const char *path,
+                            GError **error);
+
+/**
+ * @brief A shared reference to the current root of an immutable tree.
+ *
+ * The readers take the current root and keep iterating it while the
+ * writer publishes new roots; the old root is freed when the last reader
+ * drops it.
+ */
+typedef struct NbtPCell NbtPCell;
+
+/**
+ * @brief Create the cell.
+ * @param root The first root, which is referenced, or NULL
+ * @return The cell, to be freed by `nbt_pcell_free`
+ */
+NbtPCell *nbt_pcell_new (NbtPNode *root);
+/**
+ * @brief Free the cell and drop its reference to the root.
+ */
+void nbt_pcell_free (NbtPCell *cell);
+/**
+ * @brief Get the current root.
+ * @return The root with a new reference, or NULL
+ */
+NbtPNode *nbt_pcell_get (NbtPCell *cell);
+/**
+ * @brief Publish a new root.
+ * @param cell The cell
+ * @param root The new root, which is referenced, or NULL
+ */
+void nbt_pcell_set (NbtPCell *cell, NbtPNode *root);
+/**
+ * @brief Publish a new root only if the current one is `expected`.
+ *
+ * Concurrent writers use it to apply their edits to the latest root.
+ * @return TRUE if the root is replaced
+ */
+gboolean nbt_pcell_compare_and_set (NbtPCell *cell, NbtPNode *expected,
+                                    NbtPNode *root);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_PERSISTENT_H
@@ -0,0 +1,218 @@
+/*  nbt_pool - Node pool part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_pool.h"
+#include "nbt_private.h"
+
+/* The objects are kept in lists by size, in steps of `POOL_GRAIN` bytes.
+ * An object is taken from the list of its size rounded up, and put back
+ * into the list of its size rounded down, so the size given when freeing
+ * only has to be at most the allocated one */
+#define POOL_GRAIN 8
+#define POOL_MAX_SIZE 128
+#define POOL_N_CLASSES (POOL_MAX_SIZE / POOL_GRAIN)
+/** The most objects kept in one list, the others are freed */
+#define POOL_MAX_CACHED 65536
+
+typedef struct PoolObject
+{
+  struct PoolObject *next;
+} PoolObject;
+
+typedef struct PoolList
+{
+  PoolObject *head;
+  guint len;
+} PoolList;
+
+typedef struct NbtPool
+{
+  PoolList lists[POOL_N_CLASSES];
+  /* The nodes come from `g_slice`, which might not be `g_malloc` */
+  PoolList nodes;
+  NbtPoolStats stats;
+} NbtPool;
+
+static gint pool_enabled = FALSE;
+
+static void
+pool_clear (NbtPool *pool)
+{
+  for (int i = 0; i < POOL_N_CLASSES; i++)
+    {
+      PoolObject *object = pool->lists[i].head;
+      while (object)
+        {
+          PoolObject *next = object->next;
+          g_free (object);
+          object = next;
+        }
+      pool->lists[i].head = NULL;
+      pool->lists[i].len = 0;
+    }
+  PoolObject *object = pool->nodes.head;
+  while (object)
+    {
+      PoolObject *next = object->next;
+      g_slice_free1 (sizeof (GNode), object);
+      object = next;
+    }
+  pool->nodes.head = NULL;
+  pool->nodes.len = 0;
+  pool->stats.n_cached = 0;
+  pool->stats.cached_bytes = 0;
+}
+
+static void
+pool_free (gpointer pool)
+{
+  pool_clear (pool);
+  g_free (pool);
+}
+
+static GPrivate pool_key = G_PRIVATE_INIT (pool_free);
+
+static NbtPool *
+pool_get (void)
+{
+  NbtPool *pool = g_private_get (&pool_key);
+  if G_UNLIKELY (!pool)
+    {
+      pool = g_new0 (NbtPool, 1);
+      g_private_set (&pool_key, pool);
+    }
+  return pool;
+}
+
+static inline gpointer
+list_pop (NbtPool *pool, PoolList *list, gsize size)
+{
+  PoolObject *object = list->head;
+  if (!object)
+    {
+      pool->stats.n_allocated++;
+      return NULL;
+    }
+  list->head = object->next;
+  list->len--;
+  pool->stats.n_reused++;
+  pool->stats.n_cached--;
+  pool->stats.cached_bytes -= size;
+  return object;
+}
+
+static inline gboolean
+list_push (NbtPool *pool, PoolList *list, gpointer mem, gsize size)
+{
+  if (list->len >= POOL_MAX_CACHED)
+    return FALSE;
+  PoolObject *object = mem;
+  object->next = list->head;
+  list->head = object;
+  list->len++;
+  pool->stats.n_cached++;
+  pool->stats.cached_bytes += size;
+  return TRUE;
+}
+
+gpointer
+nbt_pool_alloc (gsize size)
+{
+  if (!g_atomic_int_get (&pool_enabled) || size == 0
+      || size > POOL_MAX_SIZE)
+    return g_malloc (size);
+  gsize index = (size + POOL_GRAIN - 1) / POOL_GRAIN - 1;
+  gsize class_size = (index + 1) * POOL_GRAIN;
+  NbtPool *pool = pool_get ();
+  gpointer mem = list_pop (pool, &pool->lists[index], class_size);
+  return mem ? mem : g_malloc (class_size);
+}
+
+void
+nbt_pool_free (gpointer mem, gsize size)
+{
+  if (!mem)
+    return;
+  if (g_atomic_int_get (&pool_enabled) && size >= POOL_GRAIN)
+    {
+      gsize index = MIN (size, POOL_MAX_SIZE) / POOL_GRAIN - 1;
+      NbtPool *pool = pool_get ();
+      if (list_push (pool, &pool->lists[index], mem,
+                     (index + 1) * POOL_GRAIN))
+        return;
+    }
+  g_free (mem);
+}
+
+GNode *
+nbt_pool_node_new (gpointer data)
+{
+  GNode *node = NULL;
+  if (g_atomic_int_get (&pool_enabled))
+    {
+      NbtPool *pool = pool_get ();
+      node = list_pop (pool, &pool->nodes, sizeof (GNode));
+    }
+  if (!node)
+    return g_node_new (data);
+  *node = (GNode){ .data = data };
+  return node;
+}
+
+void
+nbt_pool_node_free (GNode *node)
+{
+  if (g_atomic_int_get (&pool_enabled))
+    {
+      NbtPool *pool = pool_get ();
+      if (list_push (pool, &pool->nodes, node, sizeof (GNode)))
+        return;
+    }
+  g_slice_free (GNode, node);
+}
+
+void
+nbt_pool_set_enabled (gboolean enabled)
+{
+  g_atomic_int_set (&pool_enabled, !!enabled);
+}
+
+gboolean
+nbt_pool_get_enabled (void)
+{
+  return g_atomic_int_get (&pool_enabled);
+}
+
+void
+nbt_pool_trim (void)
+{
+  NbtPool *pool = g_private_get (&pool_key);
+  if (pool)
+    pool_clear (pool);
+}
+
+void
+nbt_pool_get_stats (NbtPoolStats *stats)
+{
+  g_return_if_fail (stats);
+  NbtPool *pool = g_private_get (&pool_key);
+  if (pool)
+    *stats = pool->stats;
+  else
+    *stats = (NbtPoolStats){ 0 };
+}
@@ -0,0 +1,70 @@
+/*  nbt_pool - Node pool part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_POOL_H
+#define DHLRC_NBT_POOL_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The counters of the pool of the calling thread.
+ */
+typedef struct NbtPoolStats
+{
+  /** Objects taken from the pool instead of the allocator */
+  guint64 n_reused;
+  /** Objects asked from the allocator because the pool was empty */
+  guint64 n_allocated;
+  /** Objects kept by the pool now */
+  guint64 n_cached;
+  /** Bytes of the objects kept by the pool now */
+  guint64 cached_bytes;
+} NbtPoolStats;
+
+/**
+ * @brief Turn on or off the recycling of the nodes, their data and their
+ * short keys and strings.
+ *
+ * When on, `nbt_node_free` keeps the freed objects in a pool of the
+ * calling thread, and the parser and the `nbt_node_new_*` functions take
+ * them back before asking the allocator. It's off by default. Turning it
+ * off doesn't free the objects already kept, see `nbt_pool_trim`. The
+ * children of a list parsed in one block aren't pooled.
+ * @param enabled Whether to recycle
+ */
+void nbt_pool_set_enabled (gboolean enabled);
+/**
+ * @brief Whether the nodes are recycled.
+ */
+gboolean nbt_pool_get_enabled (void);
+/**
+ * @brief Free the objects kept by the pool of the calling thread. The
+ * pool of a thread is also freed when the thread exits.
+ */
+void nbt_pool_trim (void);
+/**
+ * @brief Get the counters of the pool of the calling thread.
+ * @param stats The counters to fill
+ */
+void nbt_pool_get_stats (NbtPoolStats *stats);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_POOL_H
@@ -0,0 +1,616 @@
+/*  nbt_private - Private part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_PRIVATE_H
+#define DHLRC_NBT_PRIVATE_H
+
+/* This header is only used inside the library, don't install it. */
+
+#include "nbt_allocator.h"
+#include "nbt_parse.h"
+#include <string.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The progress and cancellation state shared by the parser, the
+ * packer and the decompressing loop.
+ *
+ * The hot loops only add to `ticks` and compare it with `next_poll`, so a
+ * state without callback and cancellable costs one comparison per call.
+ * The clock and the cancellable are only looked at when `ticks` reaches
+ * `next_poll`, and the callback is never called more often than every
+ * `NBT_PROGRESS_INTERVAL` microseconds.
+ */
+typedef struct NbtProgress
+{
+  DhProgressFullSet set_func;
+  void *klass;
+  GCancellable *cancellable;
+  const char *message;
+  int min;
+  int max;
+  /** Units done, the reported value is `done` against `total` */
+  guint64 done;
+  guint64 total;
+  /** Work counter, polled when it reaches `next_poll` */
+  guint64 ticks;
+  guint64 next_poll;
+  guint64 stride;
+  gint64 last_poll;
+  gint64 last_report;
+  gboolean cancelled;
+} NbtProgress;
+
+/** The minimum interval between two reports, in microseconds */
+#define NBT_PROGRESS_INTERVAL (G_USEC_PER_SEC / 10)
+
+/**
+ * @brief Initialize the progress state and report the `min` value.
+ * @param progress The progress state
+ * @param set_func The setting function for progress, or NULL
+ * @param klass The class of the progress
+ * @param cancellable Cancellable object, or NULL
+ * @param min The minimum value of the progress
+ * @param max The maximum value of the progress
+ * @param total The units `max` stands for, or 0 if unknown
+ * @param message The message of the progress
+ */
+void nbt_progress_init (NbtProgress *progress, DhProgressFullSet set_func,
+                        void *klass, GCancellable *cancellable, int min,
+                        int max, guint64 total, const char *message);
+/**
+ * @brief The slow path of the progress: sample the clock, check the
+ * cancellable and report if the interval passed.
+ * @param progress The progress state
+ * @return FALSE when cancelled
+ */
+gboolean nbt_progress_poll (NbtProgress *progress);
+/**
+ * @brief Report the `max` value without checking the interval.
+ * @param progress The progress state
+ * @param message The message of the progress, or NULL to keep the old one
+ */
+void nbt_progress_finish (NbtProgress *progress, const char *message);
+
+/**
+ * @brief Count some work which doesn't move the reported value.
+ * @return FALSE when cancelled
+ */
+static inline gboolean
+nbt_progress_tick (NbtProgress *progress, guint64 ticks)
+{
+  progress->ticks += ticks;
+  if G_LIKELY (progress->ticks < progress->next_poll)
+    return TRUE;
+  return nbt_progress_poll (progress);
+}
+
+/**
+ * @brief Add `units` to the done units.
+ * @return FALSE when cancelled
+ */
+static inline gboolean
+nbt_progress_advance (NbtProgress *progress, guint64 units)
+{
+  progress->done += units;
+  return nbt_progress_tick (progress, units);
+}
+
+/**
+ * @brief Set the done units, used by byte counters.
+ * @return FALSE when cancelled
+ */
+static inline gboolean
+nbt_progress_set (NbtProgress *progress, guint64 done)
+{
+  guint64 units = done - progress->done;
+  progress->done = done;
+  return nbt_progress_tick (progress, units);
+}
+
+/**
+ * @brief Allocate an empty node of the tag, the way every parser does.
+ * @param tag The tag of the node
+ * @return The node, to be freed by `nbt_node_free`
+ */
+NbtNode *nbt_node_create (NBT_Tags tag);
+/**
+ * @brief Allocate the data of the tag with its key and string, which are
+ * kept in the same allocation when they're short.
+ * @param tag The tag of the data
+ * @param key The key to copy, or NULL
+ * @param string The string to copy when the tag is `TAG_String`, or NULL
+ * @return The data, freed with its node
+ */
+NbtData *nbt_data_new (NBT_Tags tag, const char *key, const char *string);
+/**
+ * @brief Allocate the data like `nbt_data_new`, from the texts of the
+ * lengths given, which needn't be '\0' ended.
+ * @param stats The statistics counting the allocations, or NULL
+ */
+NbtData *nbt_data_new_full (NBT_Tags tag, const char *key, gsize key_len,
+                            const char *string, gsize string_len,
+                            NbtStats *stats);
+/**
+ * @brief Allocate the node holding the data, from the default allocator of
+ * the thread.
+ */
+NbtNode *nbt_node_new_for_data (NbtData *data);
+
+/**
+ * @brief Allocate from the pool of the thread when it's enabled.
+ * @param size The size of the object
+ * @return The object, to be freed by `nbt_pool_free` or `g_free`
+ */
+gpointer nbt_pool_alloc (gsize size);
+/**
+ * @brief Give the object allocated by `g_malloc` or `nbt_pool_alloc` back
+ * to the pool of the thread, or free it.
+ * @param mem The object, or NULL
+ * @param size The size of the object, which might be smaller than the
+ * allocated one
+ */
+void nbt_pool_free (gpointer mem, gsize size);
+/**
+ * @brief Allocate the node from the pool of the thread, like
+ * `g_node_new`.
+ */
+GNode *nbt_pool_node_new (gpointer data);
+/**
+ * @brief Give the node allocated by `g_node_new` or `nbt_pool_node_new`
+ * back, like `g_slice_free`.
+ */
+void nbt_pool_node_free (GNode *node);
+
+/** The bytes before the memory given by `nbt_allocator_alloc` */
+#define NBT_ALLOCATOR_HEADER_SIZE (2 * sizeof (gpointer))
+
+/**
+ * @brief Allocate from the allocator and remember it in the memory.
+ * @return The memory, to be freed by `nbt_allocator_free`
+ */
+gpointer nbt_allocator_alloc (NbtAllocator *allocator, gsize size);
+/**
+ * @brief Give the memory back to the allocator it remembers.
+ */
+void nbt_allocator_free (gpointer mem);
+/**
+ * @brief Allocate a part of a tree, from the default allocator of the
+ * thread or from the pool.
+ * @param size The size of the part
+ * @param flags The flags of the data, `flag` is set in them when the part
+ * comes from the allocator
+ * @param flag The flag of the part
+ * @return The part, to be freed by `nbt_part_free`
+ */
+gpointer nbt_part_alloc (gsize size, guint32 *flags, guint32 flag);
+/**
+ * @brief Free the part allocated by `nbt_part_alloc` or `g_malloc`.
+ * @param mem The part
+ * @param size The size of the part, or 0 if unknown
+ * @param custom Whether the flag of the part was set
+ */
+void nbt_part_free (gpointer mem, gsize size, gboolean custom);
+
+/**
+ * @brief Decompress the data if it's gzip or zlib.
+ * @param data The data
+ * @param length The length of the data
+ * @param out_len Filled with the length of the result
+ * @param err Error code, or NULL to ignore
+ * @return The decompressed data to be freed by `g_free`, `data` itself if
+ * it isn't compressed, or NULL when failed
+ */
+guint8 *nbt_decompress (const guint8 *data, size_t length, size_t *out_len,
+                        GError **err);
+/**
+ * @brief Parse one value of the decompressed binary NBT into a node.
+ * @param data The decompressed data
+ * @param length The length of the data
+ * @param pos The offset of the key, or of the payload if there's no key;
+ * moved after the value
+ * @param tag The tag of the value
+ * @param has_key Whether the key is before the payload
+ * @param err Error code, or NULL to ignore
+ * @return The node, or NULL when failed
+ */
+NbtNode *nbt_node_parse_value (const guint8 *data, size_t length,
+                               size_t *pos, NBT_Tags tag, gboolean has_key,
+                               GError **err);
+
+/**
+ * @brief The state of a walk over the decompressed binary NBT which skips
+ * the values instead of parsing them.
+ *
+ * The positions are passed apart, so a walker can read the same value from
+ * several places. The first failure is kept in `error`.
+ */
+typedef struct NbtReader
+{
+  const guint8 *data;
+  gsize length;
+  GError **error;
+  gboolean failed;
+} NbtReader;
+
+/**
+ * @brief Record the failure in `NBT_GLIB_PARSE_ERROR`.
+ * @return FALSE
+ */
+gboolean nbt_reader_error (NbtReader *reader, NbtGlibParseError code,
+                           const char *message);
+/**
+ * @brief Record that the data ended too early.
+ * @return FALSE
+ */
+gboolean nbt_reader_truncated (NbtReader *reader);
+
+/**
+ * @brief Move the position over `n` bytes.
+ * @return FALSE if the data is shorter
+ */
+static inline gboolean
+nbt_reader_advance (NbtReader *reader, gsize *pos, guint64 n)
+{
+  if G_UNLIKELY (n > reader->length - *pos)
+    return nbt_reader_truncated (reader);
+  *pos += n;
+  return TRUE;
+}
+
+/**
+ * @brief Copy `n` bytes at the position and move over them.
+ * @return FALSE if the data is shorter
+ */
+static inline gboolean
+nbt_reader_read (NbtReader *reader, gsize *pos, gpointer value, gsize n)
+{
+  gsize start = *pos;
+  if (!nbt_reader_advance (reader, pos, n))
+    return FALSE;
+  memcpy (value, reader->data + start, n);
+  return TRUE;
+}
+
+static inline gboolean
+nbt_reader_read_u16 (NbtReader *reader, gsize *pos, guint16 *value)
+{
+  if (!nbt_reader_read (reader, pos, value, 2))
+    return FALSE;
+  *value = GUINT16_FROM_BE (*value);
+  return TRUE;
+}
+
+static inline gboolean
+nbt_reader_read_u32 (NbtReader *reader, gsize *pos, guint32 *value)
+{
+  if (!nbt_reader_read (reader, pos, value, 4))
+    return FALSE;
+  *value = GUINT32_FROM_BE (*value);
+  return TRUE;
+}
+
+static inline gboolean
+nbt_reader_read_u64 (NbtReader *reader, gsize *pos, guint64 *value)
+{
+  if (!nbt_reader_read (reader, pos, value, 8))
+    return FALSE;
+  *value = GUINT64_FROM_BE (*value);
+  return TRUE;
+}
+
+/**
+ * @brief Read the key at the position, in place and in modified UTF-8.
+ * @param key Filled with the bytes of the key, not '\0' ended
+ * @param len Filled with the length of the key
+ */
+static inline gboolean
+nbt_reader_read_key (NbtReader *reader, gsize *pos, const char **key,
+                     guint16 *len)
+{
+  if (!nbt_reader_read_u16 (reader, pos, len))
+    return FALSE;
+  *key = (const char *)reader->data + *pos;
+  return nbt_reader_advance (reader, pos, *len);
+}
+
+/**
+ * @brief Get the size of the payload of the numeric tag.
+ * @return The size, or 0 for the other tags
+ */
+static inline gsize
+nbt_reader_scalar_size (NBT_Tags tag)
+{
+  switch (tag)
+    {
+    case TAG_Byte:
+      return 1;
+    case TAG_Short:
+      return 2;
+    case TAG_Int:
+    case TAG_Float:
+      return 4;
+    case TAG_Long:
+    case TAG_Double:
+      return 8;
+    default:
+      return 0;
+    }
+}
+
+/**
+ * @brief Read a tag and check that it's valid.
+ */
+gboolean nbt_reader_read_tag (NbtReader *reader, gsize *pos, NBT_Tags *tag);
+/**
+ * @brief Read the tag and the length of the elements of a list.
+ */
+gboolean nbt_reader_read_list_header (NbtReader *reader, gsize *pos,
+                                      NBT_Tags *tag, guint32 *len);
+/**
+ * @brief Move the position over `n` elements of the tag.
+ */
+gboolean nbt_reader_skip_elements (NbtReader *reader, NBT_Tags tag,
+                                   guint64 n, gsize *pos);
+/**
+ * @brief Move the position from the payload of the value to its end.
+ */
+gboolean nbt_reader_skip_value (NbtReader *reader, NBT_Tags tag, gsize *pos);
+
+/**
+ * @brief Encode the text into the modified UTF-8 of the binary NBT, to
+ * compare it with the bytes in place.
+ * @param text The text in UTF-8
+ * @param length Filled with the length of the result
+ * @return The encoded text, to be freed by `g_free`
+ */
+char *nbt_modified_utf8_from_utf8 (const char *text, gsize *length);
+
+/** The key of the data is a shared payload */
+#define NBT_DATA_SHARED_KEY (1 << 0)
+/** The string or the array of the data is a shared payload */
+#define NBT_DATA_SHARED_VALUE (1 << 1)
+/** The list keeps its numbers in `value_a` instead of its children */
+#define NBT_DATA_PACKED_LIST (1 << 2)
+/** The key is kept after the data, in the same allocation */
+#define NBT_DATA_INLINE_KEY (1 << 3)
+/** The string is kept after the data, in the same allocation */
+#define NBT_DATA_INLINE_VALUE (1 << 4)
+/** The keys and the strings shorter than this are kept inline */
+#define NBT_DATA_INLINE_MAX 16
+/** The data is an element of the block of its list */
+#define NBT_DATA_IN_BLOCK (1 << 5)
+/** The node holding the data is an element of the block of its list */
+#define NBT_DATA_NODE_IN_BLOCK (1 << 6)
+/** The data comes from the allocator of its tree */
+#define NBT_DATA_CUSTOM (1 << 7)
+/** The node holding the data comes from the allocator of its tree */
+#define NBT_DATA_NODE_CUSTOM (1 << 16)
+/** The key comes from the allocator of its tree */
+#define NBT_DATA_CUSTOM_KEY (1 << 17)
+/** The value comes from the allocator of its tree */
+#define NBT_DATA_CUSTOM_VALUE (1 << 18)
+/** The flags telling where the node holding the data is, which stay with
+ * the node when the data is moved */
+#define NBT_DATA_NODE_MASK (NBT_DATA_NODE_IN_BLOCK | NBT_DATA_NODE_CUSTOM)
+/** The flags telling where the data and its node are */
+#define NBT_DATA_ALLOC_MASK                                                   \
+  (NBT_DATA_NODE_MASK | NBT_DATA_IN_BLOCK | NBT_DATA_CUSTOM)
+/** The flags telling where the data, its node, key and value are, which
+ * are never copied with the data */
+#define NBT_DATA_STORAGE_MASK                                                 \
+  (NBT_DATA_ALLOC_MASK | NBT_DATA_INLINE_KEY | NBT_DATA_INLINE_VALUE        \
+   | NBT_DATA_CUSTOM_KEY | NBT_DATA_CUSTOM_VALUE)
+/** The tag of the numbers of a packed list is kept above the flags */
+#define NBT_DATA_LIST_TYPE_SHIFT 8
+#define NBT_DATA_LIST_TYPE_MASK (0xff << NBT_DATA_LIST_TYPE_SHIFT)
+
+static inline gboolean
+nbt_data_is_packed_list (const NbtData *data)
+{
+  return data->type == TAG_List && (data->flags & NBT_DATA_PACKED_LIST);
+}
+
+/**
+ * @brief Get the tag of the numbers of the packed list.
+ */
+static inline NBT_Tags
+nbt_data_list_type (const NbtData *data)
+{
+  return (data->flags & NBT_DATA_LIST_TYPE_MASK) >> NBT_DATA_LIST_TYPE_SHIFT;
+}
+
+/**
+ * @brief Fill `element` with the number at `index` of the packed list, as
+ * the data of a child would hold it.
+ */
+static inline void
+nbt_data_get_element (const NbtData *list, gsize index, NbtData *element)
+{
+  const guint8 *value = list->value_a.value;
+  element->type = nbt_data_list_type (list);
+  element->flags &= NBT_DATA_ALLOC_MASK;
+  element->key = NULL;
+  switch (element->type)
+    {
+    case TAG_Byte:
+      element->value_i = ((const gint8 *)value)[index];
+      break;
+    case TAG_Short:
+      element->value_i = ((const gint16 *)value)[index];
+      break;
+    case TAG_Int:
+      element->value_i = ((const gint32 *)value)[index];
+      break;
+    case TAG_Long:
+      element->value_i = ((const gint64 *)value)[index];
+      break;
+    case TAG_Float:
+      element->value_d = ((const float *)value)[index];
+      break;
+    default:
+      element->value_d = ((const double *)value)[index];
+      break;
+    }
+}
+
+/**
+ * @brief The walk over the elements of a list, packed or not.
+ *
+ * The elements of a packed list are given as a node owned by the iterator,
+ * which is overwritten by the next call and has no parent. Only its data
+ * may be read.
+ */
+typedef struct NbtListIter
+{
+  NbtNode *next;
+  const NbtData *list;
+  gint32 index;
+  NbtData element;
+  NbtNode node;
+} NbtListIter;
+
+static inline void
+nbt_list_iter_init (NbtListIter *iter, NbtNode *list)
+{
+  iter->next = list->children;
+  iter->list = list->data;
+  iter->index = 0;
+  memset (&iter->node, 0, sizeof (NbtNode));
+  iter->element.flags = 0;
+  iter->node.data = &iter->element;
+}
+
+/**
+ * @brief Get the next element of the list.
+ * @return The element, or NULL after the last one
+ */
+static inline NbtNode *
+nbt_list_iter_next (NbtListIter *iter)
+{
+  if (!nbt_data_is_packed_list (iter->list))
+    {
+      NbtNode *child = iter->next;
+      if (child)
+        iter->next = child->next;
+      return child;
+    }
+  if (iter->index >= iter->list->value_a.len)
+    return NULL;
+  nbt_data_get_element (iter->list, iter->index++, &iter->element);
+  return &iter->node;
+}
+
+/**
+ * @brief Count the elements of the list, packed or not.
+ */
+static inline guint
+nbt_list_length (NbtNode *list)
+{
+  NbtData *data = list->data;
+  if (nbt_data_is_packed_list (data))
+    return data->value_a.len;
+  return g_node_n_children (list);
+}
+
+/**
+ * @brief Copy the bytes into a new reference counted payload.
+ *
+ * The payload is read-only once it's shared, it's freed by
+ * `nbt_payload_unref` instead of `g_free`.
+ * @param data The bytes to copy
+ * @param size The size of the bytes
+ * @return The payload with one reference
+ */
+gpointer nbt_payload_new (gconstpointer data, gsize size);
+/**
+ * @brief Add a reference to the payload.
+ * @return The payload
+ */
+gpointer nbt_payload_ref (gpointer payload);
+/**
+ * @brief Drop a reference to the payload, free it with the last one.
+ */
+void nbt_payload_unref (gpointer payload);
+/**
+ * @brief Check whether the payload has no other reference.
+ */
+gboolean nbt_payload_is_unique (gpointer payload);
+/**
+ * @brief Free the key of the data, by `g_free` or `nbt_payload_unref`.
+ */
+void nbt_data_free_key (NbtData *data);
+/**
+ * @brief Free the string or the array of the data, by `g_free` or
+ * `nbt_payload_unref`.
+ */
+void nbt_data_free_value (NbtData *data);
+
+/**
+ * @brief Copy the data with its key and value as shared payloads.
+ *
+ * The payloads already shared by `data` get a reference, the others are
+ * copied into new payloads. `data` isn't changed.
+ * @param copy The data to fill
+ * @param data The data to copy
+ */
+void nbt_data_copy_shared (NbtData *copy, const NbtData *data);
+
+/**
+ * @brief Parse one segment of a path in the syntax of `NbtDiffEntry`.
+ * @param p The text of the segment
+ * @param first Whether it's the first segment, which has no leading `.`
+ * @param key Filled with the key of the segment
+ * @param index Filled with the list index, or -1 when it's a key
+ * @return The text after the segment, or NULL if it's malformed
+ */
+const char *nbt_path_parse_segment (const char *p, gboolean first,
+                                    GString *key, gint64 *index);
+
+/** Big enough for every number written by the formatters below */
+#define NBT_FORMAT_BUFFER_SIZE 32
+
+/**
+ * @brief Write the decimal form of the integer, without the locale.
+ * @param buf The buffer of at least `NBT_FORMAT_BUFFER_SIZE` bytes
+ * @param value The integer
+ * @return The length written, not counting the ending `'\0'`
+ */
+int nbt_format_int64 (char *buf, gint64 value);
+/**
+ * @brief Write the shortest decimal form which reads back as the same
+ * double, without the locale.
+ *
+ * In rare cases the result has one more digit than the shortest. It always
+ * has a decimal point or an exponent. The values which aren't finite are
+ * written as `NaN`, `Infinity` and `-Infinity`.
+ * @param buf The buffer of at least `NBT_FORMAT_BUFFER_SIZE` bytes
+ * @param value The double
+ * @return The length written, not counting the ending `'\0'`
+ */
+int nbt_format_double (char *buf, double value);
+/**
+ * @brief Like `nbt_format_double`, but for the float.
+ * @sa nbt_format_double
+ */
+int nbt_format_float (char *buf, float value);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_PRIVATE_H
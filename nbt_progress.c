@@ -0,0 +1,106 @@
+/*  nbt_progress - Progress part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_private.h"
+
+/* The stride adapts so that the clock is sampled about once per
+ * millisecond, whatever a unit costs. */
+#define STRIDE_MIN 16
+#define STRIDE_MAX (1 << 20)
+#define POLL_TOO_FAST (G_USEC_PER_SEC / 2000)
+#define POLL_TOO_SLOW (G_USEC_PER_SEC / 500)
+
+static void
+report (NbtProgress *progress, gint64 now)
+{
+  int value = progress->min;
+  if (progress->total)
+    {
+      guint64 done = MIN (progress->done, progress->total);
+      value += done * (progress->max - progress->min) / progress->total;
+    }
+  progress->set_func (progress->klass, value, progress->message);
+  progress->last_report = now;
+}
+
+void
+nbt_progress_init (NbtProgress *progress, DhProgressFullSet set_func,
+                   void *klass, GCancellable *cancellable, int min, int max,
+                   guint64 total, const char *message)
+{
+  memset (progress, 0, sizeof (NbtProgress));
+  progress->set_func = klass ? set_func : NULL;
+  progress->klass = klass;
+  progress->cancellable = cancellable;
+  progress->message = message;
+  progress->min = min;
+  progress->max = max;
+  progress->total = total;
+
+  if (!progress->set_func && !cancellable)
+    {
+      /* Nothing to poll, never leave the fast path */
+      progress->next_poll = G_MAXUINT64;
+      return;
+    }
+
+  progress->stride = STRIDE_MIN;
+  progress->next_poll = STRIDE_MIN;
+  progress->last_poll = g_get_monotonic_time ();
+  if (progress->set_func)
+    report (progress, progress->last_poll);
+}
+
+gboolean
+nbt_progress_poll (NbtProgress *progress)
+{
+  if (progress->cancelled)
+    return FALSE;
+  if (g_cancellable_is_cancelled (progress->cancellable))
+    {
+      progress->cancelled = TRUE;
+      return FALSE;
+    }
+
+  gint64 now = g_get_monotonic_time ();
+  gint64 passed = now - progress->last_poll;
+  if (passed < POLL_TOO_FAST && progress->stride < STRIDE_MAX)
+    progress->stride *= 2;
+  else if (passed > POLL_TOO_SLOW && progress->stride > STRIDE_MIN)
+    progress->stride /= 2;
+  progress->last_poll = now;
+  progress->next_poll = progress->ticks + progress->stride;
+
+  if (progress->set_func
+      && now - progress->last_report >= NBT_PROGRESS_INTERVAL)
+    report (progress, now);
+  return TRUE;
+}
+
+void
+nbt_progress_finish (NbtProgress *progress, const char *message)
+{
+  if (message)
+    progress->message = message;
+  progress->done = progress->total;
+  if (progress->set_func)
+    {
+      progress->set_func (progress->klass, progress->max, progress->message);
+      progress->last_report = g_get_monotonic_time ();
+    }
+}
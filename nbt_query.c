@@ -0,0 +1,1273 @@
+/*  nbt_query - Path query part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_query.h"
+#include "nbt_private.h"
+#include "nbt_util.h"
+#include <string.h>
+
+#ifndef NBT_GLIB_DISABLE_TRANSLATION
+#include <libintl.h>
+#define _(text) gettext (text)
+#else
+#define _(text) text
+#endif
+
+typedef enum
+{
+  STEP_KEY,
+  STEP_INDEX,
+  STEP_ANY,
+  STEP_FILTER,
+} StepKind;
+
+typedef struct Filter Filter;
+
+typedef struct Step
+{
+  StepKind kind;
+  char *key;
+  /** The key in the modified UTF-8 of the binary NBT */
+  char *raw_key;
+  gsize raw_key_len;
+  gint64 index;
+  Filter *filter;
+  /** The text of the filter, to merge the equal steps */
+  char *source;
+} Step;
+
+typedef enum
+{
+  FILTER_OR,
+  FILTER_AND,
+  FILTER_NOT,
+  FILTER_EXISTS,
+  FILTER_COMPARE,
+} FilterKind;
+
+typedef enum
+{
+  COMPARE_EQ,
+  COMPARE_NE,
+  COMPARE_LT,
+  COMPARE_LE,
+  COMPARE_GT,
+  COMPARE_GE,
+} CompareOp;
+
+struct Filter
+{
+  FilterKind kind;
+  Filter *left;
+  Filter *right;
+  /** The path relative to the child, only keys and indexes */
+  Step *path;
+  guint n_path;
+  CompareOp op;
+  gboolean is_string;
+  char *string;
+  char *raw_string;
+  gsize raw_string_len;
+  double number;
+  /** The integral literals are also compared as integers */
+  gboolean is_integer;
+  gint64 integer;
+};
+
+/* The steps of the queries merged by their common beginnings */
+typedef struct Trie
+{
+  Step step;
+  /** The indexes of the queries ending here */
+  GArray *queries;
+  GPtrArray *children;
+  /** Whether a child needs more than a key or a non-negative index */
+  gboolean open;
+  /** Whether a child has a negative index */
+  gboolean from_end;
+} Trie;
+
+struct NbtQuery
+{
+  Trie *root;
+};
+
+typedef struct Parser
+{
+  const char *text;
+  const char *p;
+  GError **error;
+  gboolean failed;
+} Parser;
+
+static void filter_free (Filter *filter);
+
+static void
+step_clear (Step *step)
+{
+  g_free (step->key);
+  g_free (step->raw_key);
+  g_free (step->source);
+  filter_free (step->filter);
+}
+
+static void
+filter_free (Filter *filter)
+{
+  if (!filter)
+    return;
+  filter_free (filter->left);
+  filter_free (filter->right);
+  for (guint i = 0; i < filter->n_path; i++)
+    step_clear (&filter->path[i]);
+  g_free (filter->path);
+  g_free (filter->string);
+  g_free (filter->raw_string);
+  g_free (filter);
+}
+
+static void
+trie_free (Trie *trie)
+{
+  step_clear (&trie->step);
+  g_array_free (trie->queries, TRUE);
+  g_ptr_array_free (trie->children, TRUE);
+  g_free (trie);
+}
+
+static Trie *
+trie_new (void)
+{
+  Trie *trie = g_new0 (Trie, 1);
+  trie->queries = g_array_new (FALSE, FALSE, sizeof (guint));
+  trie->children = g_ptr_array_new_with_free_func ((GDestroyNotify)trie_free);
+  return trie;
+}
+
+/* Parsing */
+
+static void
+syntax_error (Parser *parser, const char *message)
+{
+  if (parser->failed)
+    return;
+  parser->failed = TRUE;
+  g_set_error (parser->error, NBT_GLIB_PARSE_ERROR,
+               NBT_GLIB_PARSE_ERROR_SYNTAX, _ ("At %ld of \"%s\": %s"),
+               (long)(parser->p - parser->text), parser->text, message);
+}
+
+static void
+skip_whitespace (Parser *parser)
+{
+  while (g_ascii_isspace (*parser->p))
+    parser->p++;
+}
+
+static gboolean
+is_bare_char (char c)
+{
+  return g_ascii_isalnum (c) || c == '_' || c == '-' || c == '+';
+}
+
+static char *
+parse_key (Parser *parser)
+{
+  const char *p = parser->p;
+  if (*p == '"')
+    {
+      GString *key = g_string_new (NULL);
+      for (p++; *p != '"'; p++)
+        {
+          if (*p == '\\')
+            p++;
+          if (!*p)
+            {
+              parser->p = p;
+              syntax_error (parser, _ ("Unterminated key."));
+              g_string_free (key, TRUE);
+              return NULL;
+            }
+          g_string_append_c (key, *p);
+        }
+      parser->p = p + 1;
+      return g_string_free (key, FALSE);
+    }
+  while (is_bare_char (*p))
+    p++;
+  if (p == parser->p)
+    {
+      syntax_error (parser, _ ("Expected a key."));
+      return NULL;
+    }
+  char *key = g_strndup (parser->p, p - parser->p);
+  parser->p = p;
+  return key;
+}
+
+static gboolean
+parse_key_step (Parser *parser, Step *step)
+{
+  step->kind = STEP_KEY;
+  if (!(step->key = parse_key (parser)))
+    return FALSE;
+  step->raw_key = nbt_modified_utf8_from_utf8 (step->key, &step->raw_key_len);
+  return TRUE;
+}
+
+static gboolean
+parse_index (Parser *parser, gint64 *index)
+{
+  char *end = NULL;
+  *index = g_ascii_strtoll (parser->p, &end, 10);
+  if (end == parser->p || *index < G_MININT32 || *index > G_MAXINT32)
+    {
+      syntax_error (parser, _ ("Expected an index."));
+      return FALSE;
+    }
+  parser->p = end;
+  return TRUE;
+}
+
+static gboolean
+expect (Parser *parser, char c)
+{
+  if (*parser->p != c)
+    {
+      char message[32];
+      g_snprintf (message, sizeof (message), _ ("Expected '%c'."), c);
+      syntax_error (parser, message);
+      return FALSE;
+    }
+  parser->p++;
+  return TRUE;
+}
+
+/* `@` or the keys and indexes from a child */
+static gboolean
+parse_relative_path (Parser *parser, GArray *steps)
+{
+  if (*parser->p == '@')
+    {
+      parser->p++;
+      return TRUE;
+    }
+  for (gboolean first = TRUE;; first = FALSE)
+    {
+      Step step = { 0 };
+      if (*parser->p == '[')
+        {
+          parser->p++;
+          step.kind = STEP_INDEX;
+          if (!parse_index (parser, &step.index) || !expect (parser, ']'))
+            return FALSE;
+        }
+      else if (first || *parser->p == '.')
+        {
+          if (!first)
+            parser->p++;
+          if (!parse_key_step (parser, &step))
+            return FALSE;
+        }
+      else
+        return TRUE;
+      g_array_append_val (steps, step);
+    }
+}
+
+static Filter *parse_or (Parser *parser);
+
+static Filter *
+parse_test (Parser *parser)
+{
+  skip_whitespace (parser);
+  if (*parser->p == '!')
+    {
+      parser->p++;
+      Filter *filter = g_new0 (Filter, 1);
+      filter->kind = FILTER_NOT;
+      if (!(filter->left = parse_test (parser)))
+        {
+          filter_free (filter);
+          return NULL;
+        }
+      return filter;
+    }
+  if (*parser->p == '(')
+    {
+      parser->p++;
+      Filter *filter = parse_or (parser);
+      skip_whitespace (parser);
+      if (filter && !expect (parser, ')'))
+        {
+          filter_free (filter);
+          return NULL;
+        }
+      return filter;
+    }
+
+  Filter *filter = g_new0 (Filter, 1);
+  filter->kind = FILTER_EXISTS;
+  GArray *steps = g_array_new (FALSE, TRUE, sizeof (Step));
+  gboolean ok = parse_relative_path (parser, steps);
+  filter->n_path = steps->len;
+  filter->path = (Step *)g_array_free (steps, FALSE);
+  if (!ok)
+    goto error;
+
+  skip_whitespace (parser);
+  static const struct
+  {
+    const char *text;
+    CompareOp op;
+  } ops[] = { { "==", COMPARE_EQ }, { "!=", COMPARE_NE },
+              { "<=", COMPARE_LE }, { ">=", COMPARE_GE },
+              { "<", COMPARE_LT },  { ">", COMPARE_GT } };
+  guint i = 0;
+  for (; i < G_N_ELEMENTS (ops); i++)
+    if (g_str_has_prefix (parser->p, ops[i].text))
+      break;
+  if (i == G_N_ELEMENTS (ops))
+    return filter;
+  parser->p += strlen (ops[i].text);
+  filter->kind = FILTER_COMPARE;
+  filter->op = ops[i].op;
+
+  skip_whitespace (parser);
+  if (*parser->p == '"')
+    {
+      filter->is_string = TRUE;
+      if (!(filter->string = parse_key (parser)))
+        goto error;
+      filter->raw_string
+          = nbt_modified_utf8_from_utf8 (filter->string,
+                                         &filter->raw_string_len);
+    }
+  else if (g_str_has_prefix (parser->p, "true")
+           || g_str_has_prefix (parser->p, "false"))
+    {
+      gboolean value = *parser->p == 't';
+      parser->p += value ? 4 : 5;
+      filter->is_integer = TRUE;
+      filter->integer = value;
+      filter->number = value;
+    }
+  else
+    {
+      char *end = NULL;
+      filter->number = g_ascii_strtod (parser->p, &end);
+      if (end == parser->p)
+        {
+          syntax_error (parser, _ ("Expected a string or a number."));
+          goto error;
+        }
+      char *int_end = NULL;
+      filter->integer = g_ascii_strtoll (parser->p, &int_end, 10);
+      filter->is_integer = int_end == end;
+      parser->p = end;
+    }
+  return filter;
+
+error:
+  filter_free (filter);
+  return NULL;
+}
+
+static Filter *
+parse_binary (Parser *parser, FilterKind kind)
+{
+  const char *op = kind == FILTER_OR ? "||" : "&&";
+  Filter *left = kind == FILTER_OR ? parse_binary (parser, FILTER_AND)
+                                   : parse_test (parser);
+  while (left)
+    {
+      skip_whitespace (parser);
+      if (!g_str_has_prefix (parser->p, op))
+        break;
+      parser->p += 2;
+      Filter *filter = g_new0 (Filter, 1);
+      filter->kind = kind;
+      filter->left = left;
+      filter->right = kind == FILTER_OR ? parse_binary (parser, FILTER_AND)
+                                        : parse_test (parser);
+      if (!filter->right)
+        {
+          filter_free (filter);
+          return NULL;
+        }
+      left = filter;
+    }
+  return left;
+}
+
+static Filter *
+parse_or (Parser *parser)
+{
+  return parse_binary (parser, FILTER_OR);
+}
+
+/* The bracket step after `[` */
+static gboolean
+parse_bracket (Parser *parser, Step *step)
+{
+  if (*parser->p == '*')
+    {
+      parser->p++;
+      step->kind = STEP_ANY;
+    }
+  else if (*parser->p == '?')
+    {
+      const char *start = ++parser->p;
+      step->kind = STEP_FILTER;
+      if (!(step->filter = parse_or (parser)))
+        return FALSE;
+      skip_whitespace (parser);
+      step->source = g_strndup (start, parser->p - start);
+    }
+  else if (*parser->p == '"')
+    {
+      if (!parse_key_step (parser, step))
+        return FALSE;
+    }
+  else
+    {
+      step->kind = STEP_INDEX;
+      if (!parse_index (parser, &step->index))
+        return FALSE;
+    }
+  return expect (parser, ']');
+}
+
+static GArray *
+parse_query (Parser *parser)
+{
+  GArray *steps = g_array_new (FALSE, TRUE, sizeof (Step));
+  for (gboolean first = TRUE; *parser->p; first = FALSE)
+    {
+      Step step = { 0 };
+      gboolean ok;
+      if (*parser->p == '[')
+        {
+          parser->p++;
+          ok = parse_bracket (parser, &step);
+        }
+      else if (first || *parser->p == '.')
+        {
+          if (!first)
+            parser->p++;
+          if (*parser->p == '*')
+            {
+              parser->p++;
+              step.kind = STEP_ANY;
+              ok = TRUE;
+            }
+          else
+            {
+              ok = parse_key_step (parser, &step);
+            }
+        }
+      else
+        {
+          syntax_error (parser, _ ("Expected '.' or '['."));
+          ok = FALSE;
+        }
+      if (!ok)
+        {
+          step_clear (&step);
+          for (guint i = 0; i < steps->len; i++)
+            step_clear (&g_array_index (steps, Step, i));
+          g_array_free (steps, TRUE);
+          return NULL;
+        }
+      g_array_append_val (steps, step);
+    }
+  return steps;
+}
+
+static gboolean
+step_equal (const Step *a, const Step *b)
+{
+  if (a->kind != b->kind)
+    return FALSE;
+  switch (a->kind)
+    {
+    case STEP_KEY:
+      return g_str_equal (a->key, b->key);
+    case STEP_INDEX:
+      return a->index == b->index;
+    case STEP_FILTER:
+      return g_str_equal (a->source, b->source);
+    default:
+      return TRUE;
+    }
+}
+
+/* Add the steps of the query to the trie, which takes them */
+static void
+trie_add (Trie *root, GArray *steps, guint query)
+{
+  Trie *trie = root;
+  for (guint i = 0; i < steps->len; i++)
+    {
+      Step *step = &g_array_index (steps, Step, i);
+      Trie *next = NULL;
+      for (guint j = 0; j < trie->children->len && !next; j++)
+        {
+          Trie *child = g_ptr_array_index (trie->children, j);
+          if (step_equal (&child->step, step))
+            next = child;
+        }
+      if (next)
+        step_clear (step);
+      else
+        {
+          next = trie_new ();
+          next->step = *step;
+          g_ptr_array_add (trie->children, next);
+          if (step->kind == STEP_ANY || step->kind == STEP_FILTER
+              || (step->kind == STEP_INDEX && step->index < 0))
+            trie->open = TRUE;
+          if (step->kind == STEP_INDEX && step->index < 0)
+            trie->from_end = TRUE;
+        }
+      trie = next;
+    }
+  g_array_append_val (trie->queries, query);
+  g_array_free (steps, TRUE);
+}
+
+NbtQuery *
+nbt_query_new_multi (const char *const *texts, guint n_texts, GError **error)
+{
+  g_return_val_if_fail (texts || !n_texts, NULL);
+  NbtQuery *query = g_new (NbtQuery, 1);
+  query->root = trie_new ();
+  for (guint i = 0; i < n_texts; i++)
+    {
+      Parser parser = { texts[i], texts[i], error, FALSE };
+      GArray *steps = parse_query (&parser);
+      if (!steps)
+        {
+          nbt_query_free (query);
+          return NULL;
+        }
+      trie_add (query->root, steps, i);
+    }
+  return query;
+}
+
+NbtQuery *
+nbt_query_new (const char *text, GError **error)
+{
+  g_return_val_if_fail (text, NULL);
+  return nbt_query_new_multi (&text, 1, error);
+}
+
+void
+nbt_query_free (NbtQuery *query)
+{
+  if (!query)
+    return;
+  trie_free (query->root);
+  g_free (query);
+}
+
+/* Evaluation */
+
+static NBT_Tags
+node_type (NbtNode *node)
+{
+  return ((NbtData *)node->data)->type;
+}
+
+static gboolean
+key_matches (NbtNode *node, const char *key)
+{
+  const char *node_key = ((NbtData *)node->data)->key;
+  return node_key && strcmp (node_key, key) == 0;
+}
+
+/* The element at `index` of the list. An element of a packed list has no
+ * node in the tree, it's given as the node of `element` */
+static NbtNode *
+list_element (NbtNode *list, gint64 index, NbtListIter *element)
+{
+  if (index < 0)
+    index += nbt_list_length (list);
+  if (index < 0)
+    return NULL;
+  if (!nbt_data_is_packed_list (list->data))
+    return g_node_nth_child (list, index);
+  if (index >= nbt_list_length (list))
+    return NULL;
+  nbt_list_iter_init (element, list);
+  element->index = index;
+  return nbt_list_iter_next (element);
+}
+
+static NbtNode *
+resolve (NbtNode *node, Step *path, guint n_path, NbtListIter *element)
+{
+  for (guint i = 0; i < n_path && node; i++)
+    {
+      Step *step = &path[i];
+      NbtNode *parent = node;
+      node = NULL;
+      if (step->kind == STEP_KEY && node_type (parent) == TAG_Compound)
+        {
+          for (node = parent->children; node; node = node->next)
+            if (key_matches (node, step->key))
+              break;
+        }
+      else if (step->kind == STEP_INDEX && node_type (parent) == TAG_List)
+        node = list_element (parent, step->index, element);
+    }
+  return node;
+}
+
+static int
+compare_result (int c, CompareOp op)
+{
+  switch (op)
+    {
+    case COMPARE_EQ:
+      return c == 0;
+    case COMPARE_NE:
+      return c != 0;
+    case COMPARE_LT:
+      return c < 0;
+    case COMPARE_LE:
+      return c <= 0;
+    case COMPARE_GT:
+      return c > 0;
+    default:
+      return c >= 0;
+    }
+}
+
+static int
+compare_bytes (const char *a, gsize a_len, const char *b, gsize b_len)
+{
+  int c = memcmp (a, b, MIN (a_len, b_len));
+  return c ? (c > 0) - (c < 0) : (a_len > b_len) - (a_len < b_len);
+}
+
+/* Compare the number with the literal, other tags are only unequal */
+static gboolean
+compare_number (Filter *filter, const NbtData *data)
+{
+  int c;
+  if (filter->is_string)
+    return filter->op == COMPARE_NE;
+  switch (data->type)
+    {
+    case TAG_Byte:
+    case TAG_Short:
+    case TAG_Int:
+    case TAG_Long:
+      {
+        gint64 value = data->type == TAG_Byte    ? (gint8)data->value_i
+                       : data->type == TAG_Short ? (gint16)data->value_i
+                       : data->type == TAG_Int   ? (gint32)data->value_i
+                                                 : data->value_i;
+        if (filter->is_integer)
+          c = (value > filter->integer) - (value < filter->integer);
+        else
+          c = ((double)value > filter->number)
+              - ((double)value < filter->number);
+        break;
+      }
+    case TAG_Float:
+    case TAG_Double:
+      c = (data->value_d > filter->number) - (data->value_d < filter->number);
+      if (c == 0 && data->value_d != filter->number)
+        return filter->op == COMPARE_NE;
+      break;
+    default:
+      return filter->op == COMPARE_NE;
+    }
+  return compare_result (c, filter->op);
+}
+
+static gboolean
+compare (Filter *filter, NbtNode *node)
+{
+  NbtData *data = node->data;
+  if (data->type != TAG_String)
+    return compare_number (filter, data);
+  if (!filter->is_string)
+    return filter->op == COMPARE_NE;
+  const char *value = data->value_a.value;
+  int c = compare_bytes (value, strlen (value), filter->string,
+                         strlen (filter->string));
+  return compare_result (c, filter->op);
+}
+
+static gboolean
+filter_matches (Filter *filter, NbtNode *node)
+{
+  NbtListIter element;
+  switch (filter->kind)
+    {
+    case FILTER_OR:
+      return filter_matches (filter->left, node)
+             || filter_matches (filter->right, node);
+    case FILTER_AND:
+      return filter_matches (filter->left, node)
+             && filter_matches (filter->right, node);
+    case FILTER_NOT:
+      return !filter_matches (filter->left, node);
+    case FILTER_EXISTS:
+      return resolve (node, filter->path, filter->n_path, &element) != NULL;
+    default:
+      {
+        NbtNode *target
+            = resolve (node, filter->path, filter->n_path, &element);
+        return target && compare (filter, target);
+      }
+    }
+}
+
+typedef struct Runner
+{
+  NbtQueryFunc func;
+  gpointer user_data;
+  /** Whether the elements of packed lists are given as new nodes, which
+   * outlive the call of `func` */
+  gboolean copy_elements;
+  /** Whether the copies are kept in `copies` for `free_match` */
+  gboolean track_copies;
+  guint n_copies;
+} Runner;
+
+/* The copies of the packed elements held by the arrays of
+ * `nbt_query_eval`. The nodes are told apart by their addresses, so a dup
+ * of a copy put in a tree is never taken for one */
+static GMutex copies_mutex;
+static GHashTable *copies;
+
+static void
+copies_add (NbtNode *node)
+{
+  g_mutex_lock (&copies_mutex);
+  if (!copies)
+    copies = g_hash_table_new (NULL, NULL);
+  g_hash_table_add (copies, node);
+  g_mutex_unlock (&copies_mutex);
+}
+
+static gboolean
+run (Runner *runner, Trie *trie, NbtNode *node, gboolean element)
+{
+  for (guint i = 0; i < trie->queries->len; i++)
+    {
+      NbtNode *match = node;
+      if (element && runner->copy_elements)
+        {
+          match = nbt_node_dup (node);
+          if (runner->track_copies)
+            copies_add (match);
+          runner->n_copies++;
+        }
+      if (!runner->func (g_array_index (trie->queries, guint, i), match,
+                         runner->user_data))
+        return FALSE;
+    }
+
+  NBT_Tags type = node_type (node);
+  if (!trie->children->len || (type != TAG_List && type != TAG_Compound))
+    return TRUE;
+  gboolean packed = nbt_data_is_packed_list (node->data);
+
+  /* One pass over the children serves every step, and it stops when
+   * every key and index is found unless a step needs every child. The
+   * elements of a packed list are read in place */
+  guint n_children = trie->from_end ? nbt_list_length (node) : 0;
+  guint left = trie->children->len;
+  gint64 index = 0;
+  NbtListIter iter;
+  nbt_list_iter_init (&iter, node);
+  for (NbtNode *child; (child = nbt_list_iter_next (&iter)); index++)
+    {
+      for (guint i = 0; i < trie->children->len; i++)
+        {
+          Trie *next = g_ptr_array_index (trie->children, i);
+          Step *step = &next->step;
+          gboolean matched;
+          switch (step->kind)
+            {
+            case STEP_KEY:
+              matched = type == TAG_Compound && key_matches (child, step->key);
+              break;
+            case STEP_INDEX:
+              matched = type == TAG_List
+                        && index
+                               == (step->index < 0 ? step->index + n_children
+                                                   : step->index);
+              break;
+            case STEP_ANY:
+              matched = TRUE;
+              break;
+            default:
+              matched = filter_matches (step->filter, child);
+              break;
+            }
+          if (!matched)
+            continue;
+          if (!run (runner, next, child, packed))
+            return FALSE;
+          if (left)
+            left--;
+        }
+      if (!trie->open && !left)
+        break;
+    }
+  return TRUE;
+}
+
+gboolean
+nbt_query_run (NbtQuery *query, NbtNode *root, NbtQueryFunc func,
+               gpointer user_data)
+{
+  g_return_val_if_fail (query && root && func, FALSE);
+  Runner runner = { func, user_data, FALSE, FALSE, 0 };
+  return run (&runner, query->root, root, FALSE);
+}
+
+static gboolean
+collect (guint query, NbtNode *node, gpointer user_data)
+{
+  g_ptr_array_add (user_data, node);
+  return TRUE;
+}
+
+/* The nodes of the tree stay, the copies of the elements go */
+static void
+free_match (gpointer node)
+{
+  g_mutex_lock (&copies_mutex);
+  gboolean copy = g_hash_table_remove (copies, node);
+  g_mutex_unlock (&copies_mutex);
+  if (copy)
+    nbt_node_free (node);
+}
+
+GPtrArray *
+nbt_query_eval (NbtQuery *query, NbtNode *root)
+{
+  g_return_val_if_fail (query && root, NULL);
+  GPtrArray *matches = g_ptr_array_new ();
+  Runner runner = { collect, matches, TRUE, TRUE, 0 };
+  run (&runner, query->root, root, FALSE);
+  /* Only the arrays holding copies look them up when they're freed */
+  if (runner.n_copies)
+    g_ptr_array_set_free_func (matches, free_match);
+  return matches;
+}
+
+static gboolean
+take_first (guint query, NbtNode *node, gpointer user_data)
+{
+  *(NbtNode **)user_data = node;
+  return FALSE;
+}
+
+NbtNode *
+nbt_query_first (NbtQuery *query, NbtNode *root)
+{
+  g_return_val_if_fail (query && root, NULL);
+  NbtNode *first = NULL;
+  Runner runner = { take_first, &first, TRUE, FALSE, 0 };
+  run (&runner, query->root, root, FALSE);
+  return first;
+}
+
+/* Evaluation over the binary NBT */
+
+typedef struct Scanner
+{
+  NbtReader reader;
+  NbtQueryFunc func;
+  gpointer user_data;
+  /** Whether `func` takes the matched nodes */
+  gboolean take;
+} Scanner;
+
+/* The key position of the list elements, which have no key */
+#define NO_KEY G_MAXSIZE
+
+/* Move `*pos` from the payload of the value to the payload at the path */
+static gboolean
+resolve_raw (Scanner *scanner, Step *path, guint n_path, NBT_Tags *tag,
+             gsize *pos)
+{
+  NbtReader *reader = &scanner->reader;
+  for (guint i = 0; i < n_path; i++)
+    {
+      Step *step = &path[i];
+      if (step->kind == STEP_KEY && *tag == TAG_Compound)
+        {
+          while (TRUE)
+            {
+              NBT_Tags type;
+              const char *key;
+              guint16 key_len;
+              if (!nbt_reader_read_tag (reader, pos, &type) || type == TAG_End
+                  || !nbt_reader_read_key (reader, pos, &key, &key_len))
+                return FALSE;
+              if (key_len == step->raw_key_len
+                  && memcmp (key, step->raw_key, key_len) == 0)
+                {
+                  *tag = type;
+                  break;
+                }
+              if (!nbt_reader_skip_value (reader, type, pos))
+                return FALSE;
+            }
+        }
+      else if (step->kind == STEP_INDEX && *tag == TAG_List)
+        {
+          NBT_Tags type;
+          guint32 len;
+          if (!nbt_reader_read_list_header (reader, pos, &type, &len))
+            return FALSE;
+          gint64 index = step->index < 0 ? step->index + len : step->index;
+          if (index < 0 || index >= len
+              || !nbt_reader_skip_elements (reader, type, index, pos))
+            return FALSE;
+          *tag = type;
+        }
+      else
+        return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+compare_raw (Scanner *scanner, Filter *filter, NBT_Tags tag, gsize pos)
+{
+  NbtReader *reader = &scanner->reader;
+  NbtData data = { 0 };
+  data.type = tag;
+  switch (tag)
+    {
+    case TAG_String:
+      {
+        guint16 len;
+        if (!nbt_reader_read_u16 (reader, &pos, &len)
+            || !nbt_reader_advance (reader, &pos, len))
+          return FALSE;
+        if (!filter->is_string)
+          return filter->op == COMPARE_NE;
+        int c = compare_bytes ((const char *)reader->data + pos - len, len,
+                               filter->raw_string, filter->raw_string_len);
+        return compare_result (c, filter->op);
+      }
+    case TAG_Byte:
+      {
+        guint8 value;
+        if (!nbt_reader_read (reader, &pos, &value, 1))
+          return FALSE;
+        data.value_i = value;
+        break;
+      }
+    case TAG_Short:
+      {
+        guint16 value;
+        if (!nbt_reader_read_u16 (reader, &pos, &value))
+          return FALSE;
+        data.value_i = value;
+        break;
+      }
+    case TAG_Int:
+    case TAG_Float:
+      {
+        guint32 value;
+        if (!nbt_reader_read_u32 (reader, &pos, &value))
+          return FALSE;
+        if (tag == TAG_Int)
+          data.value_i = value;
+        else
+          {
+            float f;
+            memcpy (&f, &value, sizeof (f));
+            data.value_d = f;
+          }
+        break;
+      }
+    case TAG_Long:
+    case TAG_Double:
+      {
+        guint64 value;
+        if (!nbt_reader_read_u64 (reader, &pos, &value))
+          return FALSE;
+        if (tag == TAG_Long)
+          data.value_i = value;
+        else
+          memcpy (&data.value_d, &value, sizeof (double));
+        break;
+      }
+    default:
+      break;
+    }
+  return compare_number (filter, &data);
+}
+
+static gboolean
+filter_matches_raw (Scanner *scanner, Filter *filter, NBT_Tags tag,
+                    gsize pos)
+{
+  switch (filter->kind)
+    {
+    case FILTER_OR:
+      return filter_matches_raw (scanner, filter->left, tag, pos)
+             || filter_matches_raw (scanner, filter->right, tag, pos);
+    case FILTER_AND:
+      return filter_matches_raw (scanner, filter->left, tag, pos)
+             && filter_matches_raw (scanner, filter->right, tag, pos);
+    case FILTER_NOT:
+      return !filter_matches_raw (scanner, filter->left, tag, pos);
+    case FILTER_EXISTS:
+      return resolve_raw (scanner, filter->path, filter->n_path, &tag, &pos);
+    default:
+      return resolve_raw (scanner, filter->path, filter->n_path, &tag, &pos)
+             && compare_raw (scanner, filter, tag, pos);
+    }
+}
+
+/* Parse the matched value into a node for `func` */
+static gboolean
+emit_raw (Scanner *scanner, Trie *trie, NBT_Tags tag, gsize key_pos,
+          gsize *pos)
+{
+  NbtReader *reader = &scanner->reader;
+  gboolean has_key = key_pos != NO_KEY;
+  gsize end = has_key ? key_pos : *pos;
+  NbtNode *node = nbt_node_parse_value (reader->data, reader->length, &end,
+                                        tag, has_key, reader->error);
+  if (!node)
+    {
+      reader->failed = TRUE;
+      return FALSE;
+    }
+  guint n = trie->queries->len;
+  gboolean go_on = TRUE;
+  guint i = 0;
+  for (; i < n && go_on; i++)
+    {
+      /* Every query takes its own node */
+      NbtNode *match
+          = scanner->take && i + 1 < n ? nbt_node_dup (node) : node;
+      go_on = scanner->func (g_array_index (trie->queries, guint, i), match,
+                             scanner->user_data);
+    }
+  if (!scanner->take || i < n)
+    nbt_node_free (node);
+  *pos = end;
+  return go_on;
+}
+
+static gboolean scan (Scanner *scanner, Trie *trie, NBT_Tags tag,
+                      gsize key_pos, gsize *pos);
+
+static gboolean
+scan_compound (Scanner *scanner, Trie *trie, gsize *pos)
+{
+  NbtReader *reader = &scanner->reader;
+  guint left = trie->children->len;
+  while (TRUE)
+    {
+      NBT_Tags type;
+      const char *key;
+      guint16 key_len;
+      if (!nbt_reader_read_tag (reader, pos, &type))
+        return FALSE;
+      if (type == TAG_End)
+        return TRUE;
+      gsize key_pos = *pos;
+      if (!nbt_reader_read_key (reader, pos, &key, &key_len))
+        return FALSE;
+
+      /* The steps matching the same child scan it from the same place */
+      gsize end = 0;
+      for (guint i = 0; i < trie->children->len && (trie->open || left); i++)
+        {
+          Trie *next = g_ptr_array_index (trie->children, i);
+          Step *step = &next->step;
+          gboolean matched;
+          switch (step->kind)
+            {
+            case STEP_KEY:
+              matched = key_len == step->raw_key_len
+                        && memcmp (key, step->raw_key, key_len) == 0;
+              break;
+            case STEP_ANY:
+              matched = TRUE;
+              break;
+            case STEP_FILTER:
+              matched = filter_matches_raw (scanner, step->filter, type, *pos);
+              if (reader->failed)
+                return FALSE;
+              break;
+            default:
+              matched = FALSE;
+              break;
+            }
+          if (!matched)
+            continue;
+          gsize child_pos = *pos;
+          if (!scan (scanner, next, type, key_pos, &child_pos))
+            return FALSE;
+          end = child_pos;
+          if (step->kind == STEP_KEY && left)
+            left--;
+        }
+      if (end)
+        *pos = end;
+      else if (!nbt_reader_skip_value (reader, type, pos))
+        return FALSE;
+    }
+}
+
+static gboolean
+scan_list (Scanner *scanner, Trie *trie, gsize *pos)
+{
+  NbtReader *reader = &scanner->reader;
+  NBT_Tags type;
+  guint32 len;
+  if (!nbt_reader_read_list_header (reader, pos, &type, &len))
+    return FALSE;
+  guint left = trie->children->len;
+  for (guint32 index = 0; index < len; index++)
+    {
+      /* Jump over the rest once every index is found */
+      if (!trie->open && !left)
+        return nbt_reader_skip_elements (reader, type, len - index, pos);
+      gsize end = 0;
+      for (guint i = 0; i < trie->children->len; i++)
+        {
+          Trie *next = g_ptr_array_index (trie->children, i);
+          Step *step = &next->step;
+          gboolean matched;
+          switch (step->kind)
+            {
+            case STEP_INDEX:
+              matched = index
+                        == (step->index < 0 ? step->index + len
+                                            : step->index);
+              break;
+            case STEP_ANY:
+              matched = TRUE;
+              break;
+            case STEP_FILTER:
+              matched = filter_matches_raw (scanner, step->filter, type, *pos);
+              if (reader->failed)
+                return FALSE;
+              break;
+            default:
+              matched = FALSE;
+              break;
+            }
+          if (!matched)
+            continue;
+          gsize child_pos = *pos;
+          if (!scan (scanner, next, type, NO_KEY, &child_pos))
+            return FALSE;
+          end = child_pos;
+          if (step->kind == STEP_INDEX && left)
+            left--;
+        }
+      if (end)
+        *pos = end;
+      else if (!nbt_reader_skip_value (reader, type, pos))
+        return FALSE;
+    }
+  return TRUE;
+}
+
+/* Move `*pos` from the payload of the value to its end, emitting the
+ * matches inside it */
+static gboolean
+scan (Scanner *scanner, Trie *trie, NBT_Tags tag, gsize key_pos, gsize *pos)
+{
+  NbtReader *reader = &scanner->reader;
+  if (trie->queries->len)
+    {
+      gsize start = *pos;
+      if (!emit_raw (scanner, trie, tag, key_pos, pos))
+        return FALSE;
+      if (!trie->children->len)
+        return TRUE;
+      *pos = start;
+    }
+  if (tag == TAG_Compound && trie->children->len)
+    return scan_compound (scanner, trie, pos);
+  if (tag == TAG_List && trie->children->len)
+    return scan_list (scanner, trie, pos);
+  return nbt_reader_skip_value (reader, tag, pos);
+}
+
+static gboolean
+run_bytes (NbtQuery *query, const guint8 *data, gsize length,
+           NbtQueryFunc func, gpointer user_data, gboolean take,
+           GError **error)
+{
+  gsize raw_length = 0;
+  guint8 *raw = nbt_decompress (data, length, &raw_length, error);
+  if (!raw)
+    return FALSE;
+  Scanner scanner
+      = { { raw, raw_length, error, FALSE }, func, user_data, take };
+  gsize pos = 0;
+  NBT_Tags tag;
+  const char *key;
+  guint16 key_len;
+  gboolean ok = nbt_reader_read_tag (&scanner.reader, &pos, &tag);
+  if (ok && tag == TAG_End)
+    ok = nbt_reader_error (&scanner.reader, NBT_GLIB_PARSE_ERROR_INVALID_TAG,
+                     _ ("The tag is invalid."));
+  gsize key_pos = pos;
+  ok = ok && nbt_reader_read_key (&scanner.reader, &pos, &key, &key_len)
+       && scan (&scanner, query->root, tag, key_pos, &pos);
+  if (raw != data)
+    g_free (raw);
+  return ok;
+}
+
+gboolean
+nbt_query_run_bytes (NbtQuery *query, const guint8 *data, gsize length,
+                     NbtQueryFunc func, gpointer user_data, GError **error)
+{
+  g_return_val_if_fail (query && data && func, FALSE);
+  return run_bytes (query, data, length, func, user_data, FALSE, error);
+}
+
+GPtrArray *
+nbt_query_eval_bytes (NbtQuery *query, const guint8 *data, gsize length,
+                      GError **error)
+{
+  g_return_val_if_fail (query && data, NULL);
+  GPtrArray *matches
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)nbt_node_free);
+  if (!run_bytes (query, data, length, collect, matches, TRUE, error))
+    {
+      g_ptr_array_unref (matches);
+      return NULL;
+    }
+  return matches;
+}
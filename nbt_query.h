@@ -0,0 +1,142 @@
+/*  nbt_query - Path query part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_QUERY_H
+#define DHLRC_NBT_QUERY_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief A compiled set of path queries.
+ *
+ * A query is a sequence of steps from the root:
+ * - `key` or `"quoted key"`, with a leading `.` after the first step, or
+ *   `["quoted key"]` picks the child of a compound;
+ * - `[n]` picks the element of a list, `[-1]` is the last one;
+ * - `*` or `[*]` picks every child;
+ * - `[?filter]` picks every child for which the filter is true.
+ *
+ * A filter compares a path relative to the child (`@` is the child
+ * itself) with a string, a number, `true` or `false` by `==`, `!=`, `<`,
+ * `<=`, `>` or `>=`. A path alone tests that it exists, `!` negates, and
+ * the tests are combined by `&&` and `||`, like
+ * `sections[*].block_states.palette[?Name=="minecraft:chest"]`.
+ *
+ * The queries are compiled once and share their common beginnings, so
+ * evaluating many of them walks the tree once. The query can be used from
+ * many threads at the same time.
+ */
+typedef struct NbtQuery NbtQuery;
+
+/**
+ * @brief The function called with every match.
+ * @param query The index of the matched query in the compiled set
+ * @param node The matched node
+ * @param user_data The user data
+ * @return FALSE to stop the evaluation
+ */
+typedef gboolean (*NbtQueryFunc) (guint query, NbtNode *node,
+                                  gpointer user_data);
+
+/**
+ * @brief Compile the query.
+ * @param text The query
+ * @param error Error code, or NULL to ignore
+ * @return The compiled query, or NULL when the syntax is invalid
+ */
+NbtQuery *nbt_query_new (const char *text, GError **error);
+/**
+ * @brief Compile the queries into one set, evaluated together.
+ * @param texts The queries
+ * @param n_texts The count of the queries
+ * @param error Error code, or NULL to ignore
+ * @return The compiled set, or NULL when a syntax is invalid
+ */
+NbtQuery *nbt_query_new_multi (const char *const *texts, guint n_texts,
+                               GError **error);
+/**
+ * @brief Free the compiled query.
+ */
+void nbt_query_free (NbtQuery *query);
+/**
+ * @brief Evaluate the queries in one walk of the tree.
+ *
+ * The matches of a single query are reported in the order of the tree,
+ * which isn't changed. An element of a packed list of numbers has no node
+ * in the tree: it's given as a temporary node without a parent, which is
+ * only valid during the call of `func` and must not be changed.
+ * @param query The compiled queries
+ * @param root The root of the tree
+ * @param func The function called with every match
+ * @param user_data The user data of `func`
+ * @return FALSE if `func` stopped the evaluation
+ */
+gboolean nbt_query_run (NbtQuery *query, NbtNode *root, NbtQueryFunc func,
+                        gpointer user_data);
+/**
+ * @brief Collect the matches of every query.
+ *
+ * An element of a packed list of numbers is matched as a new node without
+ * a parent, owned by the array.
+ * @param query The compiled queries
+ * @param root The root of the tree
+ * @return The matched nodes, owned by the tree except for those elements,
+ * to be freed by `g_ptr_array_unref` before the tree
+ */
+GPtrArray *nbt_query_eval (NbtQuery *query, NbtNode *root);
+/**
+ * @brief Find the first match of the queries.
+ * @return The node, or NULL if nothing matches. An element of a packed
+ * list of numbers is returned as a new node without a parent, to be freed
+ * by `nbt_node_free`
+ */
+NbtNode *nbt_query_first (NbtQuery *query, NbtNode *root);
+
+/**
+ * @brief Evaluate the queries over the binary NBT without building the
+ * tree.
+ *
+ * The values no query goes into are skipped by their lengths, only the
+ * matched values are parsed into nodes, which are freed after `func`
+ * returns.
+ * @param query The compiled queries
+ * @param data The binary NBT, raw or compressed by gzip or zlib
+ * @param length The length of the data
+ * @param func The function called with every match
+ * @param user_data The user data of `func`
+ * @param error Error code, or NULL to ignore
+ * @return FALSE if the data is malformed or `func` stopped the evaluation,
+ * `error` is only set in the former case
+ */
+gboolean nbt_query_run_bytes (NbtQuery *query, const guint8 *data,
+                              gsize length, NbtQueryFunc func,
+                              gpointer user_data, GError **error);
+/**
+ * @brief Collect the matches of every query over the binary NBT.
+ * @sa nbt_query_run_bytes
+ * @return The matched nodes, owned by the array, or NULL when the data is
+ * malformed
+ */
+GPtrArray *nbt_query_eval_bytes (NbtQuery *query, const guint8 *data,
+                                 gsize length, GError **error);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_QUERY_H
@@ -0,0 +1,166 @@
+/*  nbt_reader - Binary NBT reading part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_private.h"
+#include <string.h>
+
+#ifndef NBT_GLIB_DISABLE_TRANSLATION
+#include <libintl.h>
+#define _(text) gettext (text)
+#else
+#define _(text) text
+#endif
+
+gboolean
+nbt_reader_error (NbtReader *reader, NbtGlibParseError code,
+                  const char *message)
+{
+  if (!reader->failed)
+    g_set_error_literal (reader->error, NBT_GLIB_PARSE_ERROR, code, message);
+  reader->failed = TRUE;
+  return FALSE;
+}
+
+gboolean
+nbt_reader_truncated (NbtReader *reader)
+{
+  return nbt_reader_error (reader, NBT_GLIB_PARSE_ERROR_INTERRUPTED,
+                           _ ("The data ended in the middle of a value."));
+}
+
+gboolean
+nbt_reader_read_tag (NbtReader *reader, gsize *pos, NBT_Tags *tag)
+{
+  guint8 value;
+  if (!nbt_reader_read (reader, pos, &value, 1))
+    return FALSE;
+  if (value > TAG_Long_Array)
+    return nbt_reader_error (reader, NBT_GLIB_PARSE_ERROR_INVALID_TAG,
+                             _ ("The tag is invalid."));
+  *tag = value;
+  return TRUE;
+}
+
+gboolean
+nbt_reader_read_list_header (NbtReader *reader, gsize *pos, NBT_Tags *tag,
+                             guint32 *len)
+{
+  if (!nbt_reader_read_tag (reader, pos, tag)
+      || !nbt_reader_read_u32 (reader, pos, len))
+    return FALSE;
+  if (*tag == TAG_End && *len != 0)
+    return nbt_reader_error (reader, NBT_GLIB_PARSE_ERROR_INVALID_TAG,
+                             _ ("The tag of the list is invalid."));
+  return TRUE;
+}
+
+gboolean
+nbt_reader_skip_elements (NbtReader *reader, NBT_Tags tag, guint64 n,
+                          gsize *pos)
+{
+  gsize size = nbt_reader_scalar_size (tag);
+  if (size)
+    return nbt_reader_advance (reader, pos, n * size);
+  for (; n; n--)
+    if (!nbt_reader_skip_value (reader, tag, pos))
+      return FALSE;
+  return TRUE;
+}
+
+gboolean
+nbt_reader_skip_value (NbtReader *reader, NBT_Tags tag, gsize *pos)
+{
+  switch (tag)
+    {
+    case TAG_String:
+      {
+        guint16 len;
+        return nbt_reader_read_u16 (reader, pos, &len)
+               && nbt_reader_advance (reader, pos, len);
+      }
+    case TAG_Byte_Array:
+    case TAG_Int_Array:
+    case TAG_Long_Array:
+      {
+        guint32 len;
+        guint64 size = tag == TAG_Byte_Array  ? 1
+                       : tag == TAG_Int_Array ? 4
+                                              : 8;
+        return nbt_reader_read_u32 (reader, pos, &len)
+               && nbt_reader_advance (reader, pos, len * size);
+      }
+    case TAG_List:
+      {
+        NBT_Tags type;
+        guint32 len;
+        return nbt_reader_read_list_header (reader, pos, &type, &len)
+               && nbt_reader_skip_elements (reader, type, len, pos);
+      }
+    case TAG_Compound:
+      while (TRUE)
+        {
+          NBT_Tags type;
+          const char *key;
+          guint16 key_len;
+          if (!nbt_reader_read_tag (reader, pos, &type))
+            return FALSE;
+          if (type == TAG_End)
+            return TRUE;
+          if (!nbt_reader_read_key (reader, pos, &key, &key_len)
+              || !nbt_reader_skip_value (reader, type, pos))
+            return FALSE;
+        }
+    default:
+      return nbt_reader_advance (reader, pos, nbt_reader_scalar_size (tag));
+    }
+}
+
+/* The binary NBT writes the strings in the modified UTF-8 of Java: the
+ * characters out of the BMP are the surrogates encoded one by one */
+char *
+nbt_modified_utf8_from_utf8 (const char *text, gsize *length)
+{
+  glong n = 0;
+  gunichar2 *utf16 = g_utf8_to_utf16 (text, -1, NULL, &n, NULL);
+  if (!utf16)
+    {
+      *length = strlen (text);
+      return g_strdup (text);
+    }
+  GString *out = g_string_sized_new (n);
+  for (glong i = 0; i < n; i++)
+    {
+      gunichar2 c = utf16[i];
+      if (c < 0x80)
+        g_string_append_c (out, c);
+      else if (c < 0x800)
+        {
+          g_string_append_c (out, 0xc0 | (c >> 6));
+          g_string_append_c (out, 0x80 | (c & 0x3f));
+        }
+      else
+        {
+          g_string_append_c (out, 0xe0 | (c >> 12));
+          g_string_append_c (out, 0x80 | ((c >> 6) & 0x3f));
+          g_string_append_c (out, 0x80 | (c & 0x3f));
+        }
+    }
+  g_free (utf16);
+  *length = out->len;
+  return g_string_free (out, FALSE);
+}
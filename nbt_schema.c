@@ -0,0 +1,497 @@
+/*  nbt_schema - Schema decoding part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_schema.h"
+#include "nbt_private.h"
+#include "nbt_util.h"
+
+#ifndef NBT_GLIB_DISABLE_TRANSLATION
+#include <libintl.h>
+#define _(text) gettext (text)
+#else
+#define _(text) text
+#endif
+
+GQuark
+nbt_schema_error_quark (void)
+{
+  static GQuark q;
+  if G_UNLIKELY (q == 0)
+    q = g_quark_from_static_string ("nbt-glib-schema-error-quark");
+  return q;
+}
+
+/* A key of the table, in the encoding of the tree or of the binary NBT */
+typedef struct Slot
+{
+  const char *key;
+  gsize len;
+  guint hash;
+  /** The index of the field, or -1 when the slot is empty */
+  int field;
+} Slot;
+
+struct NbtSchema
+{
+  NbtSchemaField *fields;
+  guint n_fields;
+  /** The UTF-8 keys, matched against the tree */
+  Slot *keys;
+  /** The modified UTF-8 keys, matched against the binary NBT */
+  Slot *raw_keys;
+  char **raw_key_data;
+  /** The size of both tables, a power of 2 */
+  guint mask;
+};
+
+static guint
+hash_key (const char *key, gsize len)
+{
+  /* FNV-1a */
+  guint32 hash = 2166136261u;
+  for (gsize i = 0; i < len; i++)
+    hash = (hash ^ (guint8)key[i]) * 16777619u;
+  return hash;
+}
+
+static void
+slot_insert (Slot *table, guint mask, const char *key, gsize len, int field)
+{
+  guint hash = hash_key (key, len);
+  guint i = hash & mask;
+  while (table[i].field >= 0)
+    {
+      /* The first field of a key wins */
+      if (table[i].hash == hash && table[i].len == len
+          && memcmp (table[i].key, key, len) == 0)
+        return;
+      i = (i + 1) & mask;
+    }
+  table[i] = (Slot){ key, len, hash, field };
+}
+
+static inline int
+slot_lookup (const Slot *table, guint mask, const char *key, gsize len)
+{
+  guint hash = hash_key (key, len);
+  for (guint i = hash & mask; table[i].field >= 0; i = (i + 1) & mask)
+    if (table[i].hash == hash && table[i].len == len
+        && memcmp (table[i].key, key, len) == 0)
+      return table[i].field;
+  return -1;
+}
+
+NbtSchema *
+nbt_schema_new (const NbtSchemaField *fields, guint n_fields)
+{
+  g_return_val_if_fail (fields || !n_fields, NULL);
+  for (guint i = 0; i < n_fields; i++)
+    g_return_val_if_fail (fields[i].key, NULL);
+  NbtSchema *schema = g_new0 (NbtSchema, 1);
+  schema->fields = g_new (NbtSchemaField, n_fields);
+  schema->n_fields = n_fields;
+  schema->raw_key_data = g_new (char *, n_fields);
+
+  /* Keep the tables at most half full */
+  guint size = 8;
+  while (size < n_fields * 2)
+    size *= 2;
+  schema->mask = size - 1;
+  schema->keys = g_new (Slot, size);
+  schema->raw_keys = g_new (Slot, size);
+  for (guint i = 0; i < size; i++)
+    schema->keys[i].field = schema->raw_keys[i].field = -1;
+
+  for (guint i = 0; i < n_fields; i++)
+    {
+      schema->fields[i] = fields[i];
+      schema->fields[i].key = g_strdup (fields[i].key);
+      const char *key = schema->fields[i].key;
+      slot_insert (schema->keys, schema->mask, key, strlen (key), i);
+      gsize raw_len = 0;
+      schema->raw_key_data[i] = nbt_modified_utf8_from_utf8 (key, &raw_len);
+      slot_insert (schema->raw_keys, schema->mask, schema->raw_key_data[i],
+                   raw_len, i);
+    }
+  return schema;
+}
+
+void
+nbt_schema_free (NbtSchema *schema)
+{
+  if (!schema)
+    return;
+  for (guint i = 0; i < schema->n_fields; i++)
+    {
+      g_free ((char *)schema->fields[i].key);
+      g_free (schema->raw_key_data[i]);
+    }
+  g_free (schema->fields);
+  g_free (schema->raw_key_data);
+  g_free (schema->keys);
+  g_free (schema->raw_keys);
+  g_free (schema);
+}
+
+static gsize
+array_element_size (NBT_Tags type)
+{
+  switch (type)
+    {
+    case TAG_Byte_Array:
+      return 1;
+    case TAG_Int_Array:
+      return 4;
+    case TAG_Long_Array:
+      return 8;
+    default:
+      return 0;
+    }
+}
+
+/* Free the owned value of the member, if the tag has one */
+static void
+field_clear (const NbtSchemaField *field, gpointer out)
+{
+  gpointer member = G_STRUCT_MEMBER_P (out, field->offset);
+  switch (field->type)
+    {
+    case TAG_String:
+      g_clear_pointer ((char **)member, g_free);
+      break;
+    case TAG_Byte_Array:
+    case TAG_Int_Array:
+    case TAG_Long_Array:
+      {
+        NbtSchemaArray *array = member;
+        g_clear_pointer (&array->value, g_free);
+        array->len = 0;
+        break;
+      }
+    case TAG_List:
+    case TAG_Compound:
+      g_clear_pointer ((NbtNode **)member, nbt_node_free);
+      break;
+    default:
+      break;
+    }
+}
+
+void
+nbt_schema_clear (NbtSchema *schema, gpointer out)
+{
+  g_return_if_fail (schema && out);
+  for (guint i = 0; i < schema->n_fields; i++)
+    field_clear (&schema->fields[i], out);
+}
+
+static void
+set_number (const NbtSchemaField *field, gpointer out, gint64 value_i,
+            double value_d)
+{
+  gpointer member = G_STRUCT_MEMBER_P (out, field->offset);
+  switch (field->type)
+    {
+    case TAG_Byte:
+      *(gint8 *)member = value_i;
+      break;
+    case TAG_Short:
+      *(gint16 *)member = value_i;
+      break;
+    case TAG_Int:
+      *(gint32 *)member = value_i;
+      break;
+    case TAG_Long:
+      *(gint64 *)member = value_i;
+      break;
+    case TAG_Float:
+      *(float *)member = value_d;
+      break;
+    case TAG_Double:
+      *(double *)member = value_d;
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/* Check the tag of the matched key, and drop the value of a duplicate. The
+ * key is marked as seen once the value is filled, so the defaults of the
+ * caller are never freed */
+static gboolean
+field_begin (NbtSchema *schema, int index, NBT_Tags type, gpointer out,
+             gboolean *seen, GError **error)
+{
+  const NbtSchemaField *field = &schema->fields[index];
+  if (field->type != type)
+    {
+      g_set_error (error, NBT_SCHEMA_ERROR, NBT_SCHEMA_ERROR_TYPE,
+                   _ ("The key \"%s\" has the tag %d instead of %d."),
+                   field->key, type, field->type);
+      return FALSE;
+    }
+  if (seen[index])
+    field_clear (field, out);
+  return TRUE;
+}
+
+/* Check the required keys, or free the owned values filled by this call */
+static gboolean
+decode_end (NbtSchema *schema, gpointer out, const gboolean *seen,
+            gboolean ok, GError **error)
+{
+  for (guint i = 0; ok && i < schema->n_fields; i++)
+    if (schema->fields[i].required && !seen[i])
+      {
+        g_set_error (error, NBT_SCHEMA_ERROR, NBT_SCHEMA_ERROR_MISSING,
+                     _ ("The required key \"%s\" is missing."),
+                     schema->fields[i].key);
+        ok = FALSE;
+      }
+  if (!ok)
+    for (guint i = 0; i < schema->n_fields; i++)
+      if (seen[i])
+        field_clear (&schema->fields[i], out);
+  return ok;
+}
+
+static void
+not_compound (GError **error)
+{
+  g_set_error_literal (error, NBT_SCHEMA_ERROR, NBT_SCHEMA_ERROR_MISSING,
+                       _ ("The value isn't a compound."));
+}
+
+gboolean
+nbt_schema_decode (NbtSchema *schema, NbtNode *node, gpointer out,
+                   GError **error)
+{
+  g_return_val_if_fail (schema && node && out, FALSE);
+  if (((NbtData *)node->data)->type != TAG_Compound)
+    {
+      not_compound (error);
+      return FALSE;
+    }
+  gboolean *seen = g_newa (gboolean, schema->n_fields + 1);
+  memset (seen, 0, sizeof (gboolean) * schema->n_fields);
+
+  gboolean ok = TRUE;
+  for (NbtNode *child = node->children; child && ok; child = child->next)
+    {
+      NbtData *data = child->data;
+      if (!data->key)
+        continue;
+      int index = slot_lookup (schema->keys, schema->mask, data->key,
+                               strlen (data->key));
+      if (index < 0)
+        continue;
+      ok = field_begin (schema, index, data->type, out, seen, error);
+      if (!ok)
+        break;
+      seen[index] = TRUE;
+      const NbtSchemaField *field = &schema->fields[index];
+      gpointer member = G_STRUCT_MEMBER_P (out, field->offset);
+      switch (data->type)
+        {
+        case TAG_Byte:
+          set_number (field, out, (gint8)data->value_i, 0);
+          break;
+        case TAG_Short:
+          set_number (field, out, (gint16)data->value_i, 0);
+          break;
+        case TAG_Int:
+          set_number (field, out, (gint32)data->value_i, 0);
+          break;
+        case TAG_Long:
+          set_number (field, out, data->value_i, 0);
+          break;
+        case TAG_Float:
+        case TAG_Double:
+          set_number (field, out, 0, data->value_d);
+          break;
+        case TAG_String:
+          *(char **)member = g_strdup (data->value_a.value);
+          break;
+        case TAG_Byte_Array:
+        case TAG_Int_Array:
+        case TAG_Long_Array:
+          {
+            NbtSchemaArray *array = member;
+            array->len = data->value_a.len;
+            array->value = g_memdup2 (data->value_a.value,
+                                      (gsize)data->value_a.len
+                                          * array_element_size (data->type));
+            break;
+          }
+        case TAG_List:
+        case TAG_Compound:
+          *(NbtNode **)member = nbt_node_dup (child);
+          break;
+        default:
+          break;
+        }
+    }
+  return decode_end (schema, out, seen, ok, error);
+}
+
+/* Fill the member from the payload at the position, and move after it */
+static gboolean
+decode_raw_value (NbtReader *reader, const NbtSchemaField *field,
+                  gpointer out, gsize key_pos, gsize *pos)
+{
+  gsize size = nbt_reader_scalar_size (field->type);
+  if (size)
+    {
+      guint64 bits = 0;
+      guint8 bytes[8];
+      if (!nbt_reader_read (reader, pos, bytes, size))
+        return FALSE;
+      for (gsize i = 0; i < size; i++)
+        bits = bits << 8 | bytes[i];
+      switch (field->type)
+        {
+        case TAG_Byte:
+          set_number (field, out, (gint8)bits, 0);
+          break;
+        case TAG_Short:
+          set_number (field, out, (gint16)bits, 0);
+          break;
+        case TAG_Int:
+          set_number (field, out, (gint32)bits, 0);
+          break;
+        case TAG_Long:
+          set_number (field, out, (gint64)bits, 0);
+          break;
+        case TAG_Float:
+          {
+            guint32 value = bits;
+            float f;
+            memcpy (&f, &value, sizeof (f));
+            set_number (field, out, 0, f);
+            break;
+          }
+        default:
+          {
+            double d;
+            memcpy (&d, &bits, sizeof (d));
+            set_number (field, out, 0, d);
+            break;
+          }
+        }
+      return TRUE;
+    }
+
+  /* The owned values are parsed as the tree would, then taken from the
+   * node. Those kept in the data or given by an allocator can't be freed
+   * by `g_free`, so they are copied */
+  gsize end = key_pos;
+  NbtNode *node = nbt_node_parse_value (reader->data, reader->length, &end,
+                                        field->type, TRUE, reader->error);
+  if (!node)
+    {
+      reader->failed = TRUE;
+      return FALSE;
+    }
+  *pos = end;
+  gpointer member = G_STRUCT_MEMBER_P (out, field->offset);
+  NbtData *data = node->data;
+  switch (field->type)
+    {
+    case TAG_String:
+      if (data->flags & (NBT_DATA_INLINE_VALUE | NBT_DATA_CUSTOM_VALUE))
+        *(char **)member = g_strdup (data->value_a.value);
+      else
+        *(char **)member = g_steal_pointer (&data->value_a.value);
+      break;
+    case TAG_Byte_Array:
+    case TAG_Int_Array:
+    case TAG_Long_Array:
+      {
+        NbtSchemaArray *array = member;
+        array->len = data->value_a.len;
+        if (data->flags & NBT_DATA_CUSTOM_VALUE)
+          array->value
+              = g_memdup2 (data->value_a.value,
+                           (gsize)array->len
+                               * array_element_size (field->type));
+        else
+          array->value = g_steal_pointer (&data->value_a.value);
+        break;
+      }
+    default:
+      *(NbtNode **)member = g_steal_pointer (&node);
+      break;
+    }
+  nbt_node_free (node);
+  return TRUE;
+}
+
+gboolean
+nbt_schema_decode_bytes (NbtSchema *schema, const guint8 *data, gsize length,
+                         gpointer out, GError **error)
+{
+  g_return_val_if_fail (schema && data && out, FALSE);
+  gsize raw_length = 0;
+  guint8 *raw = nbt_decompress (data, length, &raw_length, error);
+  if (!raw)
+    return FALSE;
+  gboolean *seen = g_newa (gboolean, schema->n_fields + 1);
+  memset (seen, 0, sizeof (gboolean) * schema->n_fields);
+
+  NbtReader reader = { raw, raw_length, error, FALSE };
+  gsize pos = 0;
+  NBT_Tags tag;
+  const char *key;
+  guint16 key_len;
+  gboolean ok = nbt_reader_read_tag (&reader, &pos, &tag);
+  if (ok && tag != TAG_Compound)
+    {
+      not_compound (error);
+      ok = FALSE;
+    }
+  ok = ok && nbt_reader_read_key (&reader, &pos, &key, &key_len);
+  while (ok)
+    {
+      if (!nbt_reader_read_tag (&reader, &pos, &tag))
+        {
+          ok = FALSE;
+          break;
+        }
+      if (tag == TAG_End)
+        break;
+      gsize key_pos = pos;
+      if (!nbt_reader_read_key (&reader, &pos, &key, &key_len))
+        {
+          ok = FALSE;
+          break;
+        }
+      int index = slot_lookup (schema->raw_keys, schema->mask, key, key_len);
+      if (index < 0)
+        ok = nbt_reader_skip_value (&reader, tag, &pos);
+      else
+        {
+          ok = field_begin (schema, index, tag, out, seen, error)
+               && decode_raw_value (&reader, &schema->fields[index], out,
+                                    key_pos, &pos);
+          seen[index] |= ok;
+        }
+    }
+  if (raw != data)
+    g_free (raw);
+  return decode_end (schema, out, seen, ok, error);
+}
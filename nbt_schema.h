@@ -0,0 +1,133 @@
+/*  nbt_schema - Schema decoding part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#ifndef DHLRC_NBT_SCHEMA_H
+#define DHLRC_NBT_SCHEMA_H
+
+#include "nbt.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief The error domain of the schema decoding.
+ * @sa NbtSchemaError
+ */
+#define NBT_SCHEMA_ERROR nbt_schema_error_quark ()
+GQuark nbt_schema_error_quark (void);
+
+/**
+ * @brief The error codes of the schema decoding.
+ */
+typedef enum NbtSchemaError
+{
+  /** The value isn't a compound, or a required key is missing */
+  NBT_SCHEMA_ERROR_MISSING,
+  /** A key of the schema has a value of another tag */
+  NBT_SCHEMA_ERROR_TYPE,
+} NbtSchemaError;
+
+/**
+ * @brief A field of the struct filled by the schema.
+ *
+ * The member at `offset` has the C type of the tag: `gint8`, `gint16`,
+ * `gint32`, `gint64`, `float` and `double` for the numbers, `char *` for
+ * the strings, `NbtSchemaArray` for the arrays and `NbtNode *` for the
+ * lists and compounds. The strings, arrays and nodes are owned by the
+ * struct and freed by `nbt_schema_clear`.
+ */
+typedef struct NbtSchemaField
+{
+  const char *key;
+  NBT_Tags type;
+  gsize offset;
+  gboolean required;
+} NbtSchemaField;
+
+/**
+ * @brief Describe the member of the struct as a field.
+ */
+#define NBT_SCHEMA_FIELD(struct_type, member, key, type, required)           \
+  { (key), (type), G_STRUCT_OFFSET (struct_type, member), (required) }
+
+/**
+ * @brief The member of a byte, int or long array field.
+ */
+typedef struct NbtSchemaArray
+{
+  gpointer value;
+  int len;
+} NbtSchemaArray;
+
+/**
+ * @brief The compiled field table, which matches the keys of a compound
+ * in one pass by hashing them.
+ *
+ * The schema is read-only once created and can be used from many threads.
+ */
+typedef struct NbtSchema NbtSchema;
+
+/**
+ * @brief Compile the field table.
+ * @param fields The fields, which are copied
+ * @param n_fields The count of the fields
+ * @return The schema, to be freed by `nbt_schema_free`
+ */
+NbtSchema *nbt_schema_new (const NbtSchemaField *fields, guint n_fields);
+/**
+ * @brief Free the schema.
+ */
+void nbt_schema_free (NbtSchema *schema);
+
+/**
+ * @brief Fill the struct from the compound.
+ *
+ * The members of the missing optional keys are left as they are, so the
+ * struct should hold the defaults. The keys out of the schema are
+ * ignored. When failed, the strings, arrays and nodes already filled are
+ * freed and reset to NULL.
+ * @param schema The schema
+ * @param node The compound
+ * @param out The struct to fill
+ * @param error Error code in `NBT_SCHEMA_ERROR`, or NULL to ignore
+ * @return FALSE when failed
+ */
+gboolean nbt_schema_decode (NbtSchema *schema, NbtNode *node, gpointer out,
+                            GError **error);
+/**
+ * @brief Fill the struct from the binary NBT whose root is the compound,
+ * without building the tree.
+ *
+ * The values out of the schema are skipped by their lengths.
+ * @param data The binary NBT, raw or compressed by gzip or zlib
+ * @param length The length of the data
+ * @param error Error code in `NBT_SCHEMA_ERROR` or `NBT_GLIB_PARSE_ERROR`,
+ * or NULL to ignore
+ * @sa nbt_schema_decode
+ */
+gboolean nbt_schema_decode_bytes (NbtSchema *schema, const guint8 *data,
+                                  gsize length, gpointer out,
+                                  GError **error);
+/**
+ * @brief Free the strings, arrays and nodes of the struct and reset them
+ * to NULL.
+ */
+void nbt_schema_clear (NbtSchema *schema, gpointer out);
+
+G_END_DECLS
+
+#endif // DHLRC_NBT_SCHEMA_H
@@ -0,0 +1,834 @@
+/*  nbt_snbt - SNBT parsing part of the nbt-glib
+    Copyright (C) 2025 Dream_Helium
+
+    SPDX-License-Identifier: LGPL-3.0-or-later
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>. */
+
+#include "nbt_parse.h"
+#include "nbt_private.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef NBT_GLIB_DISABLE_TRANSLATION
+#include <libintl.h>
+#define _(text) gettext (text)
+#else
+#define _(text) text
+#endif
+
+#define N_(txt) txt
+
+/* The text is validated as UTF-8 once, then scanned byte by byte. The
+ * gaps between the tokens and the quoted strings are the long runs, so
+ * they are scanned 16 bytes at a time when SSE2 is there. */
+
+/* Deeper trees are refused instead of overflowing the stack */
+#define SNBT_MAX_DEPTH 512
+
+typedef struct SnbtParser
+{
+  const char *start;
+  const char *p;
+  const char *end;
+  GError **err;
+  gsize *error_offset;
+  gboolean failed;
+} SnbtParser;
+
+/* The characters of the unquoted words: [0-9A-Za-z_\-.+] */
+static const guint8 word_chars[256] = {
+  ['+'] = 1, ['-'] = 1, ['.'] = 1, ['0'] = 1, ['1'] = 1, ['2'] = 1,
+  ['3'] = 1, ['4'] = 1, ['5'] = 1, ['6'] = 1, ['7'] = 1, ['8'] = 1,
+  ['9'] = 1, ['A'] = 1, ['B'] = 1, ['C'] = 1, ['D'] = 1, ['E'] = 1,
+  ['F'] = 1, ['G'] = 1, ['H'] = 1, ['I'] = 1, ['J'] = 1, ['K'] = 1,
+  ['L'] = 1, ['M'] = 1, ['N'] = 1, ['O'] = 1, ['P'] = 1, ['Q'] = 1,
+  ['R'] = 1, ['S'] = 1, ['T'] = 1, ['U'] = 1, ['V'] = 1, ['W'] = 1,
+  ['X'] = 1, ['Y'] = 1, ['Z'] = 1, ['_'] = 1, ['a'] = 1, ['b'] = 1,
+  ['c'] = 1, ['d'] = 1, ['e'] = 1, ['f'] = 1, ['g'] = 1, ['h'] = 1,
+  ['i'] = 1, ['j'] = 1, ['k'] = 1, ['l'] = 1, ['m'] = 1, ['n'] = 1,
+  ['o'] = 1, ['p'] = 1, ['q'] = 1, ['r'] = 1, ['s'] = 1, ['t'] = 1,
+  ['u'] = 1, ['v'] = 1, ['w'] = 1, ['x'] = 1, ['y'] = 1, ['z'] = 1,
+};
+
+static const char *const tag_names[]
+    = { N_ ("end"),    N_ ("byte"),   N_ ("short"),      N_ ("int"),
+        N_ ("long"),   N_ ("float"),  N_ ("double"),     N_ ("byte array"),
+        N_ ("string"), N_ ("list"),   N_ ("compound"),   N_ ("int array"),
+        N_ ("long array") };
+
+static gboolean
+is_space (char c)
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static void
+parse_error (SnbtParser *parser, const char *pos, const char *format, ...)
+  G_GNUC_PRINTF (3, 4);
+
+/* Only the first error is kept, it's the most precise one */
+static void
+parse_error (SnbtParser *parser, const char *pos, const char *format, ...)
+{
+  if (parser->failed)
+    return;
+  parser->failed = TRUE;
+  if (parser->error_offset)
+    *parser->error_offset = pos - parser->start;
+  if (!parser->err)
+    return;
+
+  int line = 1;
+  const char *line_start = parser->start;
+  for (const char *p = parser->start; p < pos; p++)
+    if (*p == '\n')
+      {
+        line++;
+        line_start = p + 1;
+      }
+  va_list args;
+  va_start (args, format);
+  char *message = g_strdup_vprintf (format, args);
+  va_end (args);
+  g_set_error (parser->err, NBT_GLIB_PARSE_ERROR, NBT_GLIB_PARSE_ERROR_SYNTAX,
+               _ ("Line %d, column %ld: %s"), line,
+               g_utf8_strlen (line_start, pos - line_start) + 1, message);
+  g_free (message);
+}
+
+static void
+skip_whitespace (SnbtParser *parser)
+{
+  const char *p = parser->p;
+  const char *end = parser->end;
+  /* Most gaps are empty or a single space */
+  if (p == end || !is_space (*p))
+    return;
+  p++;
+#ifdef __SSE2__
+  const __m128i space = _mm_set1_epi8 (' ');
+  const __m128i newline = _mm_set1_epi8 ('\n');
+  const __m128i tab = _mm_set1_epi8 ('\t');
+  const __m128i cr = _mm_set1_epi8 ('\r');
+  while (end - p >= 16)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *)p);
+      __m128i ws = _mm_or_si128 (
+          _mm_or_si128 (_mm_cmpeq_epi8 (chunk, space),
+                        _mm_cmpeq_epi8 (chunk, newline)),
+          _mm_or_si128 (_mm_cmpeq_epi8 (chunk, tab),
+                        _mm_cmpeq_epi8 (chunk, cr)));
+      int mask = ~_mm_movemask_epi8 (ws) & 0xffff;
+      if (mask)
+        {
+          parser->p = p + g_bit_nth_lsf (mask, -1);
+          return;
+        }
+      p += 16;
+    }
+#endif
+  while (p < end && is_space (*p))
+    p++;
+  parser->p = p;
+}
+
+/* Find the quote or the backslash which ends the plain run of a string */
+static const char *
+scan_quoted (const char *p, const char *end, char quote)
+{
+#ifdef __SSE2__
+  const __m128i quotes = _mm_set1_epi8 (quote);
+  const __m128i backslashes = _mm_set1_epi8 ('\\');
+  while (end - p >= 16)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *)p);
+      int mask = _mm_movemask_epi8 (
+          _mm_or_si128 (_mm_cmpeq_epi8 (chunk, quotes),
+                        _mm_cmpeq_epi8 (chunk, backslashes)));
+      if (mask)
+        return p + g_bit_nth_lsf (mask, -1);
+      p += 16;
+    }
+#endif
+  while (p < end && *p != quote && *p != '\\')
+    p++;
+  return p;
+}
+
+static const char *
+scan_word (const char *p, const char *end)
+{
+  while (p < end && word_chars[(guchar)*p])
+    p++;
+  return p;
+}
+
+static gboolean
+expect (SnbtParser *parser, char c)
+{
+  skip_whitespace (parser);
+  if (parser->p < parser->end && *parser->p == c)
+    {
+      parser->p++;
+      return TRUE;
+    }
+  if (parser->p == parser->end)
+    parse_error (parser, parser->p, _ ("Expected '%c' but got the end."), c);
+  else
+    parse_error (parser, parser->p, _ ("Expected '%c'."), c);
+  return FALSE;
+}
+
+static gint64
+hex_value (const char *p, int digits)
+{
+  gint64 value = 0;
+  for (int i = 0; i < digits; i++)
+    {
+      int d = g_ascii_xdigit_value (p[i]);
+      if (d < 0)
+        return -1;
+      value = value * 16 + d;
+    }
+  return value;
+}
+
+/* Read the `\x`, `\u` or `\U` escape at `p`, which points to the letter */
+static gboolean
+parse_unicode_escape (SnbtParser *parser, const char **p, gunichar *c)
+{
+  int digits = **p == 'x' ? 2 : **p == 'u' ? 4 : 8;
+  if (parser->end - (*p + 1) < digits)
+    {
+      parse_error (parser, *p - 1, _ ("Incomplete escape."));
+      return FALSE;
+    }
+  gint64 value = hex_value (*p + 1, digits);
+  if (value < 0)
+    {
+      parse_error (parser, *p - 1, _ ("Invalid escape."));
+      return FALSE;
+    }
+  *p += 1 + digits;
+  /* Java writes the characters out of the BMP as surrogate pairs */
+  if (value >= 0xd800 && value < 0xdc00 && parser->end - *p >= 6
+      && (*p)[0] == '\\' && (*p)[1] == 'u')
+    {
+      gint64 low = hex_value (*p + 2, 4);
+      if (low >= 0xdc00 && low < 0xe000)
+        {
+          value = 0x10000 + ((value - 0xd800) << 10) + (low - 0xdc00);
+          *p += 6;
+        }
+    }
+  if (!g_unichar_validate (value))
+    {
+      parse_error (parser, *p - 1, _ ("Invalid character U+%04X."),
+                   (guint)value);
+      return FALSE;
+    }
+  *c = value;
+  return TRUE;
+}
+
+/* Parse the quoted string at the parser, return the new UTF-8 string */
+static char *
+parse_quoted (SnbtParser *parser)
+{
+  const char *open = parser->p;
+  char quote = *open;
+  const char *p = open + 1;
+  const char *stop = scan_quoted (p, parser->end, quote);
+  /* Most strings don't have any escape */
+  if (stop < parser->end && *stop == quote)
+    {
+      parser->p = stop + 1;
+      return g_strndup (p, stop - p);
+    }
+
+  GString *string = g_string_sized_new (stop - p + 16);
+  for (;;)
+    {
+      g_string_append_len (string, p, stop - p);
+      p = stop;
+      if (p == parser->end)
+        {
+          parse_error (parser, open, _ ("Unterminated string."));
+          g_string_free (string, TRUE);
+          return NULL;
+        }
+      if (*p == quote)
+        break;
+      /* A backslash */
+      p++;
+      if (p == parser->end)
+        continue;
+      char c = *p;
+      switch (c)
+        {
+        case '\\':
+        case '\'':
+        case '"':
+          g_string_append_c (string, c);
+          p++;
+          break;
+        case 'b':
+          g_string_append_c (string, '\b');
+          p++;
+          break;
+        case 'f':
+          g_string_append_c (string, '\f');
+          p++;
+          break;
+        case 'n':
+          g_string_append_c (string, '\n');
+          p++;
+          break;
+        case 'r':
+          g_string_append_c (string, '\r');
+          p++;
+          break;
+        case 's':
+          g_string_append_c (string, ' ');
+          p++;
+          break;
+        case 't':
+          g_string_append_c (string, '\t');
+          p++;
+          break;
+        case 'x':
+        case 'u':
+        case 'U':
+          {
+            gunichar unichar;
+            if (!parse_unicode_escape (parser, &p, &unichar))
+              {
+                g_string_free (string, TRUE);
+                return NULL;
+              }
+            g_string_append_unichar (string, unichar);
+            break;
+          }
+        default:
+          parse_error (parser, p - 1, _ ("Invalid escape '\\%c'."), c);
+          g_string_free (string, TRUE);
+          return NULL;
+        }
+      stop = scan_quoted (p, parser->end, quote);
+    }
+  parser->p = p + 1;
+  return g_string_free (string, FALSE);
+}
+
+static char *
+parse_key (SnbtParser *parser)
+{
+  skip_whitespace (parser);
+  const char *p = parser->p;
+  if (p < parser->end && (*p == '"' || *p == '\''))
+    return parse_quoted (parser);
+  const char *end = scan_word (p, parser->end);
+  if (end == p)
+    {
+      parse_error (parser, p, _ ("Expected a key."));
+      return NULL;
+    }
+  parser->p = end;
+  return g_strndup (p, end - p);
+}
+
+/* Parse [-+]?[0-9]+ with the overflow check */
+static gboolean
+parse_integer (const char *p, const char *end, gint64 *value)
+{
+  gboolean negative = FALSE;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+  if (p == end)
+    return FALSE;
+  guint64 u = 0;
+  for (; p < end; p++)
+    {
+      guint d = (guchar)*p - '0';
+      if (d > 9)
+        return FALSE;
+      if (u > (G_MAXUINT64 - d) / 10)
+        return FALSE;
+      u = u * 10 + d;
+    }
+  if (negative ? u > (guint64)G_MAXINT64 + 1 : u > G_MAXINT64)
+    return FALSE;
+  *value = negative ? -u : u;
+  return TRUE;
+}
+
+/* The word is checked by parse_floating already */
+static gboolean
+parse_floating_slow (const char *p, const char *end, double *value)
+{
+  /* The word isn't '\0' ended */
+  char buf[64];
+  if (end - p >= sizeof (buf))
+    {
+      char *copy = g_strndup (p, end - p);
+      *value = g_ascii_strtod (copy, NULL);
+      g_free (copy);
+      return TRUE;
+    }
+  memcpy (buf, p, end - p);
+  buf[end - p] = '\0';
+  *value = g_ascii_strtod (buf, NULL);
+  return TRUE;
+}
+
+/* Parse [-+]?([0-9]+[.]?[0-9]*|[.][0-9]+)([eE][-+]?[0-9]+)?
+ *
+ * When the digits fit in the 53 bits of a double and the exponent is
+ * small, both are exact doubles and one multiplication or division gives
+ * the correctly rounded value (Clinger's fast path). The others go through
+ * g_ascii_strtod. */
+static gboolean
+parse_floating (const char *p, const char *end, double *value)
+{
+  static const double pow10[]
+      = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+          1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+          1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  const char *s = p;
+  gboolean negative = FALSE;
+  if (s < end && (*s == '-' || *s == '+'))
+    negative = *s++ == '-';
+  guint64 mantissa = 0;
+  int digits = 0;
+  int significant = 0;
+  int exponent = 0;
+  /* More digits than the mantissa holds are left to the slow path, once
+   * the whole word is checked */
+  gboolean slow = FALSE;
+  for (; s < end && g_ascii_isdigit (*s); s++, digits++)
+    if ((mantissa || *s != '0') && !slow)
+      {
+        mantissa = mantissa * 10 + (*s - '0');
+        slow = ++significant > 18;
+      }
+  if (s < end && *s == '.')
+    s++;
+  for (; s < end && g_ascii_isdigit (*s); s++, digits++)
+    {
+      exponent--;
+      if ((mantissa || *s != '0') && !slow)
+        {
+          mantissa = mantissa * 10 + (*s - '0');
+          slow = ++significant > 18;
+        }
+    }
+  if (!digits)
+    return FALSE;
+  if (s < end && (*s == 'e' || *s == 'E'))
+    {
+      s++;
+      gboolean negative_exponent = FALSE;
+      if (s < end && (*s == '-' || *s == '+'))
+        negative_exponent = *s++ == '-';
+      if (s == end || !g_ascii_isdigit (*s))
+        return FALSE;
+      int e = 0;
+      for (; s < end && g_ascii_isdigit (*s); s++)
+        if (e < 100000)
+          e = e * 10 + (*s - '0');
+      exponent += negative_exponent ? -e : e;
+    }
+  if (s != end)
+    return FALSE;
+
+  if (slow || mantissa > (G_GUINT64_CONSTANT (1) << 53) || exponent < -22
+      || exponent > 22)
+    return parse_floating_slow (p, end, value);
+  double d = mantissa;
+  d = exponent < 0 ? d / pow10[-exponent] : d * pow10[exponent];
+  *value = negative ? -d : d;
+  return TRUE;
+}
+
+/* Give the unquoted word its type and value. The words which aren't
+ * numbers, or are out of the range of their type, are strings, which are
+ * left to the caller. */
+static void
+classify_word (NbtData *data, const char *word, const char *end)
+{
+  gsize len = end - word;
+  if (len == 4 && memcmp (word, "true", 4) == 0)
+    {
+      data->type = TAG_Byte;
+      data->value_i = 1;
+      return;
+    }
+  if (len == 5 && memcmp (word, "false", 5) == 0)
+    {
+      data->type = TAG_Byte;
+      data->value_i = 0;
+      return;
+    }
+
+  gint64 i;
+  double d;
+  switch (end[-1])
+    {
+    case 'b':
+    case 'B':
+      if (parse_integer (word, end - 1, &i) && i >= G_MININT8
+          && i <= G_MAXINT8)
+        {
+          data->type = TAG_Byte;
+          data->value_i = i;
+          return;
+        }
+      break;
+    case 's':
+    case 'S':
+      if (parse_integer (word, end - 1, &i) && i >= G_MININT16
+          && i <= G_MAXINT16)
+        {
+          data->type = TAG_Short;
+          data->value_i = i;
+          return;
+        }
+      break;
+    case 'l':
+    case 'L':
+      if (parse_integer (word, end - 1, &i))
+        {
+          data->type = TAG_Long;
+          data->value_i = i;
+          return;
+        }
+      break;
+    case 'f':
+    case 'F':
+      if (parse_floating (word, end - 1, &d))
+        {
+          data->type = TAG_Float;
+          data->value_d = (float)d;
+          return;
+        }
+      break;
+    case 'd':
+    case 'D':
+      if (parse_floating (word, end - 1, &d))
+        {
+          data->type = TAG_Double;
+          data->value_d = d;
+          return;
+        }
+      break;
+    default:
+      if (parse_integer (word, end, &i))
+        {
+          if (i >= G_MININT32 && i <= G_MAXINT32)
+            {
+              data->type = TAG_Int;
+              data->value_i = i;
+              return;
+            }
+          break;
+        }
+      /* A double needs its suffix or a '.', like `1.5` or `2.`, so every
+       * integer out of range is a string */
+      if (memchr (word, '.', len) && parse_floating (word, end, &d))
+        {
+          data->type = TAG_Double;
+          data->value_d = d;
+          return;
+        }
+      break;
+    }
+  data->type = TAG_String;
+}
+
+/* The nodes are made like the ones of the binary parser, with the short
+ * key and string kept in their data */
+static NbtNode *
+node_new (NBT_Tags type, const char *key, const char *string,
+          gsize string_len)
+{
+  NbtData *data = nbt_data_new_full (type, key, key ? strlen (key) : 0,
+                                     string, string_len, NULL);
+  if (type == TAG_String)
+    data->value_a.len = string_len + 1;
+  return nbt_node_new_for_data (data);
+}
+
+static NbtNode *parse_value (SnbtParser *parser, int depth, const char *key);
+
+static NbtNode *
+parse_typed_array (SnbtParser *parser, char kind, const char *key)
+{
+  NBT_Tags type = kind == 'B'   ? TAG_Byte_Array
+                  : kind == 'I' ? TAG_Int_Array
+                                : TAG_Long_Array;
+  int size = kind == 'B' ? 1 : kind == 'I' ? 4 : 8;
+  GArray *array = g_array_new (FALSE, FALSE, size);
+  /* Skip `X;` */
+  parser->p += 2;
+  skip_whitespace (parser);
+  if (parser->p < parser->end && *parser->p == ']')
+    parser->p++;
+  else
+    for (;;)
+      {
+        skip_whitespace (parser);
+        const char *word = parser->p;
+        const char *end = scan_word (word, parser->end);
+        gint64 value;
+        const char *digits_end = end;
+        /* The suffix of the element type is optional */
+        if (end > word
+            && g_ascii_toupper (end[-1]) == (kind == 'I' ? '\0' : kind))
+          digits_end--;
+        gboolean ok = end > word && parse_integer (word, digits_end, &value);
+        if (ok && kind == 'B')
+          ok = value >= G_MININT8 && value <= G_MAXINT8;
+        else if (ok && kind == 'I')
+          ok = value >= G_MININT32 && value <= G_MAXINT32;
+        if (!ok)
+          {
+            parse_error (parser, word, _ ("Invalid element of the %s."),
+                         _ (tag_names[type]));
+            g_array_free (array, TRUE);
+            return NULL;
+          }
+        if (kind == 'B')
+          {
+            gint8 v = value;
+            g_array_append_val (array, v);
+          }
+        else if (kind == 'I')
+          {
+            gint32 v = value;
+            g_array_append_val (array, v);
+          }
+        else
+          g_array_append_val (array, value);
+        parser->p = end;
+        skip_whitespace (parser);
+        if (parser->p < parser->end && *parser->p == ',')
+          {
+            parser->p++;
+            continue;
+          }
+        if (!expect (parser, ']'))
+          {
+            g_array_free (array, TRUE);
+            return NULL;
+          }
+        break;
+      }
+
+  NbtNode *node = node_new (type, key, NULL, 0);
+  NbtData *data = node->data;
+  data->value_a.len = array->len;
+  data->value_a.value = nbt_part_alloc ((gsize)array->len * size,
+                                        &data->flags, NBT_DATA_CUSTOM_VALUE);
+  memcpy (data->value_a.value, array->data, (gsize)array->len * size);
+  g_array_free (array, TRUE);
+  return node;
+}
+
+static NbtNode *
+parse_list (SnbtParser *parser, int depth, const char *key)
+{
+  const char *open = parser->p;
+  parser->p++;
+  skip_whitespace (parser);
+  /* `[B;` starts a typed array, but `[B]` is a list of the string B */
+  if (parser->end - parser->p >= 2 && parser->p[1] == ';'
+      && (parser->p[0] == 'B' || parser->p[0] == 'I' || parser->p[0] == 'L'))
+    return parse_typed_array (parser, parser->p[0], key);
+
+  NbtNode *node = node_new (TAG_List, key, NULL, 0);
+  NbtNode *last = NULL;
+  NBT_Tags list_type = TAG_End;
+  if (parser->p < parser->end && *parser->p == ']')
+    {
+      parser->p++;
+      return node;
+    }
+  for (;;)
+    {
+      skip_whitespace (parser);
+      const char *element = parser->p;
+      NbtNode *child = parse_value (parser, depth + 1, NULL);
+      if (!child)
+        goto error;
+      NbtData *child_data = child->data;
+      if (last && child_data->type != list_type)
+        {
+          parse_error (parser, element,
+                       _ ("Can't put the %s in the list of %s."),
+                       _ (tag_names[child_data->type]),
+                       _ (tag_names[list_type]));
+          nbt_node_free (child);
+          goto error;
+        }
+      list_type = child_data->type;
+      last = g_node_insert_after (node, last, child);
+      skip_whitespace (parser);
+      if (parser->p < parser->end && *parser->p == ',')
+        {
+          parser->p++;
+          continue;
+        }
+      if (!expect (parser, ']'))
+        goto error;
+      return node;
+    }
+
+error:
+  if (!parser->failed)
+    parse_error (parser, open, _ ("Invalid list."));
+  nbt_node_free (node);
+  return NULL;
+}
+
+static NbtNode *
+parse_compound (SnbtParser *parser, int depth, const char *key)
+{
+  NbtNode *node = node_new (TAG_Compound, key, NULL, 0);
+  NbtNode *last = NULL;
+  parser->p++;
+  skip_whitespace (parser);
+  if (parser->p < parser->end && *parser->p == '}')
+    {
+      parser->p++;
+      return node;
+    }
+  for (;;)
+    {
+      char *child_key = parse_key (parser);
+      if (!child_key)
+        goto error;
+      if (!expect (parser, ':'))
+        {
+          g_free (child_key);
+          goto error;
+        }
+      NbtNode *child = parse_value (parser, depth + 1, child_key);
+      g_free (child_key);
+      if (!child)
+        goto error;
+      last = g_node_insert_after (node, last, child);
+      skip_whitespace (parser);
+      if (parser->p < parser->end && *parser->p == ',')
+        {
+          parser->p++;
+          continue;
+        }
+      if (!expect (parser, '}'))
+        goto error;
+      return node;
+    }
+
+error:
+  nbt_node_free (node);
+  return NULL;
+}
+
+static NbtNode *
+parse_value (SnbtParser *parser, int depth, const char *key)
+{
+  skip_whitespace (parser);
+  const char *p = parser->p;
+  if (p == parser->end)
+    {
+      parse_error (parser, p, _ ("Expected a value but got the end."));
+      return NULL;
+    }
+  if (depth > SNBT_MAX_DEPTH)
+    {
+      parse_error (parser, p, _ ("The text is nested too deep."));
+      return NULL;
+    }
+  switch (*p)
+    {
+    case '{':
+      return parse_compound (parser, depth, key);
+    case '[':
+      return parse_list (parser, depth, key);
+    case '"':
+    case '\'':
+      {
+        char *string = parse_quoted (parser);
+        if (!string)
+          return NULL;
+        NbtNode *node = node_new (TAG_String, key, string, strlen (string));
+        g_free (string);
+        return node;
+      }
+    default:
+      {
+        const char *end = scan_word (p, parser->end);
+        if (end == p)
+          {
+            parse_error (parser, p, _ ("Expected a value."));
+            return NULL;
+          }
+        NbtData word = { 0 };
+        classify_word (&word, p, end);
+        parser->p = end;
+        if (word.type == TAG_String)
+          return node_new (TAG_String, key, p, end - p);
+        NbtNode *node = node_new (word.type, key, NULL, 0);
+        NbtData *data = node->data;
+        if (word.type == TAG_Float || word.type == TAG_Double)
+          data->value_d = word.value_d;
+        else
+          data->value_i = word.value_i;
+        return node;
+      }
+    }
+}
+
+NbtNode *
+nbt_node_new_from_snbt (const char *text, gssize length, gsize *error_offset,
+                        GError **err)
+{
+  g_return_val_if_fail (text != NULL, NULL);
+  if (length < 0)
+    length = strlen (text);
+
+  SnbtParser parser = { text, text, text + length, err, error_offset };
+  const char *invalid = NULL;
+  if (!g_utf8_validate_len (text, length, &invalid))
+    {
+      parse_error (&parser, invalid, _ ("Invalid UTF-8."));
+      return NULL;
+    }
+
+  NbtNode *root = parse_value (&parser, 0, "");
+  if (!root)
+    return NULL;
+  skip_whitespace (&parser);
+  if (parser.p != parser.end)
+    {
+      parse_error (&parser, parser.p,
+                   _ ("Some leftover text detected after parsing."));
+      nbt_node_free (root);
+      return NULL;
+    }
+  return root;
+}
@@ -17,15 +17,12 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>. */
 
 #include "nbt_util.h"
+#include "nbt_private.h"
 
 static NbtNode *
 create_node (NBT_Tags tag, const char *key)
 {
-  NbtData *data = g_new0 (NbtData, 1);
-  data->type = tag;
-  data->key = g_strdup (key);
-  NbtNode *node = g_node_new (data);
-  return node;
+  return nbt_node_new_for_data (nbt_data_new (tag, key, NULL));
 }
 
 NbtNode *
@@ -85,11 +82,8 @@ nbt_node_new_double (const char *key, double value)
 NbtNode *
 nbt_node_new_string (const char *key, const char *value)
 {
-  NbtNode *node = create_node (TAG_String, key);
-  NbtData *data = node->data;
-  data->value_a.value = g_strdup (value);
-  data->value_a.len = 1; /* Since there's no need to fill it, we fill 1. */
-  return node;
+  /* Since there's no need to fill the length, it's 1. */
+  return nbt_node_new_for_data (nbt_data_new (TAG_String, key, value));
 }
 
 NbtNode *
@@ -98,7 +92,8 @@ nbt_node_new_byte_array (const char *key, gint8 *value, int len)
   NbtNode *node = create_node (TAG_Byte_Array, key);
   NbtData *data = node->data;
   data->value_a.len = len;
-  data->value_a.value = g_new0 (gint8, len);
+  data->value_a.value = nbt_part_alloc (len * sizeof (gint8), &data->flags,
+                                        NBT_DATA_CUSTOM_VALUE);
   memcpy (data->value_a.value, value, len * sizeof (gint8));
   return node;
 }
@@ -109,7 +104,8 @@ nbt_node_new_int_array (const char *key, gint32 *value, int len)
   NbtNode *node = create_node (TAG_Int_Array, key);
   NbtData *data = node->data;
   data->value_a.len = len;
-  data->value_a.value = g_new0 (gint32, len);
+  data->value_a.value = nbt_part_alloc (len * sizeof (gint32), &data->flags,
+                                        NBT_DATA_CUSTOM_VALUE);
   memcpy (data->value_a.value, value, len * sizeof (gint32));
   return node;
 }
@@ -120,7 +116,8 @@ nbt_node_new_long_array (const char *key, gint64 *value, int len)
   NbtNode *node = create_node (TAG_Long_Array, key);
   NbtData *data = node->data;
   data->value_a.len = len;
-  data->value_a.value = g_new0 (gint64, len);
+  data->value_a.value = nbt_part_alloc (len * sizeof (gint64), &data->flags,
+                                        NBT_DATA_CUSTOM_VALUE);
   memcpy (data->value_a.value, value, len * sizeof (gint64));
   return node;
 }
@@ -309,6 +306,96 @@ fail:
   return NULL;
 }
 
+gconstpointer
+nbt_node_get_list_span (const NbtNode *node, NBT_Tags *type, int *len,
+                        gboolean *failed)
+{
+  if (!node || !len)
+    goto fail;
+  NbtData *data = node->data;
+  if (nbt_data_is_packed_list (data))
+    {
+      fill_failed (failed, FALSE);
+      if (type)
+        *type = nbt_data_list_type (data);
+      *len = data->value_a.len;
+      return data->value_a.value;
+    }
+fail:
+  fill_failed (failed, TRUE);
+  return NULL;
+}
+
+gboolean
+nbt_node_pack_list (NbtNode *node)
+{
+  g_return_val_if_fail (node, FALSE);
+  NbtData *data = node->data;
+  if (nbt_data_is_packed_list (data))
+    return TRUE;
+  if (data->type != TAG_List || !node->children)
+    return FALSE;
+  NBT_Tags type = ((NbtData *)node->children->data)->type;
+  gsize size = nbt_reader_scalar_size (type);
+  if (!size)
+    return FALSE;
+
+  guint len = g_node_n_children (node);
+  guint8 *value
+      = nbt_part_alloc (len * size, &data->flags, NBT_DATA_CUSTOM_VALUE);
+  guint i = 0;
+  for (NbtNode *child = node->children; child; child = child->next, i++)
+    {
+      NbtData *child_data = child->data;
+      switch (type)
+        {
+        case TAG_Byte:
+          ((gint8 *)value)[i] = child_data->value_i;
+          break;
+        case TAG_Short:
+          ((gint16 *)value)[i] = child_data->value_i;
+          break;
+        case TAG_Int:
+          ((gint32 *)value)[i] = child_data->value_i;
+          break;
+        case TAG_Long:
+          ((gint64 *)value)[i] = child_data->value_i;
+          break;
+        case TAG_Float:
+          ((float *)value)[i] = child_data->value_d;
+          break;
+        default:
+          ((double *)value)[i] = child_data->value_d;
+          break;
+        }
+    }
+  nbt_node_free (node->children);
+  node->children = NULL;
+  data->value_a.value = value;
+  data->value_a.len = len;
+  data->flags |= NBT_DATA_PACKED_LIST | type << NBT_DATA_LIST_TYPE_SHIFT;
+  return TRUE;
+}
+
+void
+nbt_node_unpack_list (NbtNode *node)
+{
+  g_return_if_fail (node);
+  NbtData *data = node->data;
+  if (!nbt_data_is_packed_list (data))
+    return;
+  NbtNode *last = NULL;
+  for (gint32 i = 0; i < data->value_a.len; i++)
+    {
+      NbtNode *child = nbt_node_create (nbt_data_list_type (data));
+      nbt_data_get_element (data, i, child->data);
+      last = g_node_insert_after (node, last, child);
+    }
+  nbt_data_free_value (data);
+  data->value_a.len = 0;
+  data->flags &= ~(NBT_DATA_PACKED_LIST | NBT_DATA_LIST_TYPE_MASK);
+}
+
 const char *
 nbt_node_get_key (const NbtNode *node)
 {
@@ -329,7 +416,7 @@ nbt_node_reset_key (const NbtNode *node, const char *key)
     }
 
   NbtData *data = node->data;
-  g_free (data->key);
+  nbt_data_free_key (data);
   data->key = g_strdup (key);
 }
 
@@ -337,6 +424,7 @@ gboolean
 nbt_node_prepend (NbtNode *node, NbtNode *child)
 {
   g_return_val_if_fail (node && child, FALSE);
+  nbt_node_unpack_list (node);
   NbtData *data = node->data;
   g_return_val_if_fail (data->type == TAG_Compound || data->type == TAG_List,
                         FALSE);
@@ -354,6 +442,7 @@ gboolean
 nbt_node_append (NbtNode *node, NbtNode *child)
 {
   g_return_val_if_fail (node && child, FALSE);
+  nbt_node_unpack_list (node);
   NbtData *data = node->data;
   g_return_val_if_fail (data->type == TAG_Compound || data->type == TAG_List,
                         FALSE);
@@ -372,6 +461,7 @@ nbt_node_insert_before (NbtNode *parent, NbtNode *sibling, NbtNode *node)
 {
   g_return_val_if_fail (node && parent, FALSE);
   g_return_val_if_fail (G_NODE_IS_ROOT (node), FALSE);
+  nbt_node_unpack_list (parent);
   NbtData *parent_data = parent->data;
   g_return_val_if_fail (parent_data->type == TAG_Compound
                             || parent_data->type == TAG_List,
@@ -405,6 +495,7 @@ nbt_node_insert_after (NbtNode *parent, NbtNode *sibling, NbtNode *node)
 {
   g_return_val_if_fail (node && parent, FALSE);
   g_return_val_if_fail (G_NODE_IS_ROOT (node), FALSE);
+  nbt_node_unpack_list (parent);
   NbtData *parent_data = parent->data;
   g_return_val_if_fail (parent_data->type == TAG_Compound
                             || parent_data->type == TAG_List,
@@ -436,7 +527,18 @@ nbt_node_insert_after (NbtNode *parent, NbtNode *sibling, NbtNode *node)
 NbtNode *
 nbt_node_child_to_index (NbtNode *root, int index)
 {
-  g_return_val_if_fail (root && root->children, NULL);
+  g_return_val_if_fail (root, NULL);
+  NbtData *data = root->data;
+  if (nbt_data_is_packed_list (data))
+    {
+      g_return_val_if_fail (index < data->value_a.len, NULL);
+      /* Read in place, only the copy is allocated */
+      NbtListIter element;
+      nbt_list_iter_init (&element, root);
+      nbt_data_get_element (data, MAX (index, 0), &element.element);
+      return nbt_node_dup (&element.node);
+    }
+  g_return_val_if_fail (root->children, NULL);
   NbtNode *child = root->children;
   for (int i = 0; i < index; i++)
     {
@@ -465,6 +567,7 @@ gboolean
 nbt_node_remove_node_index (NbtNode *root, int index)
 {
   g_return_val_if_fail (root, FALSE);
+  nbt_node_unpack_list (root);
   NbtNode *node = nbt_node_child_to_index (root, index);
   g_return_val_if_fail (node, FALSE);
   g_node_unlink (node);
@@ -483,57 +586,141 @@ nbt_node_remove_node_key (NbtNode *root, const char *key)
   return TRUE;
 }
 
-static gpointer
-copy_func (gconstpointer src, gpointer data)
+static gsize
+value_size (const NbtData *data)
 {
-  const NbtData *src_data = src;
-  NbtData *new_data = g_new0 (NbtData, 1);
-  new_data->key = g_strdup (src_data->key);
-  new_data->type = src_data->type;
-  int type_len = 0;
-  switch (src_data->type)
+  switch (data->type)
     {
-    case TAG_Byte:
-    case TAG_Short:
-    case TAG_Int:
-    case TAG_Long:
-      new_data->value_i = src_data->value_i;
-      return new_data;
-    case TAG_Float:
-    case TAG_Double:
-      new_data->value_d = src_data->value_d;
-      return new_data;
-    case TAG_Compound:
-    case TAG_List:
-      return new_data;
     case TAG_String:
-      new_data->value_a.value = g_strdup (src_data->value_a.value);
-      new_data->value_a.len = src_data->value_a.len;
-      return new_data;
+      return strlen (data->value_a.value) + 1;
     case TAG_Byte_Array:
-      type_len = sizeof (gint8);
-      goto copy;
+      return data->value_a.len * sizeof (gint8);
     case TAG_Int_Array:
-      type_len = sizeof (gint32);
-      goto copy;
+      return data->value_a.len * sizeof (gint32);
     case TAG_Long_Array:
-      type_len = sizeof (gint64);
-    copy:
-      new_data->value_a.len = src_data->value_a.len;
-      new_data->value_a.value = g_malloc0 (type_len * src_data->value_a.len);
-      memcpy (new_data->value_a.value, src_data->value_a.value,
-              type_len * src_data->value_a.len);
-      return new_data;
+      return data->value_a.len * sizeof (gint64);
+    case TAG_List:
+      return data->value_a.len
+             * nbt_reader_scalar_size (nbt_data_list_type (data));
     default:
-      g_free (new_data->key);
-      g_free (new_data);
-      return NULL;
+      return 0;
+    }
+}
+
+static gboolean
+has_value (const NbtData *data)
+{
+  return (data->type == TAG_String || data->type == TAG_Byte_Array
+          || data->type == TAG_Int_Array || data->type == TAG_Long_Array
+          || nbt_data_is_packed_list (data))
+         && data->value_a.value;
+}
+
+void
+nbt_data_copy_shared (NbtData *copy, const NbtData *data)
+{
+  *copy = *data;
+  copy->flags &= ~NBT_DATA_STORAGE_MASK;
+  /* The payloads of the source are only read, it may be read or
+   * duplicated by other threads at the same time */
+  if (data->key && (data->flags & NBT_DATA_SHARED_KEY))
+    nbt_payload_ref (copy->key);
+  else if (data->key)
+    {
+      copy->key = nbt_payload_new (data->key, strlen (data->key) + 1);
+      copy->flags |= NBT_DATA_SHARED_KEY;
+    }
+  if (has_value (data) && (data->flags & NBT_DATA_SHARED_VALUE))
+    nbt_payload_ref (copy->value_a.value);
+  else if (has_value (data))
+    {
+      copy->value_a.value
+          = nbt_payload_new (data->value_a.value, value_size (data));
+      copy->flags |= NBT_DATA_SHARED_VALUE;
     }
 }
 
+static gpointer
+copy_func (gconstpointer src, gpointer data)
+{
+  const NbtData *src_data = src;
+  if (src_data->type <= TAG_End || src_data->type > TAG_Long_Array)
+    return NULL;
+  NbtData *new_data = g_new (NbtData, 1);
+  nbt_data_copy_shared (new_data, src_data);
+  return new_data;
+}
+
 NbtNode *
 nbt_node_dup (NbtNode *root)
 {
   g_return_val_if_fail (root, NULL);
   return g_node_copy_deep (root, copy_func, NULL);
-}
\ No newline at end of file
+}
+void
+nbt_node_unshare (NbtNode *node)
+{
+  g_return_if_fail (node);
+  NbtData *data = node->data;
+  if ((data->flags & NBT_DATA_SHARED_KEY)
+      && !nbt_payload_is_unique (data->key))
+    {
+      char *key = g_strdup (data->key);
+      nbt_data_free_key (data);
+      data->key = key;
+    }
+  if ((data->flags & NBT_DATA_SHARED_VALUE)
+      && !nbt_payload_is_unique (data->value_a.value))
+    {
+      gpointer value = g_memdup2 (data->value_a.value, value_size (data));
+      nbt_data_free_value (data);
+      data->value_a.value = value;
+    }
+}
+
+gboolean
+nbt_node_set_string (NbtNode *node, const char *value)
+{
+  g_return_val_if_fail (node && value, FALSE);
+  NbtData *data = node->data;
+  g_return_val_if_fail (data->type == TAG_String, FALSE);
+  char *new_value = g_strdup (value);
+  nbt_data_free_value (data);
+  data->value_a.value = new_value;
+  data->value_a.len = 1;
+  return TRUE;
+}
+
+static gboolean
+set_array (NbtNode *node, NBT_Tags type, gconstpointer value, int len,
+           gsize size)
+{
+  g_return_val_if_fail (node && len >= 0 && (value || !len), FALSE);
+  NbtData *data = node->data;
+  g_return_val_if_fail (data->type == type, FALSE);
+  gpointer new_value = g_malloc0 (len * size);
+  if (len)
+    memcpy (new_value, value, len * size);
+  nbt_data_free_value (data);
+  data->value_a.value = new_value;
+  data->value_a.len = len;
+  return TRUE;
+}
+
+gboolean
+nbt_node_set_byte_array (NbtNode *node, const gint8 *value, int len)
+{
+  return set_array (node, TAG_Byte_Array, value, len, sizeof (gint8));
+}
+
+gboolean
+nbt_node_set_int_array (NbtNode *node, const gint32 *value, int len)
+{
+  return set_array (node, TAG_Int_Array, value, len, sizeof (gint32));
+}
+
+gboolean
+nbt_node_set_long_array (NbtNode *node, const gint64 *value, int len)
+{
+  return set_array (node, TAG_Long_Array, value, len, sizeof (gint64));
+}
@@ -48,6 +48,31 @@ const gint32 *nbt_node_get_int_array (const NbtNode *node, int *len,
                                       gboolean *failed);
 const gint64 *nbt_node_get_long_array (const NbtNode *node, int *len,
                                        gboolean *failed);
+/**
+ * @brief Get the numbers of the packed list as one array.
+ *
+ * The array holds `gint8`, `gint16`, `gint32`, `gint64`, `float` or
+ * `double` by the tag, in the host order.
+ * @param node The list
+ * @param type Filled with the tag of the numbers, or NULL
+ * @param len Filled with the count of the numbers
+ * @param failed Filled with TRUE if the list isn't packed, or NULL
+ * @return The array owned by the list, or NULL if it isn't packed
+ * @sa nbt_node_pack_list
+ */
+gconstpointer nbt_node_get_list_span (const NbtNode *node, NBT_Tags *type,
+                                      int *len, gboolean *failed);
+/**
+ * @brief Move the children of the list of numbers into one array, the
+ * children are freed.
+ * @return FALSE if the list is empty or doesn't hold numbers
+ */
+gboolean nbt_node_pack_list (NbtNode *node);
+/**
+ * @brief Turn the numbers of the packed list back into children, nothing
+ * is done for the other nodes.
+ */
+void nbt_node_unpack_list (NbtNode *node);
 const char *nbt_node_get_key (const NbtNode *node);
 void nbt_node_reset_key (const NbtNode *node, const char *key);
 gboolean nbt_node_prepend (NbtNode *node, NbtNode *child);
@@ -56,11 +81,26 @@ gboolean nbt_node_insert_before (NbtNode *parent, NbtNode *sibling,
                                  NbtNode *node);
 gboolean nbt_node_insert_after (NbtNode *parent, NbtNode *sibling,
                                 NbtNode *node);
+/**
+ * @brief Get the child at `index`.
+ *
+ * The tree isn't changed. An element of a packed list of numbers has no
+ * node in the tree, it's returned as a new node without a parent.
+ * @return The child, or NULL if there's none. The node of a packed element
+ * is to be freed by `nbt_node_free`
+ */
 NbtNode *nbt_node_child_to_index (NbtNode *root, int index);
 NbtNode *nbt_node_child_to_key (NbtNode *root, const char *key);
 gboolean nbt_node_remove_node_index (NbtNode *root, int index);
 gboolean nbt_node_remove_node_key (NbtNode *root, const char *key);
 NbtNode *nbt_node_dup (NbtNode *root);
+void nbt_node_unshare (NbtNode *node);
+gboolean nbt_node_set_string (NbtNode *node, const char *value);
+gboolean nbt_node_set_byte_array (NbtNode *node, const gint8 *value,
+                                  int len);
+gboolean nbt_node_set_int_array (NbtNode *node, const gint32 *value, int len);
+gboolean nbt_node_set_long_array (NbtNode *node, const gint64 *value,
+                                  int len);
 
 G_END_DECLS
 